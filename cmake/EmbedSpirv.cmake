@@ -0,0 +1,18 @@
+# Turns a SPIR-V binary into a header with a constexpr word array.
+# Usage: cmake -DINPUT=<file.spv> -DOUTPUT=<file.h> -DSYMBOL=<name> -P EmbedSpirv.cmake
+
+file(READ "${INPUT}" SPIRV_HEX HEX)
+string(LENGTH "${SPIRV_HEX}" SPIRV_HEX_LENGTH)
+math(EXPR SPIRV_REMAINDER "${SPIRV_HEX_LENGTH} % 8")
+if (SPIRV_HEX_LENGTH EQUAL 0 OR NOT SPIRV_REMAINDER EQUAL 0)
+    message(FATAL_ERROR "${INPUT} is not a valid SPIR-V binary")
+endif ()
+
+# SPIR-V is a stream of little-endian 32-bit words.
+string(REGEX REPLACE "(..)(..)(..)(..)" "0x\\4\\3\\2\\1u, " SPIRV_WORDS "${SPIRV_HEX}")
+
+file(WRITE "${OUTPUT}"
+    "#pragma once\n\n"
+    "namespace veng {\n\n"
+    "    inline constexpr std::uint32_t ${SYMBOL}[] = {${SPIRV_WORDS}};\n"
+    "}\n")
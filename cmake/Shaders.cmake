@@ -1,3 +1,16 @@
+option(VENG_EMBED_SHADERS "Embed compiled SPIR-V into the executable instead of loading .spv files" ON)
+
+set(VENG_EMBED_SPIRV_SCRIPT "${CMAKE_CURRENT_LIST_DIR}/EmbedSpirv.cmake")
+
+# Every shader the engine loads through ShaderRegistry. Register them all with
+# add_shaders(<target> ${VENG_SHADER_SOURCES}) so none is missing at run time; included files such as
+# bindless.glsl are not listed.
+set(VENG_SHADER_SOURCES
+    "${CMAKE_CURRENT_LIST_DIR}/../shaders/basic.vert"
+    "${CMAKE_CURRENT_LIST_DIR}/../shaders/basic.frag"
+    "${CMAKE_CURRENT_LIST_DIR}/../shaders/cull.comp"
+)
+
 function(add_shaders TARGET_NAME)
     set(SHADER_SOURCE_FILES ${ARGN})
     list(LENGTH SHADER_SOURCE_FILES FILE_COUNT)
@@ -7,6 +20,9 @@ function(add_shaders TARGET_NAME)
 
     set(SHADER_COMMANDS)
     set(SHADER_PRODUCTS)
+    set(EMBEDDED_INCLUDES)
+    set(EMBEDDED_ENTRIES)
+    set(EMBEDDED_DIR "${CMAKE_CURRENT_BINARY_DIR}/embedded_shaders")
 
     foreach (SHADER_SOURCE IN LISTS SHADER_SOURCE_FILES)
         cmake_path(ABSOLUTE_PATH SHADER_SOURCE NORMALIZE)
@@ -22,6 +38,20 @@ function(add_shaders TARGET_NAME)
         # PRODUCTS
         list(APPEND SHADER_PRODUCTS "${CMAKE_CURRENT_BINARY_DIR}/${SHADER_NAME}.spv")
 
+        # EMBEDDING
+        if (VENG_EMBED_SHADERS)
+            string(MAKE_C_IDENTIFIER "${SHADER_NAME}.spv" SHADER_SYMBOL)
+            list(APPEND SHADER_COMMANDS COMMAND "${CMAKE_COMMAND}")
+            list(APPEND SHADER_COMMANDS "-DINPUT=${CMAKE_CURRENT_BINARY_DIR}/${SHADER_NAME}.spv")
+            list(APPEND SHADER_COMMANDS "-DOUTPUT=${EMBEDDED_DIR}/${SHADER_SYMBOL}.h")
+            list(APPEND SHADER_COMMANDS "-DSYMBOL=${SHADER_SYMBOL}")
+            list(APPEND SHADER_COMMANDS -P "${VENG_EMBED_SPIRV_SCRIPT}")
+
+            list(APPEND SHADER_PRODUCTS "${EMBEDDED_DIR}/${SHADER_SYMBOL}.h")
+            string(APPEND EMBEDDED_INCLUDES "#include <${SHADER_SYMBOL}.h>\n")
+            string(APPEND EMBEDDED_ENTRIES "        EmbeddedShader{\"${SHADER_NAME}.spv\", ${SHADER_SYMBOL}},\n")
+        endif ()
+
     endforeach ()
 
     add_custom_target(${TARGET_NAME} ALL
@@ -31,4 +61,25 @@ function(add_shaders TARGET_NAME)
         BYPRODUCTS ${SHADER_PRODUCTS}
     )
 
-endfunction()
\ No newline at end of file
+    # Targets linking ${TARGET_NAME}_embedded get the SPIR-V as constexpr word arrays through <embedded_shaders.h>.
+    if (VENG_EMBED_SHADERS)
+        file(WRITE "${EMBEDDED_DIR}/embedded_shaders.h"
+            "#pragma once\n\n"
+            "${EMBEDDED_INCLUDES}\n"
+            "namespace veng {\n\n"
+            "    struct EmbeddedShader {\n"
+            "        std::string_view name;\n"
+            "        gsl::span<const std::uint32_t> code;\n"
+            "    };\n\n"
+            "    inline constexpr std::array kEmbeddedShaders = {\n"
+            "${EMBEDDED_ENTRIES}"
+            "    };\n"
+            "}\n")
+
+        add_library(${TARGET_NAME}_embedded INTERFACE)
+        target_include_directories(${TARGET_NAME}_embedded INTERFACE "${EMBEDDED_DIR}")
+        target_compile_definitions(${TARGET_NAME}_embedded INTERFACE VENG_EMBEDDED_SHADERS)
+        add_dependencies(${TARGET_NAME}_embedded ${TARGET_NAME})
+    endif ()
+
+endfunction()
@@ -1,7 +1,25 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "bindless.glsl"
+
+layout(location = 0) in vec3 in_normal;
+layout(location = 1) in vec2 in_uv;
+layout(location = 2) in vec4 in_color;
 
 layout(location = 0) out vec4 out_color;
 
+// Set with Graphics::SetTexture, no texture unless one was.
+layout(push_constant) uniform Material {
+    uint textureHandle;
+} material;
+
 void main() {
-    out_color = vec4(1.0, 0.0, 0.5, 1.0);
-}
\ No newline at end of file
+    // Surfaces facing the viewer keep the full instance colour.
+    float facing = 0.5 + 0.5 * normalize(in_normal).z;
+    vec4 albedo = in_color;
+    if (material.textureHandle != kInvalidBindlessHandle) {
+        albedo *= SampleBindless(material.textureHandle, in_uv);
+    }
+    out_color = albedo * vec4(vec3(facing), 1.0);
+}
@@ -1,13 +1,45 @@
 #version 450
 
-vec2 hardcoded_positions[3] = vec2[](
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
+// Compact meshes store normals octahedral-encoded in two snorm components, float32 meshes store them as they are.
+layout(constant_id = 0) const bool kOctahedralNormals = true;
 
-);
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec3 in_normal;
+layout(location = 2) in vec2 in_uv;
+
+layout(location = 0) out vec3 out_normal;
+layout(location = 1) out vec2 out_uv;
+layout(location = 2) out vec4 out_color;
+
+// Rows of a 3x4 affine transform, matching veng::InstanceData.
+struct Instance {
+    vec4 transform[3];
+    vec4 color;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Instances {
+    Instance instances[];
+};
+
+vec3 DecodeOctahedral(vec2 encoded) {
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = clamp(-normal.z, 0.0, 1.0);
+    normal.x += normal.x >= 0.0 ? -fold : fold;
+    normal.y += normal.y >= 0.0 ? -fold : fold;
+    return normalize(normal);
+}
 
 void main() {
-    vec2 currentPosition = hardcoded_positions[gl_VertexIndex];
-    gl_Position = vec4(currentPosition, 0.0, 1.0);
-}
\ No newline at end of file
+    // gl_InstanceIndex includes the draw's first instance, so it indexes the frame's region directly.
+    Instance instance = instances[gl_InstanceIndex];
+    vec4 position = vec4(in_position, 1.0);
+    vec3 normal = kOctahedralNormals ? DecodeOctahedral(in_normal.xy) : in_normal;
+
+    // Transforms are assumed to scale uniformly, so the normal needs no inverse transpose.
+    out_normal = normalize(vec3(dot(instance.transform[0].xyz, normal), dot(instance.transform[1].xyz, normal),
+                                dot(instance.transform[2].xyz, normal)));
+    out_uv = in_uv;
+    out_color = instance.color;
+    gl_Position = vec4(dot(instance.transform[0], position), dot(instance.transform[1], position),
+                       dot(instance.transform[2], position), 1.0);
+}
@@ -0,0 +1,23 @@
+// The bindless table, matching veng::BindlessHeap. Resources are indexed by the handles the heap returns.
+#extension GL_EXT_nonuniform_qualifier : require
+
+#ifndef BINDLESS_SET
+#define BINDLESS_SET 2
+#endif
+
+const uint kInvalidBindlessHandle = 0xFFFFFFFFu;
+
+layout(set = BINDLESS_SET, binding = 0) uniform sampler2D bindlessTextures[];
+
+layout(std430, set = BINDLESS_SET, binding = 1) readonly buffer BindlessBuffer {
+    uint words[];
+} bindlessBuffers[];
+
+// Handles may differ between invocations of a draw, e.g. when read from per-instance data.
+vec4 SampleBindless(uint handle, vec2 uv) {
+    return texture(bindlessTextures[nonuniformEXT(handle)], uv);
+}
+
+uint LoadBindless(uint handle, uint wordIndex) {
+    return bindlessBuffers[nonuniformEXT(handle)].words[wordIndex];
+}
@@ -0,0 +1,899 @@
+#include <precomp.h>
+#include <benchmarks.h>
+#include <frustum_culling.h>
+#include <graphics.h>
+#include <job_system.h>
+#include <mesh_file.h>
+#include <obj_loader.h>
+#include <scene.h>
+#include <spdlog/spdlog.h>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <random>
+
+namespace veng {
+
+    static std::vector<std::uint32_t> GetThreadCountSweep(std::uint32_t maxThreads) {
+        std::vector<std::uint32_t> threadCounts;
+        for (std::uint32_t threads = 1; threads < maxThreads; threads *= 2) {
+            threadCounts.push_back(threads);
+        }
+        threadCounts.push_back(maxThreads);
+        return threadCounts;
+    }
+
+    static void BenchmarkCommandRecording() {
+        constexpr std::uint32_t kDrawCount = 50000;
+        constexpr std::uint32_t kWarmupFrames = 10;
+        constexpr std::uint32_t kMeasuredFrames = 100;
+
+        Graphics graphics(glm::ivec2(800, 600));
+
+        double singleThreadTime = 0.0;
+        for (std::uint32_t threads : GetThreadCountSweep(graphics.GetRecordingSliceCount())) {
+            std::chrono::duration<double, std::milli> recordTime{0.0};
+
+            for (std::uint32_t frame = 0; frame < kWarmupFrames + kMeasuredFrames; ++frame) {
+                if (!graphics.BeginFrame(RecordingMode::Parallel)) continue;
+
+                const auto start = std::chrono::steady_clock::now();
+                graphics.RenderTrianglesParallel(kDrawCount, threads);
+                if (frame >= kWarmupFrames) {
+                    recordTime += std::chrono::steady_clock::now() - start;
+                }
+
+                graphics.EndFrame();
+            }
+
+            const double averageTime = recordTime.count() / kMeasuredFrames;
+            if (threads == 1) singleThreadTime = averageTime;
+            spdlog::info("Recorded {} draws on {} threads in {:.3f} ms ({:.2f}x)", kDrawCount, threads, averageTime,
+                         singleThreadTime / averageTime);
+        }
+    }
+
+    static void BenchmarkJobSystem() {
+        constexpr std::uint32_t kJobCount = 100000;
+        JobSystem& jobSystem = JobSystem::Get();
+        spdlog::info("Job system running on {} threads", jobSystem.GetThreadCount());
+
+        // Spawn and run empty jobs from the main thread, which measures the per-job overhead.
+        {
+            const auto start = std::chrono::steady_clock::now();
+            JobCounter counter;
+            for (std::uint32_t i = 0; i < kJobCount; ++i) {
+                jobSystem.Spawn([] {}, &counter);
+            }
+            jobSystem.Wait(counter);
+            const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+            spdlog::info("Spawn and run: {:.1f} ns per job", elapsed.count() / kJobCount);
+        }
+
+        // One job fans out all the work from a worker's deque, so every other thread has to steal its share.
+        {
+            std::atomic<std::uint32_t> executedCount = 0;
+            const auto start = std::chrono::steady_clock::now();
+            JobCounter root;
+            jobSystem.Spawn([&jobSystem, &executedCount] {
+                JobCounter children;
+                for (std::uint32_t i = 0; i < kJobCount; ++i) {
+                    jobSystem.Spawn([&executedCount] { executedCount.fetch_add(1, std::memory_order_relaxed); }, &children);
+                }
+                jobSystem.Wait(children);
+            }, &root);
+            jobSystem.Wait(root);
+            const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+            spdlog::info("Fan-out with stealing: {:.1f} ns per job ({} jobs)", elapsed.count() / kJobCount, executedCount.load());
+        }
+
+        // Jobs whose dependency is still running are parked on its counter rather than requeued, so idle workers
+        // sleep instead of spinning on them.
+        {
+            std::atomic<bool> consumersSpawned = false;
+            std::atomic<bool> produced = false;
+            std::atomic<std::uint32_t> earlyCount = 0;
+            const auto start = std::chrono::steady_clock::now();
+            JobCounter producer;
+            JobCounter consumers;
+            jobSystem.Spawn([&consumersSpawned, &produced] {
+                while (!consumersSpawned.load(std::memory_order_acquire)) {
+                    std::this_thread::yield();
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                produced.store(true, std::memory_order_release);
+            }, &producer);
+            for (std::uint32_t i = 0; i < kJobCount; ++i) {
+                jobSystem.Spawn([&produced, &earlyCount] {
+                    if (!produced.load(std::memory_order_acquire)) earlyCount.fetch_add(1, std::memory_order_relaxed);
+                }, &consumers, &producer);
+            }
+            consumersSpawned.store(true, std::memory_order_release);
+            jobSystem.Wait(consumers);
+            const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+            spdlog::info("Dependent jobs: {:.1f} ns per job including a 5 ms producer, {} ran before it finished",
+                         elapsed.count() / kJobCount, earlyCount.load());
+        }
+
+        // A parallel sum compared against the same loop on one thread.
+        {
+            constexpr std::uint32_t kElementCount = 1u << 24;
+            std::vector<std::uint32_t> values(kElementCount);
+            std::iota(values.begin(), values.end(), 0u);
+
+            auto start = std::chrono::steady_clock::now();
+            const std::uint64_t serialSum = std::accumulate(values.begin(), values.end(), std::uint64_t{0});
+            const std::chrono::duration<double, std::milli> serialTime = std::chrono::steady_clock::now() - start;
+
+            std::atomic<std::uint64_t> parallelSum = 0;
+            start = std::chrono::steady_clock::now();
+            jobSystem.ParallelFor(kElementCount, 1u << 16, [&values, &parallelSum](std::uint32_t first, std::uint32_t last) {
+                parallelSum.fetch_add(std::accumulate(values.begin() + first, values.begin() + last, std::uint64_t{0}),
+                                      std::memory_order_relaxed);
+            });
+            const std::chrono::duration<double, std::milli> parallelTime = std::chrono::steady_clock::now() - start;
+
+            spdlog::info("ParallelFor sum of {} values: {:.3f} ms vs {:.3f} ms serial ({:.2f}x, {})", kElementCount,
+                         parallelTime.count(), serialTime.count(), serialTime / parallelTime,
+                         parallelSum.load() == serialSum ? "results match" : "RESULTS DIFFER");
+        }
+    }
+
+    static void CreateGrid(std::uint32_t resolution, std::vector<Vertex>& vertices, std::vector<std::uint32_t>& indices) {
+        vertices.clear();
+        indices.clear();
+        vertices.reserve(static_cast<std::size_t>(resolution + 1) * (resolution + 1));
+        indices.reserve(static_cast<std::size_t>(resolution) * resolution * 6);
+
+        for (std::uint32_t y = 0; y <= resolution; ++y) {
+            for (std::uint32_t x = 0; x <= resolution; ++x) {
+                const glm::vec2 uv(static_cast<float>(x) / resolution, static_cast<float>(y) / resolution);
+                const float angle = uv.x * 6.2831853f;
+                vertices.push_back({glm::vec3(uv.x * 2.0f - 1.0f, uv.y * 2.0f - 1.0f, 0.0f),
+                                    glm::vec3(std::sin(angle) * 0.6f, (uv.y - 0.5f) * 0.6f, std::cos(angle)), uv});
+            }
+        }
+
+        for (std::uint32_t y = 0; y < resolution; ++y) {
+            for (std::uint32_t x = 0; x < resolution; ++x) {
+                const std::uint32_t corner = y * (resolution + 1) + x;
+                indices.insert(indices.end(), {corner, corner + 1, corner + resolution + 1,
+                                               corner + 1, corner + resolution + 2, corner + resolution + 1});
+            }
+        }
+    }
+
+    static void BenchmarkVertexFormats() {
+        constexpr std::uint32_t kGridResolution = 1023;
+        constexpr std::uint32_t kMeasuredFrames = 200;
+
+        std::vector<Vertex> vertices;
+        std::vector<std::uint32_t> indices;
+        CreateGrid(kGridResolution, vertices, indices);
+
+        // Encoder throughput, and a check that the vectorised path produces exactly what the scalar one does.
+        std::vector<CompactVertex> vectorised(vertices.size());
+        std::vector<CompactVertex> scalar(vertices.size());
+
+        auto start = std::chrono::steady_clock::now();
+        CompressVertices(vertices, vectorised);
+        const std::chrono::duration<double, std::milli> vectorisedTime = std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        CompressVerticesScalar(vertices, scalar);
+        const std::chrono::duration<double, std::milli> scalarTime = std::chrono::steady_clock::now() - start;
+
+        const bool identical = std::memcmp(vectorised.data(), scalar.data(), scalar.size() * sizeof(CompactVertex)) == 0;
+        spdlog::info("Encoded {} vertices in {:.3f} ms vectorised vs {:.3f} ms scalar ({:.2f}x, {})", vertices.size(),
+                     vectorisedTime.count(), scalarTime.count(), scalarTime / vectorisedTime,
+                     identical ? "outputs identical" : "OUTPUTS DIFFER");
+
+        Graphics graphics(glm::ivec2(800, 600));
+        std::array<double, kVertexLayoutCount> gpuTimes = {};
+        std::array<VkDeviceSize, kVertexLayoutCount> meshBytes = {};
+
+        for (std::size_t layoutIndex = 0; layoutIndex < kVertexLayoutCount; ++layoutIndex) {
+            const VertexLayout layout = static_cast<VertexLayout>(layoutIndex);
+            std::unique_ptr<Mesh> mesh = graphics.CreateMesh(vertices, indices, layout);
+            meshBytes[layoutIndex] = mesh->GetVertexBytes() + mesh->GetIndexBytes();
+
+            std::uint32_t measuredFrames = 0;
+            for (std::uint32_t frame = 0; frame < kMeasuredFrames + graphics.GetFramesInFlight(); ++frame) {
+                if (!graphics.BeginFrame()) continue;
+                graphics.RenderMesh(*mesh);
+                graphics.EndFrame();
+
+                // Timestamps lag by the frames in flight, so the first few read back nothing from this mesh.
+                if (frame >= graphics.GetFramesInFlight()) {
+                    gpuTimes[layoutIndex] += graphics.GetGpuProfiler().GetLastFrameTime();
+                    ++measuredFrames;
+                }
+            }
+            gpuTimes[layoutIndex] /= std::max(measuredFrames, 1u);
+
+            spdlog::info("{} layout: {} byte stride, {:.2f} MiB of vertex and index data, {:.3f} ms GPU per frame",
+                         layout == VertexLayout::Compact ? "Compact" : "Float32", GetVertexStride(layout),
+                         meshBytes[layoutIndex] / (1024.0 * 1024.0), gpuTimes[layoutIndex]);
+
+            graphics.WaitIdle();
+        }
+
+        const std::size_t compact = static_cast<std::size_t>(VertexLayout::Compact);
+        const std::size_t float32 = static_cast<std::size_t>(VertexLayout::Float32);
+        spdlog::info("Compact meshes use {:.1f}% less memory, GPU frame time changed by {:+.1f}%",
+                     100.0 * (1.0 - static_cast<double>(meshBytes[compact]) / meshBytes[float32]),
+                     gpuTimes[float32] > 0.0 ? 100.0 * (gpuTimes[compact] / gpuTimes[float32] - 1.0) : 0.0);
+    }
+
+    // Lays the instances out on a square grid over the viewport, each spinning at its own phase.
+    static void WriteInstances(gsl::span<InstanceData> instances, float time) {
+        const auto side = static_cast<std::uint32_t>(std::ceil(std::sqrt(static_cast<double>(instances.size()))));
+        const float cellSize = 2.0f / side;
+        const float scale = cellSize * 0.8f;
+
+        JobSystem::Get().ParallelFor(static_cast<std::uint32_t>(instances.size()), 16384,
+            [instances, side, cellSize, scale, time](std::uint32_t first, std::uint32_t last) {
+                for (std::uint32_t i = first; i < last; ++i) {
+                    const float x = -1.0f + cellSize * (static_cast<float>(i % side) + 0.5f);
+                    const float y = -1.0f + cellSize * (static_cast<float>(i / side) + 0.5f);
+                    const float angle = time + static_cast<float>(i) * 0.01f;
+                    const float cosine = std::cos(angle) * scale;
+                    const float sine = std::sin(angle) * scale;
+
+                    InstanceData& instance = instances[i];
+                    instance.transform = {glm::vec4(cosine, -sine, 0.0f, x), glm::vec4(sine, cosine, 0.0f, y),
+                                          glm::vec4(0.0f, 0.0f, scale, 0.0f)};
+                    instance.color = glm::vec4(static_cast<float>(i % side) / side, static_cast<float>(i / side) / side, 0.5f, 1.0f);
+                }
+            });
+    }
+
+    static void BenchmarkInstancing() {
+        constexpr std::uint32_t kMaxInstanceCount = 1000000;
+        constexpr std::uint32_t kMeasuredFrames = 100;
+
+        Graphics graphics(glm::ivec2(800, 600));
+        const std::array<Vertex, 3> vertices = {{
+            {glm::vec3(0.0f, -0.5f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec2(0.5f, 0.0f)},
+            {glm::vec3(0.5f, 0.5f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec2(1.0f, 1.0f)},
+            {glm::vec3(-0.5f, 0.5f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec2(0.0f, 1.0f)},
+        }};
+        const std::array<std::uint32_t, 3> indices = {0, 1, 2};
+        std::unique_ptr<Mesh> mesh = graphics.CreateMesh(vertices, indices);
+
+        graphics.ReserveInstances(kMaxInstanceCount);
+
+        spdlog::info("{:>9} {:>12} {:>12} {:>12} {:>14}", "instances", "CPU ms", "GPU ms", "frame ms", "CPU ns/inst");
+        for (std::uint32_t instanceCount = 1; instanceCount <= kMaxInstanceCount; instanceCount *= 10) {
+            std::chrono::duration<double, std::milli> cpuTime{0.0};
+            double gpuTime = 0.0;
+            std::uint32_t measuredFrames = 0;
+            std::chrono::steady_clock::time_point firstMeasuredFrame;
+
+            for (std::uint32_t frame = 0; frame < kMeasuredFrames + graphics.GetFramesInFlight(); ++frame) {
+                if (frame == graphics.GetFramesInFlight()) {
+                    firstMeasuredFrame = std::chrono::steady_clock::now();
+                }
+                if (!graphics.BeginFrame()) continue;
+
+                // CPU cost of a frame: rewriting every instance in the mapped region, recording and submitting.
+                const auto start = std::chrono::steady_clock::now();
+                const std::optional<InstanceRange> instances = graphics.AllocateInstances(instanceCount);
+                if (!instances.has_value()) {
+                    std::exit(EXIT_FAILURE);
+                }
+                WriteInstances(instances->data, static_cast<float>(frame) * 0.02f);
+                graphics.RenderMesh(*mesh, instances.value());
+                graphics.EndFrame();
+
+                // The first frames in flight warm up and read back timestamps from before the sweep step.
+                if (frame >= graphics.GetFramesInFlight()) {
+                    cpuTime += std::chrono::steady_clock::now() - start;
+                    gpuTime += graphics.GetGpuProfiler().GetLastFrameTime();
+                    ++measuredFrames;
+                }
+            }
+            graphics.WaitIdle();
+            const std::chrono::duration<double, std::milli> wallTime = std::chrono::steady_clock::now() - firstMeasuredFrame;
+
+            measuredFrames = std::max(measuredFrames, 1u);
+            const double averageCpuTime = cpuTime.count() / measuredFrames;
+            spdlog::info("{:>9} {:>12.3f} {:>12.3f} {:>12.3f} {:>14.2f}", instanceCount, averageCpuTime, gpuTime / measuredFrames,
+                         wallTime.count() / measuredFrames, averageCpuTime * 1e6 / instanceCount);
+        }
+    }
+
+    // Right-handed perspective looking down -z with Vulkan's 0 to 1 depth range.
+    static glm::mat4 CreatePerspective(float verticalFov, float aspectRatio, float nearPlane, float farPlane) {
+        const float focalLength = 1.0f / std::tan(verticalFov * 0.5f);
+        glm::mat4 projection(0.0f);
+        projection[0][0] = focalLength / aspectRatio;
+        projection[1][1] = -focalLength;
+        projection[2][2] = farPlane / (nearPlane - farPlane);
+        projection[2][3] = -1.0f;
+        projection[3][2] = nearPlane * farPlane / (nearPlane - farPlane);
+        return projection;
+    }
+
+    static void CreateRandomVolumes(std::uint32_t count, std::uint32_t seed, BoundingSpheres& spheres, BoundingBoxes& boxes) {
+        std::mt19937 generator(seed);
+        std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+        std::uniform_real_distribution<float> size(0.1f, 20.0f);
+
+        spheres.Resize(count);
+        boxes.Resize(count);
+        for (std::uint32_t i = 0; i < count; ++i) {
+            const glm::vec3 center(position(generator), position(generator), position(generator));
+            const glm::vec3 extent(size(generator), size(generator), size(generator));
+            spheres.Set(i, center, extent.x);
+            boxes.Set(i, center - extent, center + extent);
+        }
+    }
+
+    // Checks every SIMD kernel against the scalar one, then measures culling throughput.
+    static void BenchmarkFrustumCulling() {
+        constexpr std::uint32_t kObjectCount = 1000000;
+        constexpr std::uint32_t kMeasuredRuns = 20;
+        constexpr std::array<CullingKernel, 3> kKernels = {CullingKernel::Scalar, CullingKernel::Sse, CullingKernel::Avx2};
+
+        const Frustum frustum = ExtractFrustum(CreatePerspective(1.0471976f, 16.0f / 9.0f, 0.1f, 400.0f));
+        BoundingSpheres spheres;
+        BoundingBoxes boxes;
+        std::vector<std::uint32_t> expected;
+        std::vector<std::uint32_t> actual;
+
+        // Counts that leave every kind of tail, plus volumes that touch a plane exactly.
+        bool allMatch = true;
+        for (std::uint32_t count : {0u, 1u, 7u, 9u, 1000u, 16385u, 100003u}) {
+            CreateRandomVolumes(count, count, spheres, boxes);
+            for (std::uint32_t i = 0; i < count; i += 5) {
+                const glm::vec4& plane = frustum.planes[i % frustum.planes.size()];
+                const glm::vec3 normal(plane.x, plane.y, plane.z);
+                spheres.Set(i, normal * (spheres.radius[i] * -1.0f - plane.w), spheres.radius[i]);
+            }
+
+            for (CullingKernel kernel : kKernels) {
+                if (!IsCullingKernelSupported(kernel) || kernel == CullingKernel::Scalar) continue;
+
+                CullSpheres(frustum, spheres, expected, CullingKernel::Scalar);
+                CullSpheres(frustum, spheres, actual, kernel);
+                const bool spheresMatch = actual == expected;
+
+                CullBoxes(frustum, boxes, expected, CullingKernel::Scalar);
+                CullBoxes(frustum, boxes, actual, kernel);
+                const bool boxesMatch = actual == expected;
+
+                if (!spheresMatch || !boxesMatch) {
+                    spdlog::error("{} culling of {} volumes differs from scalar (spheres {}, boxes {})", GetCullingKernelName(kernel),
+                                  count, spheresMatch ? "match" : "DIFFER", boxesMatch ? "match" : "DIFFER");
+                    allMatch = false;
+                }
+            }
+        }
+        spdlog::info("SIMD culling kernels {}", allMatch ? "match the scalar kernel" : "DIFFER FROM THE SCALAR KERNEL");
+
+        CreateRandomVolumes(kObjectCount, 42, spheres, boxes);
+        spdlog::info("Culling {} objects on {} threads", kObjectCount, JobSystem::Get().GetThreadCount());
+        for (CullingKernel kernel : kKernels) {
+            if (!IsCullingKernelSupported(kernel)) continue;
+
+            std::chrono::duration<double, std::milli> sphereTime{0.0};
+            std::chrono::duration<double, std::milli> boxTime{0.0};
+            for (std::uint32_t run = 0; run < kMeasuredRuns; ++run) {
+                auto start = std::chrono::steady_clock::now();
+                CullSpheres(frustum, spheres, actual, kernel);
+                sphereTime += std::chrono::steady_clock::now() - start;
+
+                start = std::chrono::steady_clock::now();
+                CullBoxes(frustum, boxes, expected, kernel);
+                boxTime += std::chrono::steady_clock::now() - start;
+            }
+
+            sphereTime /= kMeasuredRuns;
+            boxTime /= kMeasuredRuns;
+            spdlog::info("{:>6}: spheres {:.3f} ms ({:.0f} objects/ms, {} visible), boxes {:.3f} ms ({:.0f} objects/ms, {} visible)",
+                         GetCullingKernelName(kernel), sphereTime.count(), kObjectCount / sphereTime.count(), actual.size(),
+                         boxTime.count(), kObjectCount / boxTime.count(), expected.size());
+        }
+    }
+
+    // Objects on a grid twice the size of clip space, so about a quarter of them survive culling against it.
+    static std::vector<IndirectObject> CreateIndirectGrid(std::uint32_t count, std::uint32_t indexCount) {
+        const auto side = static_cast<std::uint32_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+        const float cellSize = 4.0f / side;
+        const float scale = cellSize * 0.8f;
+
+        std::vector<IndirectObject> objects(count);
+        for (std::uint32_t i = 0; i < count; ++i) {
+            const float x = -2.0f + cellSize * (static_cast<float>(i % side) + 0.5f);
+            const float y = -2.0f + cellSize * (static_cast<float>(i / side) + 0.5f);
+
+            IndirectObject& object = objects[i];
+            object.instance.transform = {glm::vec4(scale, 0.0f, 0.0f, x), glm::vec4(0.0f, scale, 0.0f, y),
+                                         glm::vec4(0.0f, 0.0f, scale, 0.5f)};
+            object.instance.color = glm::vec4(static_cast<float>(i % side) / side, static_cast<float>(i / side) / side, 0.5f, 1.0f);
+            // The triangle's corners lie within 0.71 of its origin.
+            object.boundingSphere = glm::vec4(x, y, 0.5f, scale * 0.71f);
+            object.indexCount = indexCount;
+        }
+        return objects;
+    }
+
+    // The CPU records the same commands for any number of GPU-culled objects, so its cost per frame should stay flat.
+    static void BenchmarkGpuCulling() {
+        constexpr std::uint32_t kMaxObjectCount = 1000000;
+        constexpr std::uint32_t kMeasuredFrames = 100;
+
+        Graphics graphics(glm::ivec2(800, 600));
+        if (!graphics.IsGpuCullingSupported()) {
+            spdlog::error("GPU culling is not available on this device or in this build");
+            return;
+        }
+
+        const std::array<Vertex, 3> vertices = {{
+            {glm::vec3(0.0f, -0.5f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec2(0.5f, 0.0f)},
+            {glm::vec3(0.5f, 0.5f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec2(1.0f, 1.0f)},
+            {glm::vec3(-0.5f, 0.5f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec2(0.0f, 1.0f)},
+        }};
+        const std::array<std::uint32_t, 3> indices = {0, 1, 2};
+        std::unique_ptr<Mesh> mesh = graphics.CreateMesh(vertices, indices);
+
+        spdlog::info("{:>9} {:>12} {:>12} {:>12}", "objects", "CPU ms", "GPU ms", "frame ms");
+        for (std::uint32_t objectCount = 1000; objectCount <= kMaxObjectCount; objectCount *= 10) {
+            graphics.SetIndirectObjects(CreateIndirectGrid(objectCount, mesh->GetIndexCount()));
+
+            std::chrono::duration<double, std::milli> cpuTime{0.0};
+            double gpuTime = 0.0;
+            std::uint32_t measuredFrames = 0;
+            std::chrono::steady_clock::time_point firstMeasuredFrame;
+
+            for (std::uint32_t frame = 0; frame < kMeasuredFrames + graphics.GetFramesInFlight(); ++frame) {
+                if (frame == graphics.GetFramesInFlight()) {
+                    firstMeasuredFrame = std::chrono::steady_clock::now();
+                }
+
+                if (!graphics.BeginFrame()) continue;
+
+                // BeginFrame has already recorded the culling dispatch, a fixed handful of commands.
+                const auto start = std::chrono::steady_clock::now();
+                graphics.RenderMeshIndirect(*mesh);
+                graphics.EndFrame();
+
+                if (frame >= graphics.GetFramesInFlight()) {
+                    cpuTime += std::chrono::steady_clock::now() - start;
+                    gpuTime += graphics.GetGpuProfiler().GetLastFrameTime();
+                    ++measuredFrames;
+                }
+            }
+            graphics.WaitIdle();
+            const std::chrono::duration<double, std::milli> wallTime = std::chrono::steady_clock::now() - firstMeasuredFrame;
+
+            measuredFrames = std::max(measuredFrames, 1u);
+            spdlog::info("{:>9} {:>12.3f} {:>12.3f} {:>12.3f}", objectCount, cpuTime.count() / measuredFrames, gpuTime / measuredFrames,
+                         wallTime.count() / measuredFrames);
+        }
+    }
+
+    static void BenchmarkRenderGraph() {
+        constexpr std::uint32_t kCompileCount = 100;
+        constexpr VkExtent2D kExtent = {1920, 1080};
+        constexpr VkExtent2D kHalfExtent = {kExtent.width / 2, kExtent.height / 2};
+        constexpr VkExtent2D kQuarterExtent = {kExtent.width / 4, kExtent.height / 4};
+
+        Graphics graphics(glm::ivec2(kExtent.width, kExtent.height));
+        std::unique_ptr<RenderGraph> graph = graphics.CreateRenderGraph();
+
+        // A deferred frame: geometry into a G-buffer, lighting into HDR, a two-level bloom chain and a tonemap into
+        // an image read back after the frame. The debug view writes an image nothing reads and must be culled.
+        const RenderGraphImage depth = graph->CreateImage("Depth", VK_FORMAT_D32_SFLOAT, kExtent);
+        const RenderGraphImage albedo = graph->CreateImage("Albedo", VK_FORMAT_R8G8B8A8_UNORM, kExtent);
+        const RenderGraphImage normal = graph->CreateImage("Normal", VK_FORMAT_R16G16B16A16_SFLOAT, kExtent);
+        const RenderGraphImage hdr = graph->CreateImage("HDR", VK_FORMAT_R16G16B16A16_SFLOAT, kExtent);
+        const RenderGraphImage bloomHalf = graph->CreateImage("Bloom half", VK_FORMAT_R16G16B16A16_SFLOAT, kHalfExtent);
+        const RenderGraphImage bloomQuarter = graph->CreateImage("Bloom quarter", VK_FORMAT_R16G16B16A16_SFLOAT, kQuarterExtent);
+        const RenderGraphImage ldr = graph->CreateImage("LDR", VK_FORMAT_R8G8B8A8_UNORM, kExtent);
+        const RenderGraphImage debug = graph->CreateImage("Debug", VK_FORMAT_R8G8B8A8_UNORM, kExtent);
+
+        const RenderGraphPass geometry = graph->AddPass("Geometry");
+        graph->ClearDepth(geometry, depth, 1.0f);
+        graph->ClearColor(geometry, albedo, {{0.0f, 0.0f, 0.0f, 0.0f}});
+        graph->ClearColor(geometry, normal, {{0.0f, 0.0f, 0.0f, 0.0f}});
+
+        const RenderGraphPass lighting = graph->AddPass("Lighting");
+        graph->Read(lighting, depth, ImageAccess::SampledRead);
+        graph->Read(lighting, albedo, ImageAccess::SampledRead);
+        graph->Read(lighting, normal, ImageAccess::SampledRead);
+        graph->ClearColor(lighting, hdr, {{0.0f, 0.0f, 0.0f, 0.0f}});
+
+        const RenderGraphPass debugView = graph->AddPass("Debug view");
+        graph->Read(debugView, normal, ImageAccess::SampledRead);
+        graph->Write(debugView, debug, ImageAccess::ColorAttachment);
+
+        const RenderGraphPass downsampleHalf = graph->AddPass("Bloom downsample half");
+        graph->Read(downsampleHalf, hdr, ImageAccess::SampledRead);
+        graph->Write(downsampleHalf, bloomHalf, ImageAccess::StorageWrite);
+
+        const RenderGraphPass downsampleQuarter = graph->AddPass("Bloom downsample quarter");
+        graph->Read(downsampleQuarter, bloomHalf, ImageAccess::SampledRead);
+        graph->Write(downsampleQuarter, bloomQuarter, ImageAccess::StorageWrite);
+
+        const RenderGraphPass upsample = graph->AddPass("Bloom upsample");
+        graph->Read(upsample, bloomQuarter, ImageAccess::SampledRead);
+        graph->Write(upsample, bloomHalf, ImageAccess::ColorAttachment);
+
+        const RenderGraphPass tonemap = graph->AddPass("Tonemap");
+        graph->Read(tonemap, hdr, ImageAccess::SampledRead);
+        graph->Read(tonemap, bloomHalf, ImageAccess::SampledRead);
+        graph->Write(tonemap, ldr, ImageAccess::ColorAttachment);
+
+        const RenderGraphPass readback = graph->AddPass("Readback");
+        graph->Read(readback, ldr, ImageAccess::TransferSource);
+        graph->SetSideEffects(readback);
+
+        const auto start = std::chrono::steady_clock::now();
+        for (std::uint32_t i = 0; i < kCompileCount; ++i) {
+            graph->Compile();
+        }
+        const std::chrono::duration<double, std::milli> compileTime = std::chrono::steady_clock::now() - start;
+
+        const RenderGraphStats& stats = graph->GetStats();
+        spdlog::info("{} passes, {} culled, {} barriers, compile {:.3f} ms", stats.passCount, stats.culledPassCount, stats.barrierCount,
+                     compileTime.count() / kCompileCount);
+        spdlog::info("{} transient images: {:.2f} MiB without aliasing, {:.2f} MiB aliased", stats.transientImageCount,
+                     stats.transientBytes / (1024.0 * 1024.0), stats.aliasedTransientBytes / (1024.0 * 1024.0));
+
+        if (!graph->IsPassCulled(debugView) || graph->IsPassCulled(readback)) {
+            spdlog::error("Render graph culled the wrong passes");
+            std::exit(EXIT_FAILURE);
+        }
+        if (stats.aliasedTransientBytes >= stats.transientBytes) {
+            spdlog::error("Render graph did not alias any transient memory");
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    static void BenchmarkUniforms() {
+        constexpr std::uint32_t kMeasuredFrames = 100;
+        constexpr std::array<std::uint32_t, 3> kDrawCounts = {100, 1000, 10000};
+
+        // A typical per-draw block: model matrix, tint and a few parameters.
+        struct DrawParameters {
+            glm::mat4 model;
+            glm::vec4 tint;
+            glm::vec4 parameters;
+        };
+
+        Graphics graphics(glm::ivec2(800, 600));
+        UniformAllocator& uniforms = graphics.GetUniformAllocator();
+
+        spdlog::info("{:>9} {:>12} {:>14}", "draws", "ns / push", "KiB / frame");
+        for (std::uint32_t drawCount : kDrawCounts) {
+            std::chrono::duration<double, std::nano> pushTime{0.0};
+            std::uint32_t measuredFrames = 0;
+
+            for (std::uint32_t frame = 0; frame < kMeasuredFrames; ++frame) {
+                if (!graphics.BeginFrame()) continue;
+
+                const auto start = std::chrono::steady_clock::now();
+                std::uint32_t pushed = 0;
+                std::uint32_t misaligned = 0;
+                for (std::uint32_t draw = 0; draw < drawCount; ++draw) {
+                    DrawParameters parameters = {};
+                    parameters.model = glm::mat4(static_cast<float>(draw));
+                    parameters.tint = glm::vec4(1.0f);
+                    const std::optional<std::uint32_t> offset = uniforms.Push(parameters);
+                    if (!offset.has_value()) break;
+                    misaligned += offset.value() % uniforms.GetAlignment() != 0 ? 1 : 0;
+                    ++pushed;
+                }
+                pushTime += std::chrono::steady_clock::now() - start;
+
+                graphics.EndFrame();
+
+                if (misaligned > 0) {
+                    spdlog::error("{} uniform offsets were not aligned", misaligned);
+                    std::exit(EXIT_FAILURE);
+                }
+                if (pushed < drawCount) {
+                    spdlog::warn("Only {} of {} draws fit in {} KiB", pushed, drawCount, uniforms.GetFrameCapacity() / 1024);
+                }
+                ++measuredFrames;
+            }
+            graphics.WaitIdle();
+
+            measuredFrames = std::max(measuredFrames, 1u);
+            spdlog::info("{:>9} {:>12.1f} {:>14.1f}", drawCount, pushTime.count() / (static_cast<double>(measuredFrames) * drawCount),
+                         uniforms.GetUsedBytes() / 1024.0);
+        }
+
+        spdlog::info("High-water mark {:.1f} KiB of {} KiB per frame", uniforms.GetHighWaterMark() / 1024.0,
+                     uniforms.GetFrameCapacity() / 1024);
+    }
+
+    static void BenchmarkBindless() {
+        constexpr std::uint32_t kMeasuredFrames = 200;
+        constexpr std::uint32_t kResidentBuffers = 10000;
+        // Streaming replaces 1% of the resident resources every frame.
+        constexpr std::uint32_t kChurnPerFrame = kResidentBuffers / 100;
+
+        Graphics graphics(glm::ivec2(800, 600));
+        BindlessHeap& heap = graphics.GetBindlessHeap();
+        const VkBuffer buffer = graphics.GetInstanceBuffer().GetBuffer();
+
+        if (heap.GetBufferCapacity() < kResidentBuffers + kChurnPerFrame * graphics.GetFramesInFlight()) {
+            spdlog::warn("Bindless heap only holds {} buffers, skipping", heap.GetBufferCapacity());
+            return;
+        }
+
+        std::vector<BindlessHandle> handles;
+        handles.reserve(kResidentBuffers);
+        for (std::uint32_t i = 0; i < kResidentBuffers; ++i) {
+            handles.push_back(heap.AddBuffer(buffer));
+        }
+
+        // A slot handed out again before the frames that removed it have completed would be a use-after-free on the GPU.
+        std::vector<std::uint64_t> removedInFrame(heap.GetBufferCapacity(), std::numeric_limits<std::uint64_t>::max());
+        std::mt19937 random(7);
+        std::uniform_int_distribution<std::uint32_t> pick(0, kResidentBuffers - 1);
+
+        std::chrono::duration<double, std::nano> updateTime{0.0};
+        std::uint32_t updates = 0;
+        std::uint32_t earlyReuses = 0;
+        for (std::uint64_t frame = 0; frame < kMeasuredFrames; ++frame) {
+            if (!graphics.BeginFrame()) continue;
+
+            const auto start = std::chrono::steady_clock::now();
+            for (std::uint32_t i = 0; i < kChurnPerFrame; ++i) {
+                BindlessHandle& handle = handles[pick(random)];
+                heap.RemoveBuffer(handle);
+                removedInFrame[handle.index] = frame;
+                handle = heap.AddBuffer(buffer);
+                if (!handle.IsValid()) {
+                    spdlog::error("Bindless heap ran out of buffer slots");
+                    std::exit(EXIT_FAILURE);
+                }
+                const std::uint64_t removed = removedInFrame[handle.index];
+                earlyReuses += removed != std::numeric_limits<std::uint64_t>::max() && frame - removed < graphics.GetFramesInFlight() ? 1 : 0;
+            }
+            updateTime += std::chrono::steady_clock::now() - start;
+            updates += kChurnPerFrame;
+
+            graphics.EndFrame();
+        }
+        graphics.WaitIdle();
+
+        if (earlyReuses > 0) {
+            spdlog::error("{} bindless slots were reused while a frame could still read them", earlyReuses);
+            std::exit(EXIT_FAILURE);
+        }
+
+        // Removing a handle twice must not free the slot twice; the second call is rejected and logged.
+        const std::uint32_t liveBuffers = heap.GetBufferCount();
+        heap.RemoveBuffer(handles.back());
+        heap.RemoveBuffer(handles.back());
+        if (heap.GetBufferCount() != liveBuffers - 1) {
+            spdlog::error("Removing a bindless buffer twice changed the live count by {}", liveBuffers - heap.GetBufferCount());
+            std::exit(EXIT_FAILURE);
+        }
+        handles.pop_back();
+
+        spdlog::info("{} resident buffers, {} replaced per frame: {:.1f} ns per replacement", heap.GetBufferCount(),
+                     kChurnPerFrame, updateTime.count() / std::max(updates, 1u));
+    }
+
+    static void BenchmarkScene() {
+        constexpr std::uint32_t kNodeCount = 1000000;
+        constexpr std::uint32_t kRootCount = 1000;
+        constexpr std::uint32_t kBranching = 10;
+        constexpr std::uint32_t kMeasuredFrames = 100;
+        // 1% of the nodes move every frame.
+        constexpr std::uint32_t kChangesPerFrame = kNodeCount / 100;
+
+        Graphics graphics(glm::ivec2(800, 600));
+        graphics.ReserveInstances(kNodeCount);
+
+        // Every frame in flight has its own copy of the instances, so each change is written once per copy.
+        Scene scene(graphics.GetFramesInFlight());
+        std::mt19937 random(11);
+        std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+
+        // Roots first, then each node takes the next free child slot of an earlier node: a tree kBranching wide.
+        std::vector<SceneNode> nodes;
+        nodes.reserve(kNodeCount);
+        for (std::uint32_t i = 0; i < kNodeCount; ++i) {
+            const SceneNode parent = i < kRootCount ? SceneNode{} : nodes[(i - kRootCount) / kBranching];
+            const SceneNode node = scene.CreateNode(parent);
+            scene.SetPosition(node, glm::vec3(offset(random), offset(random), offset(random)));
+            scene.SetRotation(node, glm::angleAxis(offset(random), glm::vec3(0.0f, 0.0f, 1.0f)));
+            scene.SetScale(node, glm::vec3(0.9f));
+            nodes.push_back(node);
+        }
+
+        std::uniform_int_distribution<std::uint32_t> pick(0, kNodeCount - 1);
+        std::chrono::duration<double, std::milli> initialTime{0.0};
+        std::chrono::duration<double, std::milli> updateTime{0.0};
+        std::uint64_t recomputedCount = 0;
+        std::uint64_t writtenCount = 0;
+        std::uint32_t levelCount = 0;
+        std::uint32_t measuredFrames = 0;
+        gsl::span<InstanceData> instances;
+
+        // The first frames write every node once per copy and are reported separately.
+        const std::uint32_t warmupFrames = graphics.GetFramesInFlight();
+        for (std::uint32_t frame = 0; frame < warmupFrames + kMeasuredFrames; ++frame) {
+            if (!graphics.BeginFrame()) continue;
+
+            const bool warmup = frame < warmupFrames;
+            if (!warmup) {
+                for (std::uint32_t i = 0; i < kChangesPerFrame; ++i) {
+                    const SceneNode node = nodes[pick(random)];
+                    scene.SetPosition(node, scene.GetPosition(node) + glm::vec3(0.01f, 0.0f, 0.0f));
+                }
+            }
+
+            // The scene's range is the frame's first allocation, so each frame in flight gets the same region back.
+            const std::optional<InstanceRange> range = graphics.AllocateInstances(kNodeCount);
+            if (!range.has_value()) {
+                std::exit(EXIT_FAILURE);
+            }
+            instances = range->data;
+            const auto start = std::chrono::steady_clock::now();
+            const SceneUpdateStats stats = scene.Update(instances);
+            const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+            if (warmup) {
+                initialTime += elapsed;
+            } else {
+                updateTime += elapsed;
+                recomputedCount += stats.recomputedCount;
+                writtenCount += stats.writtenCount;
+                ++measuredFrames;
+            }
+            levelCount = stats.levelCount;
+
+            graphics.EndFrame();
+        }
+        graphics.WaitIdle();
+
+        // Every node's world transform must be its parent's applied to its local position. The instances must match too,
+        // which catches copies that missed a write.
+        std::uint32_t mismatches = 0;
+        for (std::uint32_t i = 0; i < 1000; ++i) {
+            const SceneNode node = nodes[pick(random)];
+            const std::array<glm::vec4, 3>& world = scene.GetWorldTransform(node);
+            const SceneNode parent = scene.GetParent(node);
+            if (parent.IsValid()) {
+                const std::array<glm::vec4, 3>& parentWorld = scene.GetWorldTransform(parent);
+                const glm::vec3 position = scene.GetPosition(node);
+                for (std::size_t row = 0; row < 3; ++row) {
+                    const float expected = parentWorld[row].x * position.x + parentWorld[row].y * position.y +
+                                           parentWorld[row].z * position.z + parentWorld[row].w;
+                    mismatches += std::abs(world[row].w - expected) > 1e-3f ? 1 : 0;
+                }
+            }
+            const InstanceData& instance = instances[scene.GetInstanceIndex(node)];
+            mismatches += std::memcmp(instance.transform.data(), world.data(), sizeof(world)) != 0 ? 1 : 0;
+        }
+        if (mismatches > 0) {
+            spdlog::error("{} scene transforms did not match their parents or their instances", mismatches);
+            std::exit(EXIT_FAILURE);
+        }
+
+        measuredFrames = std::max(measuredFrames, 1u);
+        spdlog::info("{} nodes in {} levels on {} threads, first update {:.3f} ms", kNodeCount, levelCount,
+                     JobSystem::Get().GetThreadCount(), initialTime.count() / warmupFrames);
+        spdlog::info("{} changes per frame: {:.3f} ms per update, {:.0f} world transforms recomputed, {:.0f} instances written",
+                     kChangesPerFrame, updateTime.count() / measuredFrames, static_cast<double>(recomputedCount) / measuredFrames,
+                     static_cast<double>(writtenCount) / measuredFrames);
+    }
+
+    static bool WriteGridObj(const std::filesystem::path& filePath, std::uint32_t resolution) {
+        std::vector<Vertex> vertices;
+        std::vector<std::uint32_t> indices;
+        CreateGrid(resolution, vertices, indices);
+
+        std::ofstream file(filePath, std::ios::trunc);
+        if (!file.is_open()) return false;
+
+        for (const Vertex& vertex : vertices) {
+            file << "v " << vertex.position.x << ' ' << vertex.position.y << ' ' << vertex.position.z << '\n';
+        }
+        for (const Vertex& vertex : vertices) {
+            file << "vt " << vertex.uv.x << ' ' << vertex.uv.y << '\n';
+        }
+        for (std::size_t i = 0; i < indices.size(); i += 3) {
+            file << "f " << indices[i] + 1 << '/' << indices[i] + 1 << ' ' << indices[i + 1] + 1 << '/' << indices[i + 1] + 1 << ' '
+                 << indices[i + 2] + 1 << '/' << indices[i + 2] + 1 << '\n';
+        }
+        return static_cast<bool>(file);
+    }
+
+    static std::vector<std::uint8_t> CopyToStaging(const MeshView& view) {
+        std::vector<std::uint8_t> staging(view.vertexData.size() + view.indexData.size());
+        std::memcpy(staging.data(), view.vertexData.data(), view.vertexData.size());
+        std::memcpy(staging.data() + view.vertexData.size(), view.indexData.data(), view.indexData.size());
+        return staging;
+    }
+
+    // Set VENG_BENCHMARK_MESH to an OBJ file to measure a real, e.g. multi-gigabyte, asset instead of the generated grid.
+    static void BenchmarkMeshLoading() {
+        constexpr std::uint32_t kGridResolution = 1500;
+
+        const std::filesystem::path temporaryDirectory = std::filesystem::temp_directory_path();
+        std::filesystem::path objPath = temporaryDirectory / "veng_benchmark.obj";
+        const std::filesystem::path meshPath = temporaryDirectory / "veng_benchmark.vmesh";
+
+        const bool generated = std::getenv("VENG_BENCHMARK_MESH") == nullptr;
+        if (generated) {
+            if (!WriteGridObj(objPath, kGridResolution)) {
+                spdlog::error("Cannot write {}", objPath.string());
+                return;
+            }
+        } else {
+            objPath = std::getenv("VENG_BENCHMARK_MESH");
+        }
+
+        std::vector<Vertex> vertices;
+        std::vector<std::uint32_t> indices;
+        if (!LoadObj(objPath, vertices, indices) || !MeshFile::Write(meshPath, EncodeMesh(vertices, indices, VertexLayout::Compact).View())) {
+            return;
+        }
+
+        // Both paths end with the mesh in one contiguous staging allocation, which is what an upload needs. The files
+        // were just written, so both are measured against a warm page cache.
+        auto start = std::chrono::steady_clock::now();
+        std::size_t parsedBytes = 0;
+        {
+            if (!LoadObj(objPath, vertices, indices)) return;
+            const EncodedMesh encoded = EncodeMesh(vertices, indices, VertexLayout::Compact);
+            parsedBytes = CopyToStaging(encoded.View()).size();
+        }
+        const std::chrono::duration<double, std::milli> parseTime = std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        std::size_t mappedBytes = 0;
+        {
+            const std::optional<MeshFile> meshFile = MeshFile::Open(meshPath);
+            if (!meshFile.has_value()) return;
+            mappedBytes = CopyToStaging(meshFile->View()).size();
+        }
+        const std::chrono::duration<double, std::milli> mapTime = std::chrono::steady_clock::now() - start;
+
+        const double objMegabytes = std::filesystem::file_size(objPath) / (1024.0 * 1024.0);
+        const double meshMegabytes = std::filesystem::file_size(meshPath) / (1024.0 * 1024.0);
+        spdlog::info("OBJ ({:.1f} MiB): parsed and encoded into {} staging bytes in {:.1f} ms", objMegabytes, parsedBytes, parseTime.count());
+        spdlog::info("Mesh file ({:.1f} MiB): mapped into {} staging bytes in {:.1f} ms ({:.0f} MiB/s, {:.1f}x faster)", meshMegabytes,
+                     mappedBytes, mapTime.count(), meshMegabytes / (mapTime.count() / 1000.0), parseTime / mapTime);
+
+        std::filesystem::remove(meshPath);
+        if (generated) {
+            std::filesystem::remove(objPath);
+        }
+    }
+
+    bool RunBenchmark(std::string_view name) {
+        static const std::array<std::pair<std::string_view, void (*)()>, 11> kBenchmarks = {{
+            {"record", BenchmarkCommandRecording},
+            {"jobs", BenchmarkJobSystem},
+            {"vertex", BenchmarkVertexFormats},
+            {"mesh-load", BenchmarkMeshLoading},
+            {"instancing", BenchmarkInstancing},
+            {"culling", BenchmarkFrustumCulling},
+            {"gpu-culling", BenchmarkGpuCulling},
+            {"render-graph", BenchmarkRenderGraph},
+            {"uniforms", BenchmarkUniforms},
+            {"bindless", BenchmarkBindless},
+            {"scene", BenchmarkScene},
+        }};
+
+        for (const auto& [benchmarkName, benchmark] : kBenchmarks) {
+            if (benchmarkName == name) {
+                benchmark();
+                return true;
+            }
+        }
+
+        spdlog::error("Unknown benchmark {}", name);
+        return false;
+    }
+}
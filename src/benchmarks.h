@@ -0,0 +1,7 @@
+#pragma once
+
+namespace veng {
+
+    // Runs the named benchmark and logs its results, returns false when no benchmark has that name.
+    bool RunBenchmark(std::string_view name);
+}
@@ -0,0 +1,220 @@
+#include <precomp.h>
+#include <bindless_heap.h>
+#include <spdlog/spdlog.h>
+
+namespace veng {
+
+    std::optional<std::uint32_t> BindlessHeap::SlotAllocator::Allocate() {
+        std::uint32_t slot = 0;
+        if (nextUnused < capacity) {
+            slot = nextUnused++;
+        } else if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            return std::nullopt;
+        }
+        live[slot] = true;
+        ++liveCount;
+        return slot;
+    }
+
+    bool BindlessHeap::SlotAllocator::Remove(std::uint32_t slot) {
+        if (slot >= capacity || !live[slot]) {
+            return false;
+        }
+        live[slot] = false;
+        removedSlots.push_back(slot);
+        --liveCount;
+        return true;
+    }
+
+    void BindlessHeap::SlotAllocator::Retire(std::uint64_t submittedTimelineValue) {
+        for (std::uint32_t slot : removedSlots) {
+            retiringSlots.emplace_back(submittedTimelineValue, slot);
+        }
+        removedSlots.clear();
+    }
+
+    void BindlessHeap::SlotAllocator::Recycle(std::uint64_t completedTimelineValue) {
+        // Frames retire in submission order, so the oldest removals come first.
+        while (!retiringSlots.empty() && retiringSlots.front().first <= completedTimelineValue) {
+            freeSlots.push_back(retiringSlots.front().second);
+            retiringSlots.pop_front();
+        }
+    }
+
+    BindlessHeap::BindlessHeap(VkDevice logicalDevice, const VkPhysicalDeviceVulkan12Properties& properties,
+                               std::uint32_t textureCapacity, std::uint32_t bufferCapacity)
+            : logicalDevice(logicalDevice) {
+        // The per-stage limits cover the whole pipeline layout, so leave room for the other sets and attachments.
+        const auto perStageLimit = [](std::uint32_t limit) {
+            return limit > kReservedStageResources ? limit - kReservedStageResources : 0u;
+        };
+        textures.capacity = std::min({textureCapacity, properties.maxDescriptorSetUpdateAfterBindSampledImages,
+                                      perStageLimit(properties.maxPerStageDescriptorUpdateAfterBindSampledImages)});
+        buffers.capacity = std::min({bufferCapacity, properties.maxDescriptorSetUpdateAfterBindStorageBuffers,
+                                     perStageLimit(properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers)});
+        // Both arrays are visible to the same stages, so together they must also fit the per-stage resource limit.
+        const std::uint32_t resourceLimit = perStageLimit(properties.maxPerStageUpdateAfterBindResources);
+        textures.capacity = std::min(textures.capacity, resourceLimit / 2);
+        buffers.capacity = std::min(buffers.capacity, resourceLimit - textures.capacity);
+        textures.live.resize(textures.capacity);
+        buffers.live.resize(buffers.capacity);
+
+        if (textures.capacity < textureCapacity || buffers.capacity < bufferCapacity) {
+            spdlog::warn("Bindless heap limited to {} textures and {} buffers by the device", textures.capacity, buffers.capacity);
+        }
+
+        CreateDescriptorSet();
+    }
+
+    BindlessHeap::~BindlessHeap() {
+        vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+        vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
+    }
+
+    void BindlessHeap::CreateDescriptorSet() {
+        const VkShaderStageFlags stages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+
+        std::array<VkDescriptorSetLayoutBinding, 2> bindings = {};
+        bindings[0].binding = kTextureBinding;
+        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        bindings[0].descriptorCount = textures.capacity;
+        bindings[0].stageFlags = stages;
+        bindings[1].binding = kBufferBinding;
+        bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[1].descriptorCount = buffers.capacity;
+        bindings[1].stageFlags = stages;
+
+        // Slots nobody wrote or that were removed are never read, and slots are rewritten while other slots are in
+        // use by pending frames.
+        const VkDescriptorBindingFlags bindingFlag = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                                                     VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT |
+                                                     VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+        const std::array<VkDescriptorBindingFlags, 2> bindingFlags = {bindingFlag, bindingFlag};
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo = {};
+        flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+        flagsInfo.bindingCount = bindingFlags.size();
+        flagsInfo.pBindingFlags = bindingFlags.data();
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.pNext = &flagsInfo;
+        layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+        layoutInfo.bindingCount = bindings.size();
+        layoutInfo.pBindings = bindings.data();
+
+        VkResult result = vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, nullptr, &descriptorSetLayout);
+        if (result != VK_SUCCESS) {
+            std::exit(EXIT_FAILURE);
+        }
+
+        std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+        poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        poolSizes[0].descriptorCount = textures.capacity;
+        poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSizes[1].descriptorCount = buffers.capacity;
+
+        VkDescriptorPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+        poolInfo.maxSets = 1;
+        poolInfo.poolSizeCount = poolSizes.size();
+        poolInfo.pPoolSizes = poolSizes.data();
+
+        result = vkCreateDescriptorPool(logicalDevice, &poolInfo, nullptr, &descriptorPool);
+        if (result != VK_SUCCESS) {
+            std::exit(EXIT_FAILURE);
+        }
+
+        VkDescriptorSetAllocateInfo allocateInfo = {};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocateInfo.descriptorPool = descriptorPool;
+        allocateInfo.descriptorSetCount = 1;
+        allocateInfo.pSetLayouts = &descriptorSetLayout;
+
+        result = vkAllocateDescriptorSets(logicalDevice, &allocateInfo, &descriptorSet);
+        if (result != VK_SUCCESS) {
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    BindlessHandle BindlessHeap::AddTexture(VkImageView view, VkSampler sampler, VkImageLayout layout) {
+        const std::optional<std::uint32_t> slot = textures.Allocate();
+        if (!slot.has_value()) {
+            spdlog::error("Bindless heap full: all {} texture slots are in use or retiring", textures.capacity);
+            return {};
+        }
+
+        VkDescriptorImageInfo imageInfo = {};
+        imageInfo.sampler = sampler;
+        imageInfo.imageView = view;
+        imageInfo.imageLayout = layout;
+
+        VkWriteDescriptorSet write = {};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = descriptorSet;
+        write.dstBinding = kTextureBinding;
+        write.dstArrayElement = slot.value();
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.pImageInfo = &imageInfo;
+
+        vkUpdateDescriptorSets(logicalDevice, 1, &write, 0, nullptr);
+        return BindlessHandle{slot.value()};
+    }
+
+    BindlessHandle BindlessHeap::AddBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+        const std::optional<std::uint32_t> slot = buffers.Allocate();
+        if (!slot.has_value()) {
+            spdlog::error("Bindless heap full: all {} buffer slots are in use or retiring", buffers.capacity);
+            return {};
+        }
+
+        VkDescriptorBufferInfo bufferInfo = {};
+        bufferInfo.buffer = buffer;
+        bufferInfo.offset = offset;
+        bufferInfo.range = range;
+
+        VkWriteDescriptorSet write = {};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = descriptorSet;
+        write.dstBinding = kBufferBinding;
+        write.dstArrayElement = slot.value();
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write.pBufferInfo = &bufferInfo;
+
+        vkUpdateDescriptorSets(logicalDevice, 1, &write, 0, nullptr);
+        return BindlessHandle{slot.value()};
+    }
+
+    void BindlessHeap::RemoveTexture(BindlessHandle handle) {
+        if (!handle.IsValid() || !textures.Remove(handle.index)) {
+            spdlog::error("Cannot remove bindless texture {}: it is not in use", handle.index);
+        }
+    }
+
+    void BindlessHeap::RemoveBuffer(BindlessHandle handle) {
+        if (!handle.IsValid() || !buffers.Remove(handle.index)) {
+            spdlog::error("Cannot remove bindless buffer {}: it is not in use", handle.index);
+        }
+    }
+
+    void BindlessHeap::BeginFrame(std::uint64_t completedTimelineValue) {
+        textures.Recycle(completedTimelineValue);
+        buffers.Recycle(completedTimelineValue);
+    }
+
+    void BindlessHeap::EndFrame(std::uint64_t submittedTimelineValue) {
+        textures.Retire(submittedTimelineValue);
+        buffers.Retire(submittedTimelineValue);
+    }
+
+    void BindlessHeap::Bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout,
+                            std::uint32_t set) const {
+        vkCmdBindDescriptorSets(commandBuffer, bindPoint, pipelineLayout, set, 1, &descriptorSet, 0, nullptr);
+    }
+}
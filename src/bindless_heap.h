@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+namespace veng {
+
+    // Index of a descriptor in the bindless table, what shaders receive instead of a descriptor set.
+    struct BindlessHandle {
+        static constexpr std::uint32_t kInvalid = std::numeric_limits<std::uint32_t>::max();
+        std::uint32_t index = kInvalid;
+
+        bool IsValid() const { return index != kInvalid; }
+    };
+
+    // One descriptor set holding every texture and storage buffer, bound once per command buffer. Bindings are
+    // partially bound, update-after-bind arrays, so descriptors are written while frames that use other slots are in
+    // flight and shaders index them by handle (bindless.glsl). Removed slots are only handed out again once the
+    // frames that could still read them have completed.
+    class BindlessHeap final {
+    public:
+        static constexpr std::uint32_t kTextureBinding = 0;
+        static constexpr std::uint32_t kBufferBinding = 1;
+        static constexpr std::uint32_t kDefaultTextureCapacity = 16384;
+        static constexpr std::uint32_t kDefaultBufferCapacity = 16384;
+        // Per-stage descriptors and attachments kept free for the pipeline layout's other sets.
+        static constexpr std::uint32_t kReservedStageResources = 64;
+
+        // Capacities are clamped to the device's update-after-bind limits.
+        BindlessHeap(VkDevice logicalDevice, const VkPhysicalDeviceVulkan12Properties& properties,
+                     std::uint32_t textureCapacity = kDefaultTextureCapacity, std::uint32_t bufferCapacity = kDefaultBufferCapacity);
+        ~BindlessHeap();
+
+        BindlessHeap(const BindlessHeap&) = delete;
+        BindlessHeap& operator=(const BindlessHeap&) = delete;
+
+        BindlessHandle AddTexture(VkImageView view, VkSampler sampler,
+                                  VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        BindlessHandle AddBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+        // The slot stays readable by the frame being recorded and those in flight. Removing a slot that is not in
+        // use, including removing it twice, is logged and ignored.
+        void RemoveTexture(BindlessHandle handle);
+        void RemoveBuffer(BindlessHandle handle);
+
+        // Slots removed by frames up to completedTimelineValue become free again.
+        void BeginFrame(std::uint64_t completedTimelineValue);
+        // Slots removed during the frame are retired once its submission reaches this value.
+        void EndFrame(std::uint64_t submittedTimelineValue);
+
+        void Bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout, std::uint32_t set) const;
+
+        VkDescriptorSetLayout GetDescriptorSetLayout() const { return descriptorSetLayout; }
+        std::uint32_t GetTextureCapacity() const { return textures.capacity; }
+        std::uint32_t GetBufferCapacity() const { return buffers.capacity; }
+        std::uint32_t GetTextureCount() const { return textures.liveCount; }
+        std::uint32_t GetBufferCount() const { return buffers.liveCount; }
+
+    private:
+        // Slots of one binding. Never-used slots are handed out in order before any recycled one.
+        struct SlotAllocator {
+            std::uint32_t capacity = 0;
+            std::uint32_t nextUnused = 0;
+            std::uint32_t liveCount = 0;
+            std::vector<bool> live;
+            std::vector<std::uint32_t> freeSlots;
+            std::vector<std::uint32_t> removedSlots;
+            std::deque<std::pair<std::uint64_t, std::uint32_t>> retiringSlots;
+
+            std::optional<std::uint32_t> Allocate();
+            bool Remove(std::uint32_t slot);
+            void Retire(std::uint64_t submittedTimelineValue);
+            void Recycle(std::uint64_t completedTimelineValue);
+        };
+
+        void CreateDescriptorSet();
+
+        VkDevice logicalDevice = VK_NULL_HANDLE;
+        SlotAllocator textures;
+        SlotAllocator buffers;
+
+        VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+        VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    };
+}
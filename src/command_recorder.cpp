@@ -0,0 +1,97 @@
+#include <precomp.h>
+#include <command_recorder.h>
+#include <job_system.h>
+#include <profiler.h>
+#include <spdlog/spdlog.h>
+
+namespace veng {
+
+    CommandRecorder::CommandRecorder(VkDevice logicalDevice, std::uint32_t queueFamily, std::uint32_t framesInFlight, std::uint32_t sliceCount,
+                                     const VkAllocationCallbacks* allocationCallbacks)
+        : logicalDevice(logicalDevice), allocationCallbacks(allocationCallbacks), sliceCount(std::max(sliceCount, 1u)) {
+        frames.resize(framesInFlight, std::vector<SliceFrame>(this->sliceCount));
+
+        for (std::vector<SliceFrame>& frame : frames) {
+            for (SliceFrame& sliceFrame : frame) {
+                VkCommandPoolCreateInfo poolInfo = {};
+                poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+                poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+                poolInfo.queueFamilyIndex = queueFamily;
+
+                VkResult result = vkCreateCommandPool(logicalDevice, &poolInfo, allocationCallbacks, &sliceFrame.commandPool);
+                if (result != VK_SUCCESS) {
+                    spdlog::error("Cannot create recording command pool");
+                    std::exit(EXIT_FAILURE);
+                }
+
+                VkCommandBufferAllocateInfo allocateInfo = {};
+                allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+                allocateInfo.commandPool = sliceFrame.commandPool;
+                allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+                allocateInfo.commandBufferCount = 1;
+
+                result = vkAllocateCommandBuffers(logicalDevice, &allocateInfo, &sliceFrame.commandBuffer);
+                if (result != VK_SUCCESS) {
+                    spdlog::error("Cannot allocate secondary command buffer");
+                    std::exit(EXIT_FAILURE);
+                }
+            }
+        }
+    }
+
+    CommandRecorder::~CommandRecorder() {
+        for (std::vector<SliceFrame>& frame : frames) {
+            for (SliceFrame& sliceFrame : frame) {
+                vkDestroyCommandPool(logicalDevice, sliceFrame.commandPool, allocationCallbacks);
+            }
+        }
+    }
+
+    gsl::span<const VkCommandBuffer> CommandRecorder::Record(std::uint32_t frameIndex, const VkCommandBufferInheritanceInfo& inheritance,
+                                                             std::uint32_t itemCount, std::uint32_t sliceCount, const RecordFunction& record) {
+        VENG_PROFILE_FUNCTION();
+        const std::uint32_t activeSlices = std::clamp(std::min(sliceCount, itemCount), 1u, this->sliceCount);
+        job = {frameIndex, &inheritance, itemCount, activeSlices, &record};
+
+        JobSystem::Get().ParallelFor(activeSlices, 1, [this](std::uint32_t first, std::uint32_t last) {
+            for (std::uint32_t sliceIndex = first; sliceIndex < last; ++sliceIndex) {
+                RecordSlice(sliceIndex);
+            }
+        });
+
+        recorded.clear();
+        for (std::uint32_t sliceIndex = 0; sliceIndex < activeSlices; ++sliceIndex) {
+            recorded.push_back(frames[frameIndex][sliceIndex].commandBuffer);
+        }
+        return recorded;
+    }
+
+    void CommandRecorder::RecordSlice(std::uint32_t sliceIndex) {
+        VENG_PROFILE_SCOPE("RecordSlice");
+        const SliceFrame& sliceFrame = frames[job.frameIndex][sliceIndex];
+
+        // A slice runs on exactly one thread at a time, so its pool needs no further synchronisation.
+        vkResetCommandPool(logicalDevice, sliceFrame.commandPool, 0);
+
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        beginInfo.pInheritanceInfo = job.inheritance;
+
+        VkResult result = vkBeginCommandBuffer(sliceFrame.commandBuffer, &beginInfo);
+        if (result != VK_SUCCESS) {
+            spdlog::error("Cannot begin secondary command buffer for slice {}", sliceIndex);
+            std::exit(EXIT_FAILURE);
+        }
+
+        const std::uint64_t first = static_cast<std::uint64_t>(job.itemCount) * sliceIndex / job.activeSlices;
+        const std::uint64_t last = static_cast<std::uint64_t>(job.itemCount) * (sliceIndex + 1) / job.activeSlices;
+        (*job.record)(sliceFrame.commandBuffer, static_cast<std::uint32_t>(first), static_cast<std::uint32_t>(last - first));
+
+        result = vkEndCommandBuffer(sliceFrame.commandBuffer);
+        if (result != VK_SUCCESS) {
+            spdlog::error("Cannot end secondary command buffer for slice {}", sliceIndex);
+            std::exit(EXIT_FAILURE);
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+namespace veng {
+
+    // Splits a list of work items into slices recorded as jobs. Every slice owns one command pool per frame in flight
+    // and records into a secondary command buffer, which the caller executes from its primary.
+    class CommandRecorder final {
+    public:
+        using RecordFunction = std::function<void(VkCommandBuffer commandBuffer, std::uint32_t first, std::uint32_t count)>;
+
+        CommandRecorder(VkDevice logicalDevice, std::uint32_t queueFamily, std::uint32_t framesInFlight, std::uint32_t sliceCount,
+                        const VkAllocationCallbacks* allocationCallbacks = nullptr);
+        ~CommandRecorder();
+
+        CommandRecorder(const CommandRecorder&) = delete;
+        CommandRecorder& operator=(const CommandRecorder&) = delete;
+
+        // Blocks until every slice is recorded, helping with the jobs while it waits.
+        gsl::span<const VkCommandBuffer> Record(std::uint32_t frameIndex, const VkCommandBufferInheritanceInfo& inheritance,
+                                                std::uint32_t itemCount, std::uint32_t sliceCount, const RecordFunction& record);
+
+        std::uint32_t GetSliceCount() const { return sliceCount; }
+
+    private:
+        struct SliceFrame {
+            VkCommandPool commandPool = VK_NULL_HANDLE;
+            VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        };
+
+        struct Job {
+            std::uint32_t frameIndex = 0;
+            const VkCommandBufferInheritanceInfo* inheritance = nullptr;
+            std::uint32_t itemCount = 0;
+            std::uint32_t activeSlices = 0;
+            const RecordFunction* record = nullptr;
+        };
+
+        void RecordSlice(std::uint32_t sliceIndex);
+
+        VkDevice logicalDevice = VK_NULL_HANDLE;
+        // Recording allocates from the pools, so these see the command-scope allocations of every slice.
+        const VkAllocationCallbacks* allocationCallbacks = nullptr;
+        std::uint32_t sliceCount = 1;
+        std::vector<std::vector<SliceFrame>> frames;
+        std::vector<VkCommandBuffer> recorded;
+        Job job;
+    };
+}
@@ -0,0 +1,27 @@
+#include <precomp.h>
+#include <device_functions.h>
+#include <spdlog/spdlog.h>
+
+namespace veng {
+
+    template <typename Function>
+    static Function LoadDeviceFunction(VkDevice logicalDevice, gsl::czstring name) {
+        Function function = reinterpret_cast<Function>(vkGetDeviceProcAddr(logicalDevice, name));
+        if (function == nullptr) {
+            spdlog::error("Cannot load {}", name);
+            std::exit(EXIT_FAILURE);
+        }
+        return function;
+    }
+
+    DeviceFunctions LoadDeviceFunctions(VkDevice logicalDevice, bool coreVulkan13) {
+        DeviceFunctions functions;
+        functions.cmdPipelineBarrier2 = LoadDeviceFunction<PFN_vkCmdPipelineBarrier2KHR>(
+            logicalDevice, coreVulkan13 ? "vkCmdPipelineBarrier2" : "vkCmdPipelineBarrier2KHR");
+        functions.cmdBeginRendering = LoadDeviceFunction<PFN_vkCmdBeginRenderingKHR>(
+            logicalDevice, coreVulkan13 ? "vkCmdBeginRendering" : "vkCmdBeginRenderingKHR");
+        functions.cmdEndRendering = LoadDeviceFunction<PFN_vkCmdEndRenderingKHR>(
+            logicalDevice, coreVulkan13 ? "vkCmdEndRendering" : "vkCmdEndRenderingKHR");
+        return functions;
+    }
+}
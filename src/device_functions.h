@@ -0,0 +1,16 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+namespace veng {
+
+    // Commands that are core in Vulkan 1.3 and come from extensions on 1.2 devices. The loader only finds them
+    // under the name that matches how the device was created, so they are looked up once and passed around.
+    struct DeviceFunctions {
+        PFN_vkCmdPipelineBarrier2KHR cmdPipelineBarrier2 = nullptr;
+        PFN_vkCmdBeginRenderingKHR cmdBeginRendering = nullptr;
+        PFN_vkCmdEndRenderingKHR cmdEndRendering = nullptr;
+    };
+
+    DeviceFunctions LoadDeviceFunctions(VkDevice logicalDevice, bool coreVulkan13);
+}
@@ -0,0 +1,33 @@
+#include <precomp.h>
+#include <frame_limiter.h>
+#include <thread>
+
+namespace veng {
+
+    void FrameLimiter::SetTargetFrameRate(std::uint32_t framesPerSecond) {
+        targetFrameRate = framesPerSecond;
+        framePeriod = framesPerSecond == 0 ? std::chrono::steady_clock::duration::zero() :
+                      std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / framesPerSecond));
+        nextFrameDeadline = std::chrono::steady_clock::now();
+    }
+
+    void FrameLimiter::Wait() {
+        if (targetFrameRate == 0) return;
+
+        // Sleeping is coarse on most schedulers, so only sleep until shortly before the deadline and spin the rest.
+        constexpr std::chrono::microseconds kSpinMargin(1500);
+
+        auto now = std::chrono::steady_clock::now();
+        if (nextFrameDeadline - now > kSpinMargin) {
+            std::this_thread::sleep_until(nextFrameDeadline - kSpinMargin);
+        }
+
+        while (std::chrono::steady_clock::now() < nextFrameDeadline) {
+            std::this_thread::yield();
+        }
+
+        // Don't try to catch up on frames that were already missed, that would just burst.
+        now = std::chrono::steady_clock::now();
+        nextFrameDeadline = std::max(nextFrameDeadline + framePeriod, now);
+    }
+}
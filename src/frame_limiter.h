@@ -0,0 +1,17 @@
+#pragma once
+
+namespace veng {
+
+    class FrameLimiter {
+    public:
+        void SetTargetFrameRate(std::uint32_t framesPerSecond);
+        std::uint32_t GetTargetFrameRate() const { return targetFrameRate; }
+
+        void Wait();
+
+    private:
+        std::uint32_t targetFrameRate = 0;
+        std::chrono::steady_clock::duration framePeriod{};
+        std::chrono::steady_clock::time_point nextFrameDeadline{};
+    };
+}
@@ -0,0 +1,343 @@
+#include <precomp.h>
+#include <frustum_culling.h>
+#include <job_system.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#include <immintrin.h>
+// SSE2 is part of every x86-64 target. GCC and Clang compile the AVX2 kernels on any x86 build and pick them at run
+// time, MSVC only when /arch:AVX2 is set.
+#define VENG_CULLING_SSE 1
+#if defined(__GNUC__) || defined(__clang__)
+#define VENG_CULLING_AVX2 1
+#define VENG_TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(__AVX2__)
+#define VENG_CULLING_AVX2 1
+#define VENG_TARGET_AVX2
+#endif
+#endif
+
+namespace veng {
+
+    static glm::vec4 NormalisePlane(float x, float y, float z, float w) {
+        const float length = std::sqrt(x * x + y * y + z * z);
+        return glm::vec4(x / length, y / length, z / length, w / length);
+    }
+
+    Frustum ExtractFrustum(const glm::mat4& viewProjection) {
+        // Rows of the matrix, which glm stores column by column.
+        std::array<glm::vec4, 4> rows;
+        for (int row = 0; row < 4; ++row) {
+            rows[row] = glm::vec4(viewProjection[0][row], viewProjection[1][row], viewProjection[2][row], viewProjection[3][row]);
+        }
+
+        auto combine = [&rows](int row, float sign) {
+            return NormalisePlane(rows[3].x + sign * rows[row].x, rows[3].y + sign * rows[row].y,
+                                  rows[3].z + sign * rows[row].z, rows[3].w + sign * rows[row].w);
+        };
+
+        Frustum frustum;
+        frustum.planes[0] = combine(0, 1.0f);
+        frustum.planes[1] = combine(0, -1.0f);
+        frustum.planes[2] = combine(1, 1.0f);
+        frustum.planes[3] = combine(1, -1.0f);
+        // Vulkan clip space puts the near plane at z = 0 rather than z = -w.
+        frustum.planes[4] = NormalisePlane(rows[2].x, rows[2].y, rows[2].z, rows[2].w);
+        frustum.planes[5] = combine(2, -1.0f);
+        return frustum;
+    }
+
+    void BoundingSpheres::Resize(std::size_t count) {
+        centerX.resize(count);
+        centerY.resize(count);
+        centerZ.resize(count);
+        radius.resize(count);
+    }
+
+    void BoundingSpheres::Set(std::size_t index, glm::vec3 center, float sphereRadius) {
+        centerX[index] = center.x;
+        centerY[index] = center.y;
+        centerZ[index] = center.z;
+        radius[index] = sphereRadius;
+    }
+
+    void BoundingBoxes::Resize(std::size_t count) {
+        centerX.resize(count);
+        centerY.resize(count);
+        centerZ.resize(count);
+        extentX.resize(count);
+        extentY.resize(count);
+        extentZ.resize(count);
+    }
+
+    void BoundingBoxes::Set(std::size_t index, glm::vec3 minimum, glm::vec3 maximum) {
+        centerX[index] = (minimum.x + maximum.x) * 0.5f;
+        centerY[index] = (minimum.y + maximum.y) * 0.5f;
+        centerZ[index] = (minimum.z + maximum.z) * 0.5f;
+        extentX[index] = (maximum.x - minimum.x) * 0.5f;
+        extentY[index] = (maximum.y - minimum.y) * 0.5f;
+        extentZ[index] = (maximum.z - minimum.z) * 0.5f;
+    }
+
+    // Every kernel evaluates the same expressions in the same order and without fused multiply-adds, so they agree
+    // on volumes that touch a plane exactly as well.
+    static std::uint32_t CullSpheresScalar(const Frustum& frustum, const BoundingSpheres& spheres, std::uint32_t first,
+                                           std::uint32_t last, std::uint32_t* visible) {
+        std::uint32_t visibleCount = 0;
+        for (std::uint32_t i = first; i < last; ++i) {
+            bool inside = true;
+            for (const glm::vec4& plane : frustum.planes) {
+                const float distance = plane.x * spheres.centerX[i] + plane.y * spheres.centerY[i] + plane.z * spheres.centerZ[i] + plane.w;
+                inside = inside && distance >= -spheres.radius[i];
+            }
+            visible[visibleCount] = i;
+            visibleCount += inside ? 1 : 0;
+        }
+        return visibleCount;
+    }
+
+    static std::uint32_t CullBoxesScalar(const Frustum& frustum, const BoundingBoxes& boxes, std::uint32_t first,
+                                         std::uint32_t last, std::uint32_t* visible) {
+        std::uint32_t visibleCount = 0;
+        for (std::uint32_t i = first; i < last; ++i) {
+            bool inside = true;
+            for (const glm::vec4& plane : frustum.planes) {
+                const float distance = plane.x * boxes.centerX[i] + plane.y * boxes.centerY[i] + plane.z * boxes.centerZ[i] + plane.w;
+                const float radius = std::abs(plane.x) * boxes.extentX[i] + std::abs(plane.y) * boxes.extentY[i] +
+                                     std::abs(plane.z) * boxes.extentZ[i];
+                inside = inside && distance >= -radius;
+            }
+            visible[visibleCount] = i;
+            visibleCount += inside ? 1 : 0;
+        }
+        return visibleCount;
+    }
+
+    // Writes an index for every lane and only advances past the visible ones, which avoids a branch per object.
+    static std::uint32_t AppendVisible(std::uint32_t* visible, std::uint32_t visibleCount, std::uint32_t first,
+                                       std::uint32_t laneCount, std::uint32_t mask) {
+        for (std::uint32_t lane = 0; lane < laneCount; ++lane) {
+            visible[visibleCount] = first + lane;
+            visibleCount += (mask >> lane) & 1u;
+        }
+        return visibleCount;
+    }
+
+#if defined(VENG_CULLING_SSE)
+    static std::uint32_t CullSpheresSse(const Frustum& frustum, const BoundingSpheres& spheres, std::uint32_t first,
+                                        std::uint32_t last, std::uint32_t* visible) {
+        constexpr std::uint32_t kLanes = 4;
+        std::uint32_t visibleCount = 0;
+        std::uint32_t i = first;
+        for (; i + kLanes <= last; i += kLanes) {
+            const __m128 x = _mm_loadu_ps(&spheres.centerX[i]);
+            const __m128 y = _mm_loadu_ps(&spheres.centerY[i]);
+            const __m128 z = _mm_loadu_ps(&spheres.centerZ[i]);
+            const __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&spheres.radius[i]));
+
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (const glm::vec4& plane : frustum.planes) {
+                __m128 distance = _mm_mul_ps(_mm_set1_ps(plane.x), x);
+                distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.y), y));
+                distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.z), z));
+                distance = _mm_add_ps(distance, _mm_set1_ps(plane.w));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+            }
+
+            visibleCount = AppendVisible(visible, visibleCount, i, kLanes, static_cast<std::uint32_t>(_mm_movemask_ps(inside)));
+        }
+        return visibleCount + CullSpheresScalar(frustum, spheres, i, last, visible + visibleCount);
+    }
+
+    static std::uint32_t CullBoxesSse(const Frustum& frustum, const BoundingBoxes& boxes, std::uint32_t first,
+                                      std::uint32_t last, std::uint32_t* visible) {
+        constexpr std::uint32_t kLanes = 4;
+        std::uint32_t visibleCount = 0;
+        std::uint32_t i = first;
+        for (; i + kLanes <= last; i += kLanes) {
+            const __m128 x = _mm_loadu_ps(&boxes.centerX[i]);
+            const __m128 y = _mm_loadu_ps(&boxes.centerY[i]);
+            const __m128 z = _mm_loadu_ps(&boxes.centerZ[i]);
+            const __m128 extentX = _mm_loadu_ps(&boxes.extentX[i]);
+            const __m128 extentY = _mm_loadu_ps(&boxes.extentY[i]);
+            const __m128 extentZ = _mm_loadu_ps(&boxes.extentZ[i]);
+
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (const glm::vec4& plane : frustum.planes) {
+                __m128 distance = _mm_mul_ps(_mm_set1_ps(plane.x), x);
+                distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.y), y));
+                distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(plane.z), z));
+                distance = _mm_add_ps(distance, _mm_set1_ps(plane.w));
+
+                __m128 radius = _mm_mul_ps(_mm_set1_ps(std::abs(plane.x)), extentX);
+                radius = _mm_add_ps(radius, _mm_mul_ps(_mm_set1_ps(std::abs(plane.y)), extentY));
+                radius = _mm_add_ps(radius, _mm_mul_ps(_mm_set1_ps(std::abs(plane.z)), extentZ));
+
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_sub_ps(_mm_setzero_ps(), radius)));
+            }
+
+            visibleCount = AppendVisible(visible, visibleCount, i, kLanes, static_cast<std::uint32_t>(_mm_movemask_ps(inside)));
+        }
+        return visibleCount + CullBoxesScalar(frustum, boxes, i, last, visible + visibleCount);
+    }
+#endif
+
+#if defined(VENG_CULLING_AVX2)
+    VENG_TARGET_AVX2 static std::uint32_t CullSpheresAvx2(const Frustum& frustum, const BoundingSpheres& spheres,
+                                                          std::uint32_t first, std::uint32_t last, std::uint32_t* visible) {
+        constexpr std::uint32_t kLanes = 8;
+        std::uint32_t visibleCount = 0;
+        std::uint32_t i = first;
+        for (; i + kLanes <= last; i += kLanes) {
+            const __m256 x = _mm256_loadu_ps(&spheres.centerX[i]);
+            const __m256 y = _mm256_loadu_ps(&spheres.centerY[i]);
+            const __m256 z = _mm256_loadu_ps(&spheres.centerZ[i]);
+            const __m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&spheres.radius[i]));
+
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (const glm::vec4& plane : frustum.planes) {
+                __m256 distance = _mm256_mul_ps(_mm256_set1_ps(plane.x), x);
+                distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane.y), y));
+                distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane.z), z));
+                distance = _mm256_add_ps(distance, _mm256_set1_ps(plane.w));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+            }
+
+            visibleCount = AppendVisible(visible, visibleCount, i, kLanes, static_cast<std::uint32_t>(_mm256_movemask_ps(inside)));
+        }
+        return visibleCount + CullSpheresScalar(frustum, spheres, i, last, visible + visibleCount);
+    }
+
+    VENG_TARGET_AVX2 static std::uint32_t CullBoxesAvx2(const Frustum& frustum, const BoundingBoxes& boxes,
+                                                        std::uint32_t first, std::uint32_t last, std::uint32_t* visible) {
+        constexpr std::uint32_t kLanes = 8;
+        std::uint32_t visibleCount = 0;
+        std::uint32_t i = first;
+        for (; i + kLanes <= last; i += kLanes) {
+            const __m256 x = _mm256_loadu_ps(&boxes.centerX[i]);
+            const __m256 y = _mm256_loadu_ps(&boxes.centerY[i]);
+            const __m256 z = _mm256_loadu_ps(&boxes.centerZ[i]);
+            const __m256 extentX = _mm256_loadu_ps(&boxes.extentX[i]);
+            const __m256 extentY = _mm256_loadu_ps(&boxes.extentY[i]);
+            const __m256 extentZ = _mm256_loadu_ps(&boxes.extentZ[i]);
+
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (const glm::vec4& plane : frustum.planes) {
+                __m256 distance = _mm256_mul_ps(_mm256_set1_ps(plane.x), x);
+                distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane.y), y));
+                distance = _mm256_add_ps(distance, _mm256_mul_ps(_mm256_set1_ps(plane.z), z));
+                distance = _mm256_add_ps(distance, _mm256_set1_ps(plane.w));
+
+                __m256 radius = _mm256_mul_ps(_mm256_set1_ps(std::abs(plane.x)), extentX);
+                radius = _mm256_add_ps(radius, _mm256_mul_ps(_mm256_set1_ps(std::abs(plane.y)), extentY));
+                radius = _mm256_add_ps(radius, _mm256_mul_ps(_mm256_set1_ps(std::abs(plane.z)), extentZ));
+
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_sub_ps(_mm256_setzero_ps(), radius), _CMP_GE_OQ));
+            }
+
+            visibleCount = AppendVisible(visible, visibleCount, i, kLanes, static_cast<std::uint32_t>(_mm256_movemask_ps(inside)));
+        }
+        return visibleCount + CullBoxesScalar(frustum, boxes, i, last, visible + visibleCount);
+    }
+#endif
+
+    bool IsCullingKernelSupported(CullingKernel kernel) {
+        switch (kernel) {
+            case CullingKernel::Scalar:
+                return true;
+            case CullingKernel::Sse:
+#if defined(VENG_CULLING_SSE)
+                return true;
+#else
+                return false;
+#endif
+            case CullingKernel::Avx2:
+#if defined(VENG_CULLING_AVX2) && (defined(__GNUC__) || defined(__clang__))
+                {
+                    static const bool supported = __builtin_cpu_supports("avx2");
+                    return supported;
+                }
+#elif defined(VENG_CULLING_AVX2)
+                return true;
+#else
+                return false;
+#endif
+        }
+        return false;
+    }
+
+    CullingKernel GetBestCullingKernel() {
+        if (IsCullingKernelSupported(CullingKernel::Avx2)) return CullingKernel::Avx2;
+        if (IsCullingKernelSupported(CullingKernel::Sse)) return CullingKernel::Sse;
+        return CullingKernel::Scalar;
+    }
+
+    gsl::czstring GetCullingKernelName(CullingKernel kernel) {
+        switch (kernel) {
+            case CullingKernel::Scalar: return "scalar";
+            case CullingKernel::Sse: return "SSE";
+            case CullingKernel::Avx2: return "AVX2";
+        }
+        return "unknown";
+    }
+
+    // Each range writes its visible indices to the start of its own slice of the output, then the slices are packed
+    // together in order. Ranges from ParallelFor start on multiples of the grain size.
+    template <typename Volumes>
+    static void CullParallel(const Frustum& frustum, const Volumes& volumes, std::vector<std::uint32_t>& visibleIndices,
+                             std::uint32_t (*kernel)(const Frustum&, const Volumes&, std::uint32_t, std::uint32_t, std::uint32_t*)) {
+        constexpr std::uint32_t kGrainSize = 16384;
+        const std::uint32_t count = volumes.GetCount();
+        visibleIndices.resize(count);
+
+        std::vector<std::uint32_t> rangeVisibleCounts((count + kGrainSize - 1) / kGrainSize);
+        JobSystem::Get().ParallelFor(count, kGrainSize, [&](std::uint32_t first, std::uint32_t last) {
+            rangeVisibleCounts[first / kGrainSize] = kernel(frustum, volumes, first, last, visibleIndices.data() + first);
+        });
+
+        std::uint32_t visibleCount = 0;
+        for (std::size_t range = 0; range < rangeVisibleCounts.size(); ++range) {
+            const auto rangeStart = visibleIndices.begin() + static_cast<std::ptrdiff_t>(range * kGrainSize);
+            visibleCount = static_cast<std::uint32_t>(
+                std::copy(rangeStart, rangeStart + rangeVisibleCounts[range], visibleIndices.begin() + visibleCount) - visibleIndices.begin());
+        }
+        visibleIndices.resize(visibleCount);
+    }
+
+    void CullSpheres(const Frustum& frustum, const BoundingSpheres& spheres, std::vector<std::uint32_t>& visibleIndices,
+                     CullingKernel kernel) {
+        switch (IsCullingKernelSupported(kernel) ? kernel : CullingKernel::Scalar) {
+#if defined(VENG_CULLING_AVX2)
+            case CullingKernel::Avx2:
+                CullParallel(frustum, spheres, visibleIndices, CullSpheresAvx2);
+                return;
+#endif
+#if defined(VENG_CULLING_SSE)
+            case CullingKernel::Sse:
+                CullParallel(frustum, spheres, visibleIndices, CullSpheresSse);
+                return;
+#endif
+            default:
+                CullParallel(frustum, spheres, visibleIndices, CullSpheresScalar);
+                return;
+        }
+    }
+
+    void CullBoxes(const Frustum& frustum, const BoundingBoxes& boxes, std::vector<std::uint32_t>& visibleIndices,
+                   CullingKernel kernel) {
+        switch (IsCullingKernelSupported(kernel) ? kernel : CullingKernel::Scalar) {
+#if defined(VENG_CULLING_AVX2)
+            case CullingKernel::Avx2:
+                CullParallel(frustum, boxes, visibleIndices, CullBoxesAvx2);
+                return;
+#endif
+#if defined(VENG_CULLING_SSE)
+            case CullingKernel::Sse:
+                CullParallel(frustum, boxes, visibleIndices, CullBoxesSse);
+                return;
+#endif
+            default:
+                CullParallel(frustum, boxes, visibleIndices, CullBoxesScalar);
+                return;
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+namespace veng {
+
+    // Six normalised planes (xyz normal pointing inwards, w distance). A point p is inside when dot(n, p) + w >= 0
+    // for every plane.
+    struct Frustum {
+        std::array<glm::vec4, 6> planes = {};
+    };
+
+    // Extracts the planes of a Vulkan clip space (depth 0 to 1) view-projection matrix.
+    Frustum ExtractFrustum(const glm::mat4& viewProjection);
+
+    // Bounding volumes as structure of arrays, so the kernels load eight objects' worth of one component at a time.
+    struct BoundingSpheres {
+        std::vector<float> centerX;
+        std::vector<float> centerY;
+        std::vector<float> centerZ;
+        std::vector<float> radius;
+
+        void Resize(std::size_t count);
+        void Set(std::size_t index, glm::vec3 center, float sphereRadius);
+        std::uint32_t GetCount() const { return static_cast<std::uint32_t>(radius.size()); }
+    };
+
+    struct BoundingBoxes {
+        std::vector<float> centerX;
+        std::vector<float> centerY;
+        std::vector<float> centerZ;
+        std::vector<float> extentX;
+        std::vector<float> extentY;
+        std::vector<float> extentZ;
+
+        void Resize(std::size_t count);
+        void Set(std::size_t index, glm::vec3 minimum, glm::vec3 maximum);
+        std::uint32_t GetCount() const { return static_cast<std::uint32_t>(extentX.size()); }
+    };
+
+    enum class CullingKernel {
+        Scalar,
+        Sse,
+        Avx2,
+    };
+
+    bool IsCullingKernelSupported(CullingKernel kernel);
+    CullingKernel GetBestCullingKernel();
+    gsl::czstring GetCullingKernelName(CullingKernel kernel);
+
+    // Writes the indices of every volume that intersects the frustum to visibleIndices, in ascending order. The
+    // volumes are split across the job system; every kernel produces exactly the same list.
+    void CullSpheres(const Frustum& frustum, const BoundingSpheres& spheres, std::vector<std::uint32_t>& visibleIndices,
+                     CullingKernel kernel = GetBestCullingKernel());
+    void CullBoxes(const Frustum& frustum, const BoundingBoxes& boxes, std::vector<std::uint32_t>& visibleIndices,
+                   CullingKernel kernel = GetBestCullingKernel());
+}
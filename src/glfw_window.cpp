@@ -7,11 +7,23 @@ namespace veng{
 
     Window::Window(gsl::czstring name, glm::ivec2 size) {
 
-        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
         window = glfwCreateWindow(size.x, size.y, name, nullptr, nullptr);
         if(window == nullptr)
             std::exit(EXIT_FAILURE);
+
+        glfwSetWindowUserPointer(window, this);
+        glfwSetFramebufferSizeCallback(window, FrameBufferSizeCallback);
+    }
+
+    void Window::FrameBufferSizeCallback(GLFWwindow* handle, std::int32_t width, std::int32_t height) {
+        Window* owner = static_cast<Window*>(glfwGetWindowUserPointer(handle));
+        owner->frameBufferResized = true;
+    }
+
+    bool Window::ConsumeFrameBufferResized() {
+        return std::exchange(frameBufferResized, false);
     }
 
     Window::~Window() {
@@ -47,4 +59,9 @@ namespace veng{
         glfwGetFramebufferSize(window, &frameBufferSize.x, &frameBufferSize.y);
         return frameBufferSize;
     }
-}
\ No newline at end of file
+
+    bool Window::IsMinimised() const {
+        const glm::ivec2 frameBufferSize = GetFrameBufferSize();
+        return frameBufferSize.x == 0 || frameBufferSize.y == 0;
+    }
+}
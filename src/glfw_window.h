@@ -11,12 +11,18 @@ namespace veng {
 
         glm::ivec2 GetWindowSize() const;
         glm::ivec2 GetFrameBufferSize() const;
+        // A minimised window has an empty framebuffer and nothing can be presented to it.
+        bool IsMinimised() const;
         bool ShouldClose() const;
         GLFWwindow* GetHandle() const;
+        bool ConsumeFrameBufferResized();
 
         bool TryMoveToMonitor(std::uint16_t monitorNumber);
 
     private:
+        static void FrameBufferSizeCallback(GLFWwindow* handle, std::int32_t width, std::int32_t height);
+
         GLFWwindow* window;
+        bool frameBufferResized = false;
     };
 }
\ No newline at end of file
@@ -0,0 +1,301 @@
+#include <precomp.h>
+#include <gpu_culling.h>
+#include <spdlog/spdlog.h>
+
+namespace veng {
+
+    static_assert(sizeof(VkDrawIndexedIndirectCommand) == 20, "cull.comp writes tightly packed draw commands");
+
+    GpuCulling::GpuCulling(VkDevice logicalDevice, MemoryAllocator& allocator, const DeviceFunctions& functions, UploadService& uploadService,
+                           VkPipelineCache pipelineCache, VkShaderModule cullShader, VkDescriptorSetLayout instanceSetLayout, const VkPhysicalDeviceLimits& limits,
+                           std::uint32_t framesInFlight, bool drawIndirectCountSupported)
+            : logicalDevice(logicalDevice), allocator(allocator), functions(functions), uploadService(uploadService), instanceSetLayout(instanceSetLayout),
+              minOffsetAlignment(std::max<VkDeviceSize>(limits.minStorageBufferOffsetAlignment, 4)),
+              maxDrawCount(limits.maxDrawIndirectCount), framesInFlight(framesInFlight),
+              drawIndirectCountSupported(drawIndirectCountSupported) {
+        CreatePipeline(pipelineCache, cullShader);
+        CreateDescriptorPool();
+    }
+
+    GpuCulling::~GpuCulling() {
+        DestroyObjectBuffers();
+        vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+        vkDestroyPipeline(logicalDevice, cullPipeline, nullptr);
+        vkDestroyPipelineLayout(logicalDevice, cullPipelineLayout, nullptr);
+        vkDestroyDescriptorSetLayout(logicalDevice, cullSetLayout, nullptr);
+    }
+
+    void GpuCulling::CreatePipeline(VkPipelineCache pipelineCache, VkShaderModule cullShader) {
+        // Objects, the frame's draw commands and the frame's draw count.
+        std::array<VkDescriptorSetLayoutBinding, 3> bindings = {};
+        for (std::uint32_t i = 0; i < bindings.size(); ++i) {
+            bindings[i].binding = i;
+            bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            bindings[i].descriptorCount = 1;
+            bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        }
+
+        VkDescriptorSetLayoutCreateInfo setLayoutInfo = {};
+        setLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        setLayoutInfo.bindingCount = bindings.size();
+        setLayoutInfo.pBindings = bindings.data();
+
+        VkResult result = vkCreateDescriptorSetLayout(logicalDevice, &setLayoutInfo, nullptr, &cullSetLayout);
+        if (result != VK_SUCCESS) {
+            std::exit(EXIT_FAILURE);
+        }
+
+        VkPushConstantRange pushConstantRange = {};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(PushConstants);
+
+        VkPipelineLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        layoutInfo.setLayoutCount = 1;
+        layoutInfo.pSetLayouts = &cullSetLayout;
+        layoutInfo.pushConstantRangeCount = 1;
+        layoutInfo.pPushConstantRanges = &pushConstantRange;
+
+        result = vkCreatePipelineLayout(logicalDevice, &layoutInfo, nullptr, &cullPipelineLayout);
+        if (result != VK_SUCCESS) {
+            std::exit(EXIT_FAILURE);
+        }
+
+        VkComputePipelineCreateInfo pipelineInfo = {};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = cullShader;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = cullPipelineLayout;
+
+        result = vkCreateComputePipelines(logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, &cullPipeline);
+        if (result != VK_SUCCESS) {
+            spdlog::error("Cannot create the culling pipeline");
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    void GpuCulling::CreateDescriptorPool() {
+        std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+        poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSizes[0].descriptorCount = 3 * framesInFlight;
+        poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+        poolSizes[1].descriptorCount = 1;
+
+        VkDescriptorPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.maxSets = framesInFlight + 1;
+        poolInfo.poolSizeCount = poolSizes.size();
+        poolInfo.pPoolSizes = poolSizes.data();
+
+        VkResult result = vkCreateDescriptorPool(logicalDevice, &poolInfo, nullptr, &descriptorPool);
+        if (result != VK_SUCCESS) {
+            std::exit(EXIT_FAILURE);
+        }
+
+        std::vector<VkDescriptorSetLayout> setLayouts(framesInFlight, cullSetLayout);
+        setLayouts.push_back(instanceSetLayout);
+        std::vector<VkDescriptorSet> sets(setLayouts.size());
+
+        VkDescriptorSetAllocateInfo allocateInfo = {};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocateInfo.descriptorPool = descriptorPool;
+        allocateInfo.descriptorSetCount = sets.size();
+        allocateInfo.pSetLayouts = setLayouts.data();
+
+        result = vkAllocateDescriptorSets(logicalDevice, &allocateInfo, sets.data());
+        if (result != VK_SUCCESS) {
+            std::exit(EXIT_FAILURE);
+        }
+
+        instanceSet = sets.back();
+        sets.pop_back();
+        cullSets = std::move(sets);
+    }
+
+    VkBuffer GpuCulling::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, Allocation& allocation) {
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkResult result = vkCreateBuffer(logicalDevice, &bufferInfo, nullptr, &buffer);
+        if (result != VK_SUCCESS) {
+            spdlog::error("Cannot create culling buffer");
+            std::exit(EXIT_FAILURE);
+        }
+
+        allocation = allocator.AllocateForBuffer(buffer, properties);
+        if (!allocation.IsValid()) {
+            spdlog::error("Cannot allocate {} bytes for a culling buffer", size);
+            std::exit(EXIT_FAILURE);
+        }
+        return buffer;
+    }
+
+    void GpuCulling::DestroyObjectBuffers() {
+        if (drawBuffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(logicalDevice, drawBuffer, nullptr);
+            allocator.Free(drawMemory);
+            drawBuffer = VK_NULL_HANDLE;
+        }
+        if (instanceBuffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(logicalDevice, instanceBuffer, nullptr);
+            allocator.Free(instanceMemory);
+            instanceBuffer = VK_NULL_HANDLE;
+        }
+        if (objectBuffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(logicalDevice, objectBuffer, nullptr);
+            allocator.Free(objectMemory);
+            objectBuffer = VK_NULL_HANDLE;
+        }
+        objectCount = 0;
+    }
+
+    static void UploadInChunks(UploadService& uploadService, VkBuffer buffer, gsl::span<const std::uint8_t> data) {
+        // Same chunking as mesh uploads, so a large scene streams through the staging ring.
+        constexpr std::size_t kChunkSize = 8ull * 1024 * 1024;
+
+        for (std::size_t offset = 0; offset < data.size(); offset += kChunkSize) {
+            const std::size_t chunkSize = std::min(kChunkSize, data.size() - offset);
+            if (!uploadService.UploadBuffer(buffer, offset, data.subspan(offset, chunkSize))) {
+                spdlog::error("Cannot upload culling objects");
+                std::exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    void GpuCulling::SetObjects(gsl::span<const IndirectObject> objects) {
+        DestroyObjectBuffers();
+        if (objects.empty()) return;
+
+        objectCount = static_cast<std::uint32_t>(objects.size());
+        if (objectCount > maxDrawCount) {
+            spdlog::warn("{} culled objects exceed the device's {} indirect draws, the rest are never drawn", objectCount, maxDrawCount);
+        }
+
+        std::vector<CullObject> cullObjects(objects.size());
+        std::vector<InstanceData> instances(objects.size());
+        for (std::size_t i = 0; i < objects.size(); ++i) {
+            const IndirectObject& object = objects[i];
+            cullObjects[i] = {object.boundingSphere, object.indexCount, object.firstIndex, object.vertexOffset, 0};
+            instances[i] = object.instance;
+        }
+
+        const VkDeviceSize objectBytes = cullObjects.size() * sizeof(CullObject);
+        const VkDeviceSize instanceBytes = instances.size() * sizeof(InstanceData);
+        objectBuffer = CreateBuffer(objectBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, objectMemory);
+        instanceBuffer = CreateBuffer(instanceBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, instanceMemory);
+
+        UploadInChunks(uploadService, objectBuffer, {reinterpret_cast<const std::uint8_t*>(cullObjects.data()), objectBytes});
+        UploadInChunks(uploadService, instanceBuffer, {reinterpret_cast<const std::uint8_t*>(instances.data()), instanceBytes});
+
+        auto align = [this](VkDeviceSize size) { return (size + minOffsetAlignment - 1) / minOffsetAlignment * minOffsetAlignment; };
+        countSize = align(sizeof(std::uint32_t));
+        regionSize = align(countSize + static_cast<VkDeviceSize>(objectCount) * sizeof(VkDrawIndexedIndirectCommand));
+        drawBuffer = CreateBuffer(regionSize * framesInFlight,
+                                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, drawMemory);
+
+        UpdateDescriptorSets();
+    }
+
+    void GpuCulling::UpdateDescriptorSets() {
+        std::vector<VkDescriptorBufferInfo> bufferInfos;
+        bufferInfos.reserve(3 * framesInFlight + 1);
+        std::vector<VkWriteDescriptorSet> writes;
+
+        auto addWrite = [&](VkDescriptorSet set, std::uint32_t binding, VkDescriptorType type, VkBuffer buffer,
+                            VkDeviceSize offset, VkDeviceSize range) {
+            bufferInfos.push_back({buffer, offset, range});
+
+            VkWriteDescriptorSet write = {};
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = set;
+            write.dstBinding = binding;
+            write.descriptorCount = 1;
+            write.descriptorType = type;
+            write.pBufferInfo = &bufferInfos.back();
+            writes.push_back(write);
+        };
+
+        for (std::uint32_t frame = 0; frame < framesInFlight; ++frame) {
+            const VkDeviceSize regionOffset = regionSize * frame;
+            addWrite(cullSets[frame], 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, objectBuffer, 0, VK_WHOLE_SIZE);
+            addWrite(cullSets[frame], 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, drawBuffer, regionOffset + countSize, regionSize - countSize);
+            addWrite(cullSets[frame], 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, drawBuffer, regionOffset, sizeof(std::uint32_t));
+        }
+
+        // Same layout as the per-frame instance buffer, so the graphics pipelines draw from it unchanged.
+        addWrite(instanceSet, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, instanceBuffer, 0, VK_WHOLE_SIZE);
+
+        vkUpdateDescriptorSets(logicalDevice, writes.size(), writes.data(), 0, nullptr);
+    }
+
+    void GpuCulling::Record(VkCommandBuffer commandBuffer, std::uint32_t frameIndex, const Frustum& frustum) const {
+        if (objectCount == 0) return;
+
+        // Without a count buffer every command slot is drawn, so the slots the shader leaves alone must hold empty draws.
+        const VkDeviceSize regionOffset = regionSize * frameIndex;
+        vkCmdFillBuffer(commandBuffer, drawBuffer, regionOffset, drawIndirectCountSupported ? sizeof(std::uint32_t) : regionSize, 0);
+
+        // The shader's atomics read and write the cleared count; the commands it only writes.
+        VkMemoryBarrier2KHR clearBarrier = {};
+        clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+        clearBarrier.srcStageMask = VK_PIPELINE_STAGE_2_CLEAR_BIT;
+        clearBarrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        clearBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+        clearBarrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+
+        VkDependencyInfoKHR clearDependency = {};
+        clearDependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+        clearDependency.memoryBarrierCount = 1;
+        clearDependency.pMemoryBarriers = &clearBarrier;
+        functions.cmdPipelineBarrier2(commandBuffer, &clearDependency);
+
+        PushConstants pushConstants = {};
+        pushConstants.planes = frustum.planes;
+        pushConstants.objectCount = objectCount;
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &cullSets[frameIndex], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+        vkCmdDispatch(commandBuffer, (objectCount + kWorkgroupSize - 1) / kWorkgroupSize, 1, 1);
+
+        VkMemoryBarrier2KHR drawBarrier = {};
+        drawBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+        drawBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+        drawBarrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+        drawBarrier.dstStageMask = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT;
+        drawBarrier.dstAccessMask = VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT;
+
+        VkDependencyInfoKHR drawDependency = {};
+        drawDependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+        drawDependency.memoryBarrierCount = 1;
+        drawDependency.pMemoryBarriers = &drawBarrier;
+        functions.cmdPipelineBarrier2(commandBuffer, &drawDependency);
+    }
+
+    void GpuCulling::Draw(VkCommandBuffer commandBuffer, std::uint32_t frameIndex, VkPipelineLayout pipelineLayout) const {
+        if (objectCount == 0) return;
+
+        // gl_InstanceIndex is the object index, which reads the object's own instance data.
+        const std::uint32_t dynamicOffset = 0;
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &instanceSet, 1, &dynamicOffset);
+
+        const VkDeviceSize regionOffset = regionSize * frameIndex;
+        const std::uint32_t drawCount = std::min(objectCount, maxDrawCount);
+        if (drawIndirectCountSupported) {
+            vkCmdDrawIndexedIndirectCount(commandBuffer, drawBuffer, regionOffset + countSize, drawBuffer, regionOffset, drawCount,
+                                          sizeof(VkDrawIndexedIndirectCommand));
+        } else {
+            vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, regionOffset + countSize, drawCount, sizeof(VkDrawIndexedIndirectCommand));
+        }
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <memory_allocator.h>
+#include <device_functions.h>
+#include <upload_service.h>
+#include <instance_buffer.h>
+#include <frustum_culling.h>
+
+namespace veng {
+
+    // One object of a GPU-culled scene: its instance data, a world-space bounding sphere and the indexed range of
+    // the shared mesh it draws.
+    struct IndirectObject {
+        InstanceData instance;
+        glm::vec4 boundingSphere = glm::vec4(0.0f);
+        std::uint32_t indexCount = 0;
+        std::uint32_t firstIndex = 0;
+        std::int32_t vertexOffset = 0;
+    };
+
+    // Culls a static set of objects in a compute shader that appends a VkDrawIndexedIndirectCommand for every
+    // visible one, so the CPU records the same handful of commands per frame however large the scene is. Objects
+    // live in device-local memory; each frame in flight has its own command list and draw count.
+    class GpuCulling final {
+    public:
+        GpuCulling(VkDevice logicalDevice, MemoryAllocator& allocator, const DeviceFunctions& functions, UploadService& uploadService,
+                   VkPipelineCache pipelineCache,
+                   VkShaderModule cullShader, VkDescriptorSetLayout instanceSetLayout, const VkPhysicalDeviceLimits& limits,
+                   std::uint32_t framesInFlight, bool drawIndirectCountSupported);
+        ~GpuCulling();
+
+        GpuCulling(const GpuCulling&) = delete;
+        GpuCulling& operator=(const GpuCulling&) = delete;
+
+        // No frame that used the previous objects may still be in flight.
+        void SetObjects(gsl::span<const IndirectObject> objects);
+
+        // Must be recorded outside a render pass, before the Draw of the same frame.
+        void Record(VkCommandBuffer commandBuffer, std::uint32_t frameIndex, const Frustum& frustum) const;
+        // Expects the pipeline and the mesh every object indexes into to be bound. Leaves set 0 bound to the objects'
+        // instances.
+        void Draw(VkCommandBuffer commandBuffer, std::uint32_t frameIndex, VkPipelineLayout pipelineLayout) const;
+
+        std::uint32_t GetObjectCount() const { return objectCount; }
+
+    private:
+        // std430 layout of an object as cull.comp reads it.
+        struct CullObject {
+            glm::vec4 boundingSphere;
+            std::uint32_t indexCount;
+            std::uint32_t firstIndex;
+            std::int32_t vertexOffset;
+            std::uint32_t padding;
+        };
+
+        struct PushConstants {
+            std::array<glm::vec4, 6> planes;
+            std::uint32_t objectCount;
+        };
+
+        static constexpr std::uint32_t kWorkgroupSize = 64;
+
+        void CreatePipeline(VkPipelineCache pipelineCache, VkShaderModule cullShader);
+        void CreateDescriptorPool();
+        void DestroyObjectBuffers();
+        VkBuffer CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, Allocation& allocation);
+        void UpdateDescriptorSets();
+
+        VkDevice logicalDevice = VK_NULL_HANDLE;
+        MemoryAllocator& allocator;
+        DeviceFunctions functions;
+        UploadService& uploadService;
+        VkDescriptorSetLayout instanceSetLayout = VK_NULL_HANDLE;
+        VkDeviceSize minOffsetAlignment = 1;
+        std::uint32_t maxDrawCount = 0;
+        std::uint32_t framesInFlight = 0;
+        bool drawIndirectCountSupported = false;
+
+        VkDescriptorSetLayout cullSetLayout = VK_NULL_HANDLE;
+        VkPipelineLayout cullPipelineLayout = VK_NULL_HANDLE;
+        VkPipeline cullPipeline = VK_NULL_HANDLE;
+        VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+        std::vector<VkDescriptorSet> cullSets;
+        VkDescriptorSet instanceSet = VK_NULL_HANDLE;
+
+        std::uint32_t objectCount = 0;
+        VkBuffer objectBuffer = VK_NULL_HANDLE;
+        Allocation objectMemory;
+        VkBuffer instanceBuffer = VK_NULL_HANDLE;
+        Allocation instanceMemory;
+
+        // Per frame: the draw count, padded to the offset alignment, followed by room for one command per object.
+        VkBuffer drawBuffer = VK_NULL_HANDLE;
+        Allocation drawMemory;
+        VkDeviceSize countSize = 0;
+        VkDeviceSize regionSize = 0;
+    };
+}
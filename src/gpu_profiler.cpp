@@ -0,0 +1,114 @@
+#include <precomp.h>
+#include <gpu_profiler.h>
+#include <profiler.h>
+#include <spdlog/spdlog.h>
+
+namespace veng {
+
+    GpuProfiler::GpuProfiler(VkDevice logicalDevice, float timestampPeriod, std::uint32_t timestampValidBits,
+                             std::uint32_t framesInFlight)
+            : logicalDevice(logicalDevice), timestampPeriod(timestampPeriod) {
+        if (timestampValidBits == 0) {
+            spdlog::warn("The graphics queue does not support timestamps, GPU timings are disabled");
+            return;
+        }
+
+        timestampMask = timestampValidBits >= 64 ? ~0ull : (1ull << timestampValidBits) - 1;
+
+        slots.resize(framesInFlight);
+        for (FrameSlot& slot : slots) {
+            VkQueryPoolCreateInfo info = {};
+            info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            info.queryCount = kMaxQueriesPerFrame;
+
+            VkResult result = vkCreateQueryPool(logicalDevice, &info, nullptr, &slot.queryPool);
+            if (result != VK_SUCCESS) {
+                std::exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    GpuProfiler::~GpuProfiler() {
+        for (FrameSlot& slot : slots) {
+            vkDestroyQueryPool(logicalDevice, slot.queryPool, nullptr);
+        }
+    }
+
+    void GpuProfiler::ReadBack(FrameSlot& slot) {
+        std::array<std::uint64_t, kMaxQueriesPerFrame> timestamps;
+        VkResult result = vkGetQueryPoolResults(logicalDevice, slot.queryPool, 0, slot.queryCount,
+                                                slot.queryCount * sizeof(std::uint64_t), timestamps.data(),
+                                                sizeof(std::uint64_t), VK_QUERY_RESULT_64_BIT);
+        slot.pending = false;
+        if (result != VK_SUCCESS) {
+            return;
+        }
+
+        auto toNanoseconds = [this, &timestamps](std::uint32_t query) {
+            return static_cast<std::int64_t>(static_cast<double>(timestamps[query] & timestampMask) * timestampPeriod);
+        };
+
+#if VENG_PROFILER_ENABLED
+        // GPU ticks live in their own clock domain, place the frame on the CPU timeline at its submit time.
+        const std::int64_t frameBegin = toNanoseconds(slot.scopes[frameScope].beginQuery);
+
+        for (const Scope& scope : slot.scopes) {
+            const std::int64_t begin = toNanoseconds(scope.beginQuery);
+            const std::int64_t end = toNanoseconds(scope.endQuery);
+            VENG_PROFILE_ON_TRACK(kGpuTrackId, "GPU", scope.name, slot.cpuSubmitTime + (begin - frameBegin),
+                                  std::max<std::int64_t>(end - begin, 0));
+        }
+#endif
+
+        const Scope& frame = slot.scopes[frameScope];
+        lastFrameTime = (toNanoseconds(frame.endQuery) - toNanoseconds(frame.beginQuery)) / 1.0e6;
+    }
+
+    void GpuProfiler::BeginFrame(VkCommandBuffer commandBuffer, std::uint32_t frameIndex) {
+        if (!IsEnabled()) return;
+
+        currentSlot = &slots[frameIndex % slots.size()];
+
+        // The caller already waited for this slot's previous frame, so its results are available.
+        if (currentSlot->pending) {
+            ReadBack(*currentSlot);
+        }
+
+        currentSlot->scopes.clear();
+        currentSlot->queryCount = 0;
+        vkCmdResetQueryPool(commandBuffer, currentSlot->queryPool, 0, kMaxQueriesPerFrame);
+
+        frameScope = BeginScope(commandBuffer, "GpuFrame");
+    }
+
+    void GpuProfiler::EndFrame(VkCommandBuffer commandBuffer, std::int64_t cpuSubmitTime) {
+        if (!IsEnabled()) return;
+
+        EndScope(commandBuffer, frameScope);
+        currentSlot->cpuSubmitTime = cpuSubmitTime;
+        currentSlot->pending = true;
+    }
+
+    std::uint32_t GpuProfiler::BeginScope(VkCommandBuffer commandBuffer, gsl::czstring name) {
+        if (!IsEnabled() || currentSlot->queryCount + 2 > kMaxQueriesPerFrame) {
+            return std::numeric_limits<std::uint32_t>::max();
+        }
+
+        Scope scope;
+        scope.name = name;
+        scope.beginQuery = currentSlot->queryCount++;
+        scope.endQuery = currentSlot->queryCount++;
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, currentSlot->queryPool, scope.beginQuery);
+
+        currentSlot->scopes.push_back(scope);
+        return static_cast<std::uint32_t>(currentSlot->scopes.size() - 1);
+    }
+
+    void GpuProfiler::EndScope(VkCommandBuffer commandBuffer, std::uint32_t scopeIndex) {
+        if (!IsEnabled() || scopeIndex >= currentSlot->scopes.size()) return;
+
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, currentSlot->queryPool,
+                            currentSlot->scopes[scopeIndex].endQuery);
+    }
+}
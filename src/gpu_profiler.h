@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <profiler.h>
+
+#define VENG_GPU_PROFILE_SCOPE(profiler, commandBuffer, name) \
+    const veng::GpuProfileScope VENG_PROFILE_CONCAT(gpuProfileScope, __LINE__)(profiler, commandBuffer, name)
+
+namespace veng {
+
+    // Timestamp queries with one pool per frame in flight. A slot is only read back once the frame that used it
+    // has completed on the GPU, so reading results never waits.
+    class GpuProfiler final {
+    public:
+        GpuProfiler(VkDevice logicalDevice, float timestampPeriod, std::uint32_t timestampValidBits, std::uint32_t framesInFlight);
+        ~GpuProfiler();
+
+        GpuProfiler(const GpuProfiler&) = delete;
+        GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+        void BeginFrame(VkCommandBuffer commandBuffer, std::uint32_t frameIndex);
+        void EndFrame(VkCommandBuffer commandBuffer, std::int64_t cpuSubmitTime);
+
+        std::uint32_t BeginScope(VkCommandBuffer commandBuffer, gsl::czstring name);
+        void EndScope(VkCommandBuffer commandBuffer, std::uint32_t scopeIndex);
+
+        bool IsEnabled() const { return !slots.empty(); }
+        double GetLastFrameTime() const { return lastFrameTime; }
+
+    private:
+        struct Scope {
+            gsl::czstring name = nullptr;
+            std::uint32_t beginQuery = 0;
+            std::uint32_t endQuery = 0;
+        };
+
+        struct FrameSlot {
+            VkQueryPool queryPool = VK_NULL_HANDLE;
+            std::vector<Scope> scopes;
+            std::uint32_t queryCount = 0;
+            std::int64_t cpuSubmitTime = 0;
+            bool pending = false;
+        };
+
+        static constexpr std::uint32_t kMaxQueriesPerFrame = 256;
+        static constexpr std::uint32_t kGpuTrackId = Profiler::kFirstCustomTrackId;
+
+        void ReadBack(FrameSlot& slot);
+
+        VkDevice logicalDevice = VK_NULL_HANDLE;
+        double timestampPeriod = 1.0;
+        std::uint64_t timestampMask = 0;
+        std::vector<FrameSlot> slots;
+        FrameSlot* currentSlot = nullptr;
+        std::uint32_t frameScope = 0;
+        double lastFrameTime = 0.0;
+    };
+
+    class GpuProfileScope {
+    public:
+        GpuProfileScope(GpuProfiler& profiler, VkCommandBuffer commandBuffer, gsl::czstring name)
+                : profiler(profiler), commandBuffer(commandBuffer), scopeIndex(profiler.BeginScope(commandBuffer, name)) {}
+        ~GpuProfileScope() { profiler.EndScope(commandBuffer, scopeIndex); }
+
+        GpuProfileScope(const GpuProfileScope&) = delete;
+        GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+
+    private:
+        GpuProfiler& profiler;
+        VkCommandBuffer commandBuffer;
+        std::uint32_t scopeIndex;
+    };
+}
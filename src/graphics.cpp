@@ -2,6 +2,9 @@
 #include <graphics.h>
 #include <GLFW/glfw3.h>
 #include <spdlog/spdlog.h>
+#include <profiler.h>
+#include <job_system.h>
+#include <charconv>
 
 #pragma region VK_FUNCTION_EXT_IMPL
 
@@ -46,15 +49,12 @@ namespace veng {
             const VkDebugUtilsMessengerCallbackDataEXT* callbackData,
             void* userData
             ){
-        if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
-            spdlog::warn("Vulkan Validation: {}", callbackData->pMessage);
-        } else {
-            spdlog::error("Vulkan Error: {}", callbackData->pMessage);
-        }
+        // Logging here would run on the driver's thread for every message, so hand it to the sink instead.
+        static_cast<ValidationSink*>(userData)->Push(severity, *callbackData);
         return VK_FALSE;
     }
 
-    static VkDebugUtilsMessengerCreateInfoEXT GetCreateMessengerInfo() {
+    static VkDebugUtilsMessengerCreateInfoEXT GetCreateMessengerInfo(ValidationSink* sink) {
         VkDebugUtilsMessengerCreateInfoEXT creationInfo = {};
         creationInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
         creationInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
@@ -64,7 +64,7 @@ namespace veng {
                                     VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT;
 
         creationInfo.pfnUserCallback = ValidationCallback;
-        creationInfo.pUserData = nullptr;
+        creationInfo.pUserData = sink;
 
         return creationInfo;
     }
@@ -96,9 +96,10 @@ namespace veng {
     }
 
     void Graphics::SetupDebugMessenger() {
+        VENG_PROFILE_FUNCTION();
         if (!validationEnabled) return;
-        VkDebugUtilsMessengerCreateInfoEXT info = GetCreateMessengerInfo();
-        VkResult result = vkCreateDebugUtilsMessengerEXT(vkInstance, &info, nullptr, &debugMessenger);
+        VkDebugUtilsMessengerCreateInfoEXT info = GetCreateMessengerInfo(validationSink.get());
+        VkResult result = vkCreateDebugUtilsMessengerEXT(vkInstance, &info, GetAllocationCallbacks(VK_OBJECT_TYPE_DEBUG_UTILS_MESSENGER_EXT), &debugMessenger);
         if (result != VK_SUCCESS){
             spdlog::error("Cannot create debug messenger");
             return;
@@ -110,12 +111,28 @@ namespace veng {
 #pragma region INSTANCE_AND_EXTENSIONS
 
     void Graphics::CreateInstance() {
+        VENG_PROFILE_FUNCTION();
         std::array<gsl::czstring, 1> validationLayers = {"VK_LAYER_KHRONOS_validation"};
         if (!AreAllLayersSupported(validationLayers))
             validationEnabled = false;
 
         std::vector<gsl::czstring> requiredExtensions = GetRequiredInstanceExtensions();
 
+        // Target 1.3 where the loader has it; 1.2 devices get the same features from extensions. A 1.0 loader does
+        // not export vkEnumerateInstanceVersion, so it is looked up rather than called directly.
+        std::uint32_t loaderVersion = VK_API_VERSION_1_0;
+        const auto enumerateInstanceVersion =
+                reinterpret_cast<PFN_vkEnumerateInstanceVersion>(vkGetInstanceProcAddr(VK_NULL_HANDLE, "vkEnumerateInstanceVersion"));
+        if (enumerateInstanceVersion == nullptr || enumerateInstanceVersion(&loaderVersion) != VK_SUCCESS) {
+            loaderVersion = VK_API_VERSION_1_0;
+        }
+        if (loaderVersion < VK_API_VERSION_1_2) {
+            spdlog::error("The Vulkan loader supports version {}.{}, but Vulkan 1.2 or newer is required; update the Vulkan runtime or driver",
+                          VK_API_VERSION_MAJOR(loaderVersion), VK_API_VERSION_MINOR(loaderVersion));
+            std::exit(EXIT_FAILURE);
+        }
+        instanceApiVersion = loaderVersion >= VK_API_VERSION_1_3 ? VK_API_VERSION_1_3 : VK_API_VERSION_1_2;
+
         VkApplicationInfo applicationInfo = {};
         applicationInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
         applicationInfo.pNext = nullptr;
@@ -123,7 +140,7 @@ namespace veng {
         applicationInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
         applicationInfo.pEngineName = "VEng";
         applicationInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        applicationInfo.apiVersion = VK_API_VERSION_1_0;
+        applicationInfo.apiVersion = instanceApiVersion;
 
         VkInstanceCreateInfo instanceCreateInfo = {};
         instanceCreateInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -132,7 +149,11 @@ namespace veng {
         instanceCreateInfo.enabledExtensionCount = requiredExtensions.size();
         instanceCreateInfo.ppEnabledExtensionNames = requiredExtensions.data();
 
-        VkDebugUtilsMessengerCreateInfoEXT messengerCreationInfo = GetCreateMessengerInfo();
+        if (validationEnabled) {
+            validationSink = std::make_unique<ValidationSink>();
+            validationSink->SetBreakOnError(std::getenv("VENG_BREAK_ON_VALIDATION_ERROR") != nullptr);
+        }
+        VkDebugUtilsMessengerCreateInfoEXT messengerCreationInfo = GetCreateMessengerInfo(validationSink.get());
 
         if (validationEnabled){
             instanceCreateInfo.pNext = &messengerCreationInfo;
@@ -145,7 +166,7 @@ namespace veng {
 
         instanceCreateInfo.flags |= VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR;
 
-        VkResult result = vkCreateInstance(&instanceCreateInfo, nullptr, &vkInstance);
+        VkResult result = vkCreateInstance(&instanceCreateInfo, GetAllocationCallbacks(VK_OBJECT_TYPE_INSTANCE), &vkInstance);
 
         if(result != VK_SUCCESS){
             std::cout << static_cast<std::underlying_type<VkResult>::type>(result) << std::endl;
@@ -154,10 +175,13 @@ namespace veng {
     }
 
     gsl::span<gsl::czstring> Graphics::GetSuggestedInstanceExtensions() {
-        std::uint32_t  glfwExtensionCount = 0;
-        const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
         m_extensions.clear();
-        m_extensions.insert(m_extensions.end(), glfwExtensions, glfwExtensions + glfwExtensionCount);
+
+        if (!IsHeadless()) {
+            std::uint32_t  glfwExtensionCount = 0;
+            const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+            m_extensions.insert(m_extensions.end(), glfwExtensions, glfwExtensions + glfwExtensionCount);
+        }
 
         m_extensions.push_back(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME);
 
@@ -209,19 +233,44 @@ namespace veng {
 
 #pragma region DEVICES_AND_QUEUES
 
-    Graphics::QueueFamilyIndices Graphics::FindQueueFamilies(VkPhysicalDevice device) {
-
-        std::uint32_t queueFamilyCount = 0;
-        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
-        std::vector<VkQueueFamilyProperties> families(queueFamilyCount);
-        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, families.data());
+    Graphics::QueueFamilyIndices Graphics::FindQueueFamilies(VkPhysicalDevice device, gsl::span<const VkQueueFamilyProperties> families) {
 
         auto graphicsFamilyIt = std::find_if(families.begin(), families.end(), [](const VkQueueFamilyProperties& properties) {
-        return properties.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_TRANSFER_BIT);
+        return properties.queueFlags & VK_QUEUE_GRAPHICS_BIT;
         });
 
         QueueFamilyIndices result;
-        result.graphicsFamily = graphicsFamilyIt - families.begin();
+        if (graphicsFamilyIt != families.end()) {
+            result.graphicsFamily = graphicsFamilyIt - families.begin();
+        }
+
+        // A transfer-only family usually maps to the copy engines, which run next to the graphics queue.
+        auto transferOnlyFamilyIt = std::find_if(families.begin(), families.end(), [](const VkQueueFamilyProperties& properties) {
+            return (properties.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+                   !(properties.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT));
+        });
+        auto nonGraphicsTransferFamilyIt = std::find_if(families.begin(), families.end(), [](const VkQueueFamilyProperties& properties) {
+            return (properties.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(properties.queueFlags & VK_QUEUE_GRAPHICS_BIT);
+        });
+
+        if (transferOnlyFamilyIt != families.end()) {
+            result.transferFamily = transferOnlyFamilyIt - families.begin();
+        } else if (nonGraphicsTransferFamilyIt != families.end()) {
+            result.transferFamily = nonGraphicsTransferFamilyIt - families.begin();
+        } else {
+            result.transferFamily = result.graphicsFamily;
+        }
+
+        auto computeOnlyFamilyIt = std::find_if(families.begin(), families.end(), [](const VkQueueFamilyProperties& properties) {
+            return (properties.queueFlags & VK_QUEUE_COMPUTE_BIT) && !(properties.queueFlags & VK_QUEUE_GRAPHICS_BIT);
+        });
+        if (computeOnlyFamilyIt != families.end()) {
+            result.computeFamily = computeOnlyFamilyIt - families.begin();
+        }
+
+        if (IsHeadless()) {
+            return result;
+        }
 
         for (std::uint32_t i = 0; i < families.size(); ++i) {
             VkBool32 hasPresentationSupport = false;
@@ -246,29 +295,224 @@ namespace veng {
         return availableExtensions;
     }
 
-    bool Graphics::AreAllDeviceExtensionsSupported(VkPhysicalDevice device) {
-        std::vector<VkExtensionProperties> availableExtensions = GetDeviceAvailableExtensions(device);
+    bool Graphics::DeviceCapabilities::HasExtension(gsl::czstring name) const {
+        return std::any_of(extensions.begin(), extensions.end(), std::bind_front(ExtensionMatchesName, name));
+    }
 
+    VkDeviceSize Graphics::DeviceCapabilities::GetDeviceLocalMemory() const {
+        VkDeviceSize largestHeap = 0;
+        for (std::uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i) {
+            if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+                largestHeap = std::max(largestHeap, memoryProperties.memoryHeaps[i].size);
+            }
+        }
+        return largestHeap;
+    }
+
+    Graphics::DeviceCapabilities Graphics::QueryDeviceCapabilities(VkPhysicalDevice device) {
+        DeviceCapabilities capabilities;
+        capabilities.device = device;
+
+        // The descriptor indexing limits size the bindless heap.
+        capabilities.vulkan12Properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+        VkPhysicalDeviceProperties2 properties = {};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        vkGetPhysicalDeviceProperties(device, &capabilities.properties);
+        if (std::min(capabilities.properties.apiVersion, instanceApiVersion) >= VK_API_VERSION_1_2) {
+            properties.pNext = &capabilities.vulkan12Properties;
+            vkGetPhysicalDeviceProperties2(device, &properties);
+            capabilities.vulkan12Properties.pNext = nullptr;
+        }
+        vkGetPhysicalDeviceMemoryProperties(device, &capabilities.memoryProperties);
+        capabilities.apiVersion = std::min(capabilities.properties.apiVersion, instanceApiVersion);
+        capabilities.extensions = GetDeviceAvailableExtensions(device);
+
+        capabilities.vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        capabilities.vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+
+        VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures = {};
+        dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+        VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2Features = {};
+        synchronization2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+
+        VkPhysicalDeviceFeatures2 features = {};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        if (capabilities.apiVersion >= VK_API_VERSION_1_2) {
+            features.pNext = &capabilities.vulkan12Features;
+        }
+        if (capabilities.HasCoreVulkan13()) {
+            capabilities.vulkan12Features.pNext = &capabilities.vulkan13Features;
+        } else {
+            // Extension structs are only valid in the chain when the device has the extension.
+            void** next = &capabilities.vulkan12Features.pNext;
+            if (capabilities.HasExtension(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME)) {
+                *next = &dynamicRenderingFeatures;
+                next = &dynamicRenderingFeatures.pNext;
+            }
+            if (capabilities.HasExtension(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME)) {
+                *next = &synchronization2Features;
+            }
+        }
+        vkGetPhysicalDeviceFeatures2(device, &features);
+        capabilities.features = features.features;
+        capabilities.vulkan12Features.pNext = nullptr;
+        capabilities.vulkan13Features.pNext = nullptr;
+
+        if (!capabilities.HasCoreVulkan13()) {
+            capabilities.vulkan13Features.dynamicRendering = dynamicRenderingFeatures.dynamicRendering;
+            capabilities.vulkan13Features.synchronization2 = synchronization2Features.synchronization2;
+        }
+
+        std::uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+        capabilities.queueFamilies.resize(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, capabilities.queueFamilies.data());
+
+        capabilities.queueFamilyIndices = FindQueueFamilies(device, capabilities.queueFamilies);
+
+        return capabilities;
+    }
+
+    bool Graphics::AreAllDeviceExtensionsSupported(const DeviceCapabilities& capabilities) {
         return std::all_of(requiredDeviceExtensions.begin(), requiredDeviceExtensions.end(),
-                           std::bind_front(IsExtensionSupported, availableExtensions));
+                           std::bind_front(&DeviceCapabilities::HasExtension, &capabilities));
     }
 
-    bool Graphics::IsDeviceSuitable(VkPhysicalDevice device) {
-        QueueFamilyIndices families = FindQueueFamilies(device);
-        return families.IsValid() && AreAllDeviceExtensionsSupported(device) && GetSwapChainProperties(device).IsValid();
+    bool Graphics::MeetsRequiredLimits(const DeviceCapabilities& capabilities) {
+        const VkPhysicalDeviceLimits& limits = capabilities.properties.limits;
+        return limits.maxImageDimension2D >= 4096 &&
+               limits.maxBoundDescriptorSets >= 4 &&
+               limits.maxPushConstantsSize >= 128;
+    }
+
+    std::optional<std::string_view> Graphics::FindMissingBindlessFeature(const DeviceCapabilities& capabilities) {
+        const VkPhysicalDeviceVulkan12Features& features = capabilities.vulkan12Features;
+        const std::array<std::pair<VkBool32, std::string_view>, 8> required = {{
+            {features.descriptorIndexing, "descriptorIndexing"},
+            {features.runtimeDescriptorArray, "runtimeDescriptorArray"},
+            {features.descriptorBindingPartiallyBound, "descriptorBindingPartiallyBound"},
+            {features.descriptorBindingUpdateUnusedWhilePending, "descriptorBindingUpdateUnusedWhilePending"},
+            {features.descriptorBindingSampledImageUpdateAfterBind, "descriptorBindingSampledImageUpdateAfterBind"},
+            {features.descriptorBindingStorageBufferUpdateAfterBind, "descriptorBindingStorageBufferUpdateAfterBind"},
+            {features.shaderSampledImageArrayNonUniformIndexing, "shaderSampledImageArrayNonUniformIndexing"},
+            {features.shaderStorageBufferArrayNonUniformIndexing, "shaderStorageBufferArrayNonUniformIndexing"},
+        }};
+
+        for (const auto& [supported, name] : required) {
+            if (supported != VK_TRUE) return name;
+        }
+        return std::nullopt;
+    }
+
+    std::optional<std::string_view> Graphics::FindUnmetRequirement(const DeviceCapabilities& capabilities) {
+        const QueueFamilyIndices& families = capabilities.queueFamilyIndices;
+        if (IsHeadless() ? !families.IsValidHeadless() : !families.IsValid()) return "required queue families";
+        if (!AreAllDeviceExtensionsSupported(capabilities)) return "required device extensions";
+        if (capabilities.apiVersion < VK_API_VERSION_1_2 || capabilities.vulkan12Features.timelineSemaphore != VK_TRUE) {
+            return "timeline semaphores";
+        }
+        if (capabilities.vulkan13Features.dynamicRendering != VK_TRUE) return "dynamic rendering";
+        if (capabilities.vulkan13Features.synchronization2 != VK_TRUE) return "synchronization2";
+        // The bindless heap has no fallback, so each descriptor indexing feature it relies on is named.
+        if (std::optional<std::string_view> missing = FindMissingBindlessFeature(capabilities)) return missing;
+        if (!MeetsRequiredLimits(capabilities)) return "required limits";
+        if (!IsHeadless() && !GetSwapChainProperties(capabilities.device).IsValid()) return "swap chain support";
+        return std::nullopt;
+    }
+
+    std::uint64_t Graphics::ScoreDevice(const DeviceCapabilities& capabilities) {
+        std::uint64_t score = 0;
+
+        switch (capabilities.properties.deviceType) {
+            case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: score += 100000; break;
+            case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: score += 10000; break;
+            case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: score += 5000; break;
+            default: break;
+        }
+
+        // One point per 16 MiB of the largest device-local heap.
+        score += capabilities.GetDeviceLocalMemory() >> 24;
+
+        const QueueFamilyIndices& families = capabilities.queueFamilyIndices;
+        if (families.transferFamily.has_value() && families.transferFamily != families.graphicsFamily) {
+            score += 2000;
+        }
+        if (families.computeFamily.has_value()) {
+            score += 2000;
+        }
+
+        return score;
+    }
+
+    bool MatchesDeviceOverride(gsl::czstring deviceOverride, std::size_t index, const VkPhysicalDeviceProperties& properties) {
+        const std::string_view overrideView(deviceOverride);
+        const bool isIndex = !overrideView.empty() && std::all_of(overrideView.begin(), overrideView.end(), [](char c) {
+            return std::isdigit(static_cast<unsigned char>(c)) != 0;
+        });
+        if (isIndex) {
+            // An index too large to parse cannot match any device.
+            std::size_t overrideIndex = 0;
+            const std::from_chars_result result = std::from_chars(overrideView.data(), overrideView.data() + overrideView.size(), overrideIndex);
+            return result.ec == std::errc() && overrideIndex == index;
+        }
+        return std::string_view(properties.deviceName).find(overrideView) != std::string_view::npos;
     }
 
     void Graphics::PickPhysicalDevice() {
+        VENG_PROFILE_FUNCTION();
         std::vector<VkPhysicalDevice> devices = GetAvailableDevices();
 
-        std::erase_if(devices, std::not_fn(std::bind_front(&Graphics::IsDeviceSuitable, this)));
+        std::vector<DeviceCapabilities> candidates;
+        std::transform(devices.begin(), devices.end(), std::back_inserter(candidates),
+                       std::bind_front(&Graphics::QueryDeviceCapabilities, this));
+
+        // VENG_DEVICE picks a device by enumeration index or by part of its name, bypassing the scoring.
+        gsl::czstring deviceOverride = std::getenv("VENG_DEVICE");
+
+        const DeviceCapabilities* picked = nullptr;
+        std::uint64_t bestScore = 0;
+        bool overrideMatched = false;
+        for (std::size_t i = 0; i < candidates.size(); ++i) {
+            const DeviceCapabilities& candidate = candidates[i];
+            const bool matchesOverride = deviceOverride != nullptr && MatchesDeviceOverride(deviceOverride, i, candidate.properties);
+            if (const std::optional<std::string_view> unmet = FindUnmetRequirement(candidate)) {
+                if (matchesOverride) {
+                    spdlog::warn("VENG_DEVICE={} matches device {}: {}, which is not suitable: it lacks {}", deviceOverride, i,
+                                 candidate.properties.deviceName, unmet.value());
+                } else {
+                    spdlog::info("Device {}: {} is not suitable: it lacks {}", i, candidate.properties.deviceName, unmet.value());
+                }
+                continue;
+            }
+
+            const std::uint64_t score = ScoreDevice(candidate);
+            spdlog::info("Device {}: {} scored {}", i, candidate.properties.deviceName, score);
+
+            if (matchesOverride) {
+                picked = &candidate;
+                overrideMatched = true;
+                break;
+            }
+
+            if (picked == nullptr || score > bestScore) {
+                picked = &candidate;
+                bestScore = score;
+            }
+        }
 
-        if (devices.empty()){
+        if (picked == nullptr){
             spdlog::error("No physical devices that match the criteria");
             std::exit(EXIT_FAILURE);
         }
 
-        physicalDevice = devices[0];
+        if (deviceOverride != nullptr && !overrideMatched) {
+            spdlog::warn("VENG_DEVICE={} does not match a suitable device, falling back to the highest scored one", deviceOverride);
+        }
+
+        spdlog::info("Picked {} with Vulkan {}.{}{}", picked->properties.deviceName, VK_API_VERSION_MAJOR(picked->apiVersion),
+                     VK_API_VERSION_MINOR(picked->apiVersion), picked->HasCoreVulkan13() ? "" : " and 1.3 extensions");
+        physicalDevice = picked->device;
+        deviceCapabilities = std::make_unique<const DeviceCapabilities>(*picked);
     }
 
     std::vector<VkPhysicalDevice> Graphics::GetAvailableDevices() {
@@ -286,15 +530,20 @@ namespace veng {
     }
 
     void Graphics::CreateLogicalDeviceAndQueues() {
-        QueueFamilyIndices pickedDeviceFamilies = FindQueueFamilies(physicalDevice);
+        VENG_PROFILE_FUNCTION();
+        const QueueFamilyIndices& pickedDeviceFamilies = deviceCapabilities->queueFamilyIndices;
 
-        if (!pickedDeviceFamilies.IsValid()){
+        if (IsHeadless() ? !pickedDeviceFamilies.IsValidHeadless() : !pickedDeviceFamilies.IsValid()){
             std::exit(EXIT_FAILURE);
         }
 
-        std::set<std::uint32_t> uniqueQueueFamilies = {
-                pickedDeviceFamilies.graphicsFamily.value(),
-                pickedDeviceFamilies.presentationFamily.value()};
+        std::set<std::uint32_t> uniqueQueueFamilies = {pickedDeviceFamilies.graphicsFamily.value()};
+        if (pickedDeviceFamilies.presentationFamily.has_value()) {
+            uniqueQueueFamilies.insert(pickedDeviceFamilies.presentationFamily.value());
+        }
+        if (pickedDeviceFamilies.transferFamily.has_value()) {
+            uniqueQueueFamilies.insert(pickedDeviceFamilies.transferFamily.value());
+        }
 
         std::float_t queuePriority = 1.0f;
 
@@ -308,24 +557,94 @@ namespace veng {
             queueCreateInfos.push_back(queueInfo);
         }
 
+        // GPU culling needs multi-draw indirect with per-command first instances; without a draw count it falls back
+        // to drawing every command slot.
+        multiDrawIndirectSupported = deviceCapabilities->features.multiDrawIndirect == VK_TRUE &&
+                                     deviceCapabilities->features.drawIndirectFirstInstance == VK_TRUE;
+        drawIndirectCountSupported = deviceCapabilities->vulkan12Features.drawIndirectCount == VK_TRUE;
+
         VkPhysicalDeviceFeatures requiredFeatures = {};
+        requiredFeatures.multiDrawIndirect = multiDrawIndirectSupported ? VK_TRUE : VK_FALSE;
+        requiredFeatures.drawIndirectFirstInstance = multiDrawIndirectSupported ? VK_TRUE : VK_FALSE;
+
+        VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+        vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        vulkan12Features.timelineSemaphore = VK_TRUE;
+        vulkan12Features.drawIndirectCount = drawIndirectCountSupported ? VK_TRUE : VK_FALSE;
+        // Descriptor indexing for the bindless heap, core in 1.2 and checked by FindUnmetRequirement.
+        vulkan12Features.descriptorIndexing = VK_TRUE;
+        vulkan12Features.runtimeDescriptorArray = VK_TRUE;
+        vulkan12Features.descriptorBindingPartiallyBound = VK_TRUE;
+        vulkan12Features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+        vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        vulkan12Features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+        vulkan12Features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+        vulkan12Features.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
 
         VkDeviceCreateInfo deviceInfo = {};
         deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        deviceInfo.pNext = &vulkan12Features;
         deviceInfo.queueCreateInfoCount = queueCreateInfos.size();
         deviceInfo.pQueueCreateInfos = queueCreateInfos.data();
         deviceInfo.pEnabledFeatures = &requiredFeatures;
-        deviceInfo.enabledExtensionCount = requiredDeviceExtensions.size();
-        deviceInfo.ppEnabledExtensionNames = requiredDeviceExtensions.data();
+        std::vector<gsl::czstring> enabledExtensions(requiredDeviceExtensions.begin(), requiredDeviceExtensions.end());
+
+        // Rendering without render pass objects and synchronization2 barriers, core on 1.3 and extensions before.
+        VkPhysicalDeviceVulkan13Features vulkan13Features = {};
+        vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+        vulkan13Features.dynamicRendering = VK_TRUE;
+        vulkan13Features.synchronization2 = VK_TRUE;
+
+        VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures = {};
+        dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+        dynamicRenderingFeatures.dynamicRendering = VK_TRUE;
+        VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2Features = {};
+        synchronization2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+        synchronization2Features.pNext = &dynamicRenderingFeatures;
+        synchronization2Features.synchronization2 = VK_TRUE;
+
+        if (deviceCapabilities->HasCoreVulkan13()) {
+            vulkan12Features.pNext = &vulkan13Features;
+        } else {
+            vulkan12Features.pNext = &synchronization2Features;
+            enabledExtensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+            enabledExtensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+        }
+
+        const bool memoryBudgetSupported = deviceCapabilities->HasExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        if (memoryBudgetSupported) {
+            enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        }
+
+        pipelineCreationFeedbackSupported = deviceCapabilities->HasExtension(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+        if (pipelineCreationFeedbackSupported) {
+            enabledExtensions.push_back(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+        }
+
+        deviceInfo.enabledExtensionCount = enabledExtensions.size();
+        deviceInfo.ppEnabledExtensionNames = enabledExtensions.data();
         deviceInfo.enabledLayerCount = 0;
 
-        VkResult result = vkCreateDevice(physicalDevice, &deviceInfo, nullptr, &logicalDevice);
+        VkResult result = vkCreateDevice(physicalDevice, &deviceInfo, GetAllocationCallbacks(VK_OBJECT_TYPE_DEVICE), &logicalDevice);
         if(result != VK_SUCCESS){
             std::exit(EXIT_FAILURE);
         }
 
+        deviceFunctions = LoadDeviceFunctions(logicalDevice, deviceCapabilities->HasCoreVulkan13());
+
         vkGetDeviceQueue(logicalDevice, pickedDeviceFamilies.graphicsFamily.value(), 0, &graphicsQueue);
-        vkGetDeviceQueue(logicalDevice, pickedDeviceFamilies.presentationFamily.value(), 0, &presentQueue);
+        if (pickedDeviceFamilies.presentationFamily.has_value()) {
+            vkGetDeviceQueue(logicalDevice, pickedDeviceFamilies.presentationFamily.value(), 0, &presentQueue);
+        }
+
+        const std::uint32_t transferFamily = pickedDeviceFamilies.transferFamily.value_or(pickedDeviceFamilies.graphicsFamily.value());
+        vkGetDeviceQueue(logicalDevice, transferFamily, 0, &transferQueue);
+
+        memoryAllocator = std::make_unique<MemoryAllocator>(physicalDevice, logicalDevice, memoryBudgetSupported,
+                                                            GetAllocationCallbacks(VK_OBJECT_TYPE_DEVICE_MEMORY));
+        uploadService = std::make_unique<UploadService>(logicalDevice, *memoryAllocator, deviceFunctions, transferQueue, transferFamily,
+                                                        pickedDeviceFamilies.graphicsFamily.value(), UploadService::kDefaultRingSize,
+                                                        hostAllocator.get());
     }
 
 #pragma endregion
@@ -333,7 +652,9 @@ namespace veng {
 #pragma region PRESENTATION
 
     void Graphics::CreateSurface() {
-        VkResult result = glfwCreateWindowSurface(vkInstance, window->GetHandle(), nullptr, &surface);
+        VENG_PROFILE_FUNCTION();
+        VkResult result = glfwCreateWindowSurface(vkInstance, window->GetHandle(), GetAllocationCallbacks(VK_OBJECT_TYPE_SURFACE_KHR),
+                                                  &surface);
         if (result != VK_SUCCESS) {
             std::exit(EXIT_FAILURE);
         }
@@ -385,14 +706,38 @@ namespace veng {
         return formats[0];
     }
 
-    bool IsMailboxPresentMode(const VkPresentModeKHR& mode) {
-        return mode == VK_PRESENT_MODE_MAILBOX_KHR;
+    bool IsPresentModeAvailable(gsl::span<VkPresentModeKHR> presentModes, VkPresentModeKHR mode) {
+        return std::find(presentModes.begin(), presentModes.end(), mode) != presentModes.end();
+    }
+
+    gsl::czstring GetPresentModeName(VkPresentModeKHR mode) {
+        switch (mode) {
+            case VK_PRESENT_MODE_IMMEDIATE_KHR: return "IMMEDIATE";
+            case VK_PRESENT_MODE_MAILBOX_KHR: return "MAILBOX";
+            case VK_PRESENT_MODE_FIFO_KHR: return "FIFO";
+            case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "FIFO_RELAXED";
+            default: return "UNKNOWN";
+        }
     }
 
     VkPresentModeKHR Graphics::ChooseSwapPresentMode(gsl::span<VkPresentModeKHR> presentMode) {
 
-        if (std::any_of(presentMode.begin(), presentMode.end(), IsMailboxPresentMode)){
-            return VK_PRESENT_MODE_MAILBOX_KHR;
+        switch (presentPolicy) {
+            case PresentPolicy::LowLatency:
+                if (IsPresentModeAvailable(presentMode, VK_PRESENT_MODE_MAILBOX_KHR)) {
+                    return VK_PRESENT_MODE_MAILBOX_KHR;
+                }
+                if (IsPresentModeAvailable(presentMode, VK_PRESENT_MODE_IMMEDIATE_KHR)) {
+                    return VK_PRESENT_MODE_IMMEDIATE_KHR;
+                }
+                break;
+            case PresentPolicy::Throughput:
+                if (IsPresentModeAvailable(presentMode, VK_PRESENT_MODE_FIFO_RELAXED_KHR)) {
+                    return VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+                }
+                break;
+            case PresentPolicy::PowerSaving:
+                break;
         }
 
         return VK_PRESENT_MODE_FIFO_KHR;
@@ -420,7 +765,14 @@ namespace veng {
     }
 
     std::uint32_t Graphics::ChooseSwapImageCount(const VkSurfaceCapabilitiesKHR& capabilities) {
+        // IMMEDIATE never blocks on the presentation engine, MAILBOX needs one spare image to replace the queued one
+        // and the throughput policy keeps a deeper queue so the GPU never starves.
         std::uint32_t imageCount = capabilities.minImageCount + 1;
+        if (presentMode == VK_PRESENT_MODE_IMMEDIATE_KHR) {
+            imageCount = capabilities.minImageCount;
+        } else if (presentPolicy == PresentPolicy::Throughput) {
+            imageCount = capabilities.minImageCount + 2;
+        }
 
         if (capabilities.maxImageCount > 0 && capabilities.maxImageCount < imageCount){
             imageCount = capabilities.maxImageCount;
@@ -430,6 +782,7 @@ namespace veng {
     }
 
     void Graphics::CreateSwapChain() {
+        VENG_PROFILE_FUNCTION();
         SwapChainProperties properties = GetSwapChainProperties(physicalDevice);
 
         surfaceFormat = ChooseSwapSurfaceFormat(properties.formats);
@@ -451,9 +804,10 @@ namespace veng {
         info.preTransform = properties.capabilities.currentTransform;
         info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
         info.clipped = VK_TRUE;
-        info.oldSwapchain = VK_NULL_HANDLE;
+        // Handing over the current swap chain lets the driver reuse its resources and keep presenting meanwhile.
+        info.oldSwapchain = swapChain;
 
-        QueueFamilyIndices indices = FindQueueFamilies(physicalDevice);
+        const QueueFamilyIndices& indices = deviceCapabilities->queueFamilyIndices;
 
 
         if (indices.graphicsFamily != indices.presentationFamily){
@@ -469,7 +823,7 @@ namespace veng {
             info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
         }
 
-        VkResult result = vkCreateSwapchainKHR(logicalDevice, &info, nullptr, &swapChain);
+        VkResult result = vkCreateSwapchainKHR(logicalDevice, &info, GetAllocationCallbacks(VK_OBJECT_TYPE_SWAPCHAIN_KHR), &swapChain);
         if (result != VK_SUCCESS){
             std::exit(EXIT_FAILURE);
         }
@@ -478,9 +832,27 @@ namespace veng {
         vkGetSwapchainImagesKHR(logicalDevice, swapChain, &actualImageCount, nullptr);
         swapChainImages.resize(actualImageCount);
         vkGetSwapchainImagesKHR(logicalDevice, swapChain, &actualImageCount, swapChainImages.data());
+
+        presentStats.presentMode = presentMode;
+        presentStats.imageCount = actualImageCount;
+        spdlog::info("Presenting with {} and {} swap chain images", GetPresentModeName(presentMode), actualImageCount);
+    }
+
+    void Graphics::SetPresentPolicy(PresentPolicy policy, std::uint32_t frameRateLimit) {
+        presentPolicy = policy;
+        frameLimiter.SetTargetFrameRate(policy == PresentPolicy::PowerSaving ? frameRateLimit : 0);
+
+        if (!IsHeadless()) {
+            swapChainNeedsRecreation = true;
+        }
+    }
+
+    void Graphics::MarkInputSampled() {
+        inputSampleTime = std::chrono::steady_clock::now();
     }
 
     void Graphics::CreateImageViews() {
+        VENG_PROFILE_FUNCTION();
         swapChainImageViews.resize(swapChainImages.size());
 
         auto imageViewIt = swapChainImageViews.begin();
@@ -500,55 +872,1022 @@ namespace veng {
             info.subresourceRange.baseArrayLayer = 0;
             info.subresourceRange.layerCount = 1;
 
-            VkResult result = vkCreateImageView(logicalDevice, &info, nullptr, &*imageViewIt);
+            VkResult result = vkCreateImageView(logicalDevice, &info, GetAllocationCallbacks(VK_OBJECT_TYPE_IMAGE_VIEW), &*imageViewIt);
             if (result != VK_SUCCESS){
                 std::exit(EXIT_FAILURE);
             }
-            std::next(imageViewIt);
+            ++imageViewIt;
+        }
+    }
+
+#pragma endregion
+
+#pragma region OFFSCREEN
+
+    void Graphics::CreateOffscreenImages() {
+        VENG_PROFILE_FUNCTION();
+        surfaceFormat = {VK_FORMAT_R8G8B8A8_SRGB, VK_COLORSPACE_SRGB_NONLINEAR_KHR};
+
+        // One target per frame in flight, so a frame never renders into an image the GPU is still using.
+        const std::uint32_t imageCount = GetFramesInFlight();
+        swapChainImages.resize(imageCount);
+        offscreenImageMemory.resize(imageCount);
+
+        for (std::uint32_t i = 0; i < imageCount; ++i) {
+            VkImageCreateInfo info = {};
+            info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            info.imageType = VK_IMAGE_TYPE_2D;
+            info.format = surfaceFormat.format;
+            info.extent = {extent.width, extent.height, 1};
+            info.mipLevels = 1;
+            info.arrayLayers = 1;
+            info.samples = VK_SAMPLE_COUNT_1_BIT;
+            info.tiling = VK_IMAGE_TILING_OPTIMAL;
+            info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+            info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+            VkResult result = vkCreateImage(logicalDevice, &info, GetAllocationCallbacks(VK_OBJECT_TYPE_IMAGE), &swapChainImages[i]);
+            if (result != VK_SUCCESS) {
+                std::exit(EXIT_FAILURE);
+            }
+
+            offscreenImageMemory[i] = memoryAllocator->AllocateForImage(swapChainImages[i], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            if (!offscreenImageMemory[i].IsValid()) {
+                std::exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+#pragma endregion
+
+#pragma region GRAPHICS_PIPELINE
+
+    void Graphics::CreatePipelineCache() {
+        VENG_PROFILE_FUNCTION();
+        pipelineCache = std::make_unique<PipelineCache>(logicalDevice, deviceCapabilities->properties, "pipeline_cache.bin",
+                                                        GetAllocationCallbacks(VK_OBJECT_TYPE_PIPELINE_CACHE));
+    }
+
+    void Graphics::CreateInstanceBuffer() {
+        instanceBuffer = std::make_unique<InstanceBuffer>(logicalDevice, *memoryAllocator,
+                                                          deviceCapabilities->properties.limits.minStorageBufferOffsetAlignment,
+                                                          GetFramesInFlight());
+    }
+
+    void Graphics::CreateUniformAllocator() {
+        uniformAllocator = std::make_unique<UniformAllocator>(logicalDevice, *memoryAllocator, deviceCapabilities->properties.limits,
+                                                              GetFramesInFlight());
+    }
+
+    void Graphics::CreateBindlessHeap() {
+        bindlessHeap = std::make_unique<BindlessHeap>(logicalDevice, deviceCapabilities->vulkan12Properties);
+        spdlog::info("Bindless heap holds {} textures and {} buffers", bindlessHeap->GetTextureCapacity(),
+                     bindlessHeap->GetBufferCapacity());
+    }
+
+    void Graphics::CreateGraphicsPipeline() {
+        VENG_PROFILE_FUNCTION();
+        VkShaderModule vertexShader = shaderRegistry->GetModule("basic.vert.spv");
+        VkShaderModule fragmentShader = shaderRegistry->GetModule("basic.frag.spv");
+
+        if (vertexShader == VK_NULL_HANDLE || fragmentShader == VK_NULL_HANDLE) {
+            spdlog::error("Cannot load the basic shaders");
+            std::exit(EXIT_FAILURE);
+        }
+
+        VkPipelineShaderStageCreateInfo vertexStageInfo = {};
+        vertexStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        vertexStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+        vertexStageInfo.module = vertexShader;
+        vertexStageInfo.pName = "main";
+
+        VkPipelineShaderStageCreateInfo fragmentStageInfo = {};
+        fragmentStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        fragmentStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        fragmentStageInfo.module = fragmentShader;
+        fragmentStageInfo.pName = "main";
+
+        // One pipeline per vertex layout. Both share the vertex shader, which only decodes octahedral normals when told to.
+        VkSpecializationMapEntry octahedralEntry = {};
+        octahedralEntry.constantID = 0;
+        octahedralEntry.offset = 0;
+        octahedralEntry.size = sizeof(VkBool32);
+
+        VkBool32 octahedralNormals = VK_FALSE;
+
+        VkSpecializationInfo specializationInfo = {};
+        specializationInfo.mapEntryCount = 1;
+        specializationInfo.pMapEntries = &octahedralEntry;
+        specializationInfo.dataSize = sizeof(VkBool32);
+        specializationInfo.pData = &octahedralNormals;
+        vertexStageInfo.pSpecializationInfo = &specializationInfo;
+
+        std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages = {vertexStageInfo, fragmentStageInfo};
+
+        std::array<VkDynamicState, 2> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+
+        VkPipelineDynamicStateCreateInfo dynamicStateInfo = {};
+        dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicStateInfo.dynamicStateCount = dynamicStates.size();
+        dynamicStateInfo.pDynamicStates = dynamicStates.data();
+
+        VkPipelineViewportStateCreateInfo viewportInfo = {};
+        viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportInfo.viewportCount = 1;
+        viewportInfo.scissorCount = 1;
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo = {};
+        inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
+
+        VkPipelineRasterizationStateCreateInfo rasterizationInfo = {};
+        rasterizationInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizationInfo.depthClampEnable = VK_FALSE;
+        rasterizationInfo.rasterizerDiscardEnable = VK_FALSE;
+        rasterizationInfo.polygonMode = VK_POLYGON_MODE_FILL;
+        rasterizationInfo.lineWidth = 1.0f;
+        rasterizationInfo.cullMode = VK_CULL_MODE_NONE;
+        rasterizationInfo.frontFace = VK_FRONT_FACE_CLOCKWISE;
+        rasterizationInfo.depthBiasEnable = VK_FALSE;
+
+        VkPipelineMultisampleStateCreateInfo multisampleInfo = {};
+        multisampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampleInfo.sampleShadingEnable = VK_FALSE;
+        multisampleInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+        VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+        colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+                                              VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        colorBlendAttachment.blendEnable = VK_FALSE;
+
+        VkPipelineColorBlendStateCreateInfo colorBlendInfo = {};
+        colorBlendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlendInfo.logicOpEnable = VK_FALSE;
+        colorBlendInfo.attachmentCount = 1;
+        colorBlendInfo.pAttachments = &colorBlendAttachment;
+
+        VkPipelineLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        // Set 0 holds the per-frame instance data every draw reads through gl_InstanceIndex, set 1 the per-frame
+        // uniforms and set 2 the bindless table.
+        const std::array<VkDescriptorSetLayout, 3> setLayouts = {instanceBuffer->GetDescriptorSetLayout(),
+                                                                 uniformAllocator->GetDescriptorSetLayout(),
+                                                                 bindlessHeap->GetDescriptorSetLayout()};
+        layoutInfo.setLayoutCount = setLayouts.size();
+        layoutInfo.pSetLayouts = setLayouts.data();
+
+        // The bindless handle of the texture basic.frag samples.
+        VkPushConstantRange textureRange = {};
+        textureRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        textureRange.offset = 0;
+        textureRange.size = sizeof(std::uint32_t);
+        layoutInfo.pushConstantRangeCount = 1;
+        layoutInfo.pPushConstantRanges = &textureRange;
+
+        VkResult layoutResult = vkCreatePipelineLayout(logicalDevice, &layoutInfo, GetAllocationCallbacks(VK_OBJECT_TYPE_PIPELINE_LAYOUT), &pipelineLayout);
+        if (layoutResult != VK_SUCCESS) {
+            std::exit(EXIT_FAILURE);
+        }
+
+        // Pipelines name the formats they render to instead of a render pass.
+        VkPipelineRenderingCreateInfoKHR renderingInfo = {};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+        renderingInfo.colorAttachmentCount = 1;
+        renderingInfo.pColorAttachmentFormats = &surfaceFormat.format;
+
+        for (std::size_t layoutIndex = 0; layoutIndex < kVertexLayoutCount; ++layoutIndex) {
+            const VertexLayout layout = static_cast<VertexLayout>(layoutIndex);
+            octahedralNormals = layout == VertexLayout::Compact ? VK_TRUE : VK_FALSE;
+            gsl::czstring layoutName = layout == VertexLayout::Compact ? "compact" : "float32";
+
+            const VkVertexInputBindingDescription bindingDescription = GetVertexBindingDescription(layout);
+            const std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions = GetVertexAttributeDescriptions(layout);
+
+            VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+            vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+            vertexInputInfo.vertexBindingDescriptionCount = 1;
+            vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+            vertexInputInfo.vertexAttributeDescriptionCount = attributeDescriptions.size();
+            vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+            VkGraphicsPipelineCreateInfo pipelineInfo = {};
+            pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+            pipelineInfo.pNext = &renderingInfo;
+            pipelineInfo.stageCount = shaderStages.size();
+            pipelineInfo.pStages = shaderStages.data();
+            pipelineInfo.pVertexInputState = &vertexInputInfo;
+            pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
+            pipelineInfo.pViewportState = &viewportInfo;
+            pipelineInfo.pRasterizationState = &rasterizationInfo;
+            pipelineInfo.pMultisampleState = &multisampleInfo;
+            pipelineInfo.pDepthStencilState = nullptr;
+            pipelineInfo.pColorBlendState = &colorBlendInfo;
+            pipelineInfo.pDynamicState = &dynamicStateInfo;
+            pipelineInfo.layout = pipelineLayout;
+            pipelineInfo.renderPass = VK_NULL_HANDLE;
+            pipelineInfo.subpass = 0;
+            pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+            pipelineInfo.basePipelineIndex = -1;
+
+            VkPipelineCreationFeedbackEXT creationFeedback = {};
+            std::array<VkPipelineCreationFeedbackEXT, 2> stageFeedbacks = {};
+
+            VkPipelineCreationFeedbackCreateInfoEXT feedbackInfo = {};
+            feedbackInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+            feedbackInfo.pPipelineCreationFeedback = &creationFeedback;
+            feedbackInfo.pipelineStageCreationFeedbackCount = stageFeedbacks.size();
+            feedbackInfo.pPipelineStageCreationFeedbacks = stageFeedbacks.data();
+
+            if (pipelineCreationFeedbackSupported) {
+                renderingInfo.pNext = &feedbackInfo;
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+            VkResult pipelineResult = vkCreateGraphicsPipelines(logicalDevice, pipelineCache->GetHandle(), 1, &pipelineInfo, GetAllocationCallbacks(VK_OBJECT_TYPE_PIPELINE), &pipelines[layoutIndex]);
+            if (pipelineResult != VK_SUCCESS) {
+                std::exit(EXIT_FAILURE);
+            }
+            const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+            if (creationFeedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT) {
+                const bool cacheHit = creationFeedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT;
+                spdlog::info("Graphics pipeline for {} vertices created in {:.3f} ms (cache {})", layoutName, elapsed.count(),
+                             cacheHit ? "hit" : "miss");
+            } else {
+                spdlog::info("Graphics pipeline for {} vertices created in {:.3f} ms ({} cache)", layoutName, elapsed.count(),
+                             pipelineCache->IsWarm() ? "warm" : "cold");
+            }
+        }
+    }
+
+    void Graphics::CreateGpuCulling() {
+        if (!multiDrawIndirectSupported) {
+            spdlog::warn("Multi-draw indirect is not supported, GPU culling is disabled");
+            return;
+        }
+
+        // Culling is optional, so a build that did not compile cull.comp only loses it.
+        VkShaderModule cullShader = shaderRegistry->GetModule("cull.comp.spv");
+        if (cullShader == VK_NULL_HANDLE) {
+            spdlog::warn("Cannot load cull.comp.spv, GPU culling is disabled");
+            return;
         }
+
+        gpuCulling = std::make_unique<GpuCulling>(logicalDevice, *memoryAllocator, deviceFunctions, *uploadService, pipelineCache->GetHandle(), cullShader,
+                                                  instanceBuffer->GetDescriptorSetLayout(), deviceCapabilities->properties.limits,
+                                                  GetFramesInFlight(), drawIndirectCountSupported);
+    }
+
+    void Graphics::CreateTriangleMesh() {
+        const std::array<Vertex, 3> vertices = {{
+            {glm::vec3(0.0f, -0.5f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec2(0.5f, 0.0f)},
+            {glm::vec3(0.5f, 0.5f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec2(1.0f, 1.0f)},
+            {glm::vec3(-0.5f, 0.5f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec2(0.0f, 1.0f)},
+        }};
+        const std::array<std::uint32_t, 3> indices = {0, 1, 2};
+
+        triangleMesh = CreateMesh(vertices, indices);
+    }
+
+    std::unique_ptr<Mesh> Graphics::CreateMesh(gsl::span<const Vertex> vertices, gsl::span<const std::uint32_t> indices, VertexLayout layout) {
+        const EncodedMesh encoded = EncodeMesh(vertices, indices, layout);
+        return CreateMesh(encoded.View());
+    }
+
+    std::unique_ptr<Mesh> Graphics::CreateMesh(const MeshView& view) {
+        VENG_PROFILE_FUNCTION();
+        return std::make_unique<Mesh>(logicalDevice, *memoryAllocator, *uploadService, view, GetAllocationCallbacks(VK_OBJECT_TYPE_BUFFER));
+    }
+
+    void Graphics::WaitIdle() {
+        vkDeviceWaitIdle(logicalDevice);
     }
 
 #pragma endregion
 
-    Graphics::Graphics(gsl::not_null<Window *> window) : window (window){
+#pragma region DRAWING
+
+    void Graphics::CreateFrameGraph() {
+        frameGraph = CreateRenderGraph();
+
+        // The acquired image arrives through the acquire semaphore, waited on at color attachment output, and
+        // leaves the frame ready to present, or to be copied out when rendering offscreen.
+        ImportedImage image;
+        image.image = swapChainImages[0];
+        image.view = swapChainImageViews[0];
+        image.format = surfaceFormat.format;
+        image.extent = extent;
+        image.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        image.initialStages = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+        image.finalLayout = IsHeadless() ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        backBuffer = frameGraph->ImportImage("Back buffer", image);
+
+        scenePass = frameGraph->AddPass("Scene");
+        frameGraph->ClearColor(scenePass, backBuffer, {{0.0f, 0.0f, 0.0f, 1.0f}});
+        frameGraph->Compile();
+        frameGraph->LogStats();
+    }
+
+    std::unique_ptr<RenderGraph> Graphics::CreateRenderGraph() {
+        return std::make_unique<RenderGraph>(logicalDevice, *memoryAllocator, deviceFunctions, hostAllocator.get());
+    }
+
+    void Graphics::CreateFrameResources() {
+        VENG_PROFILE_FUNCTION();
+        const QueueFamilyIndices& indices = deviceCapabilities->queueFamilyIndices;
+
+        VkSemaphoreCreateInfo binarySemaphoreInfo = {};
+        binarySemaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        for (FrameData& frame : frames) {
+            VkCommandPoolCreateInfo poolInfo = {};
+            poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+            poolInfo.queueFamilyIndex = indices.graphicsFamily.value();
+
+            VkResult result = vkCreateCommandPool(logicalDevice, &poolInfo, GetAllocationCallbacks(VK_OBJECT_TYPE_COMMAND_POOL), &frame.commandPool);
+            if (result != VK_SUCCESS) {
+                std::exit(EXIT_FAILURE);
+            }
+
+            VkCommandBufferAllocateInfo allocateInfo = {};
+            allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocateInfo.commandPool = frame.commandPool;
+            allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocateInfo.commandBufferCount = 1;
+
+            result = vkAllocateCommandBuffers(logicalDevice, &allocateInfo, &frame.commandBuffer);
+            if (result != VK_SUCCESS) {
+                std::exit(EXIT_FAILURE);
+            }
+
+            if (!IsHeadless()) {
+                result = vkCreateSemaphore(logicalDevice, &binarySemaphoreInfo, GetAllocationCallbacks(VK_OBJECT_TYPE_SEMAPHORE), &frame.imageAvailableSemaphore);
+                if (result != VK_SUCCESS) {
+                    std::exit(EXIT_FAILURE);
+                }
+            }
+        }
+
+        CreateRenderFinishedSemaphores();
+
+        VkSemaphoreTypeCreateInfo timelineInfo = {};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        timelineInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo timelineSemaphoreInfo = {};
+        timelineSemaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        timelineSemaphoreInfo.pNext = &timelineInfo;
+
+        VkResult result = vkCreateSemaphore(logicalDevice, &timelineSemaphoreInfo, GetAllocationCallbacks(VK_OBJECT_TYPE_SEMAPHORE), &frameTimeline);
+        if (result != VK_SUCCESS) {
+            std::exit(EXIT_FAILURE);
+        }
+
+        const std::uint32_t timestampValidBits = deviceCapabilities->queueFamilies[indices.graphicsFamily.value()].timestampValidBits;
+        gpuProfiler = std::make_unique<GpuProfiler>(logicalDevice, deviceCapabilities->properties.limits.timestampPeriod,
+                                                    timestampValidBits, GetFramesInFlight());
+
+        commandRecorder = std::make_unique<CommandRecorder>(logicalDevice, indices.graphicsFamily.value(), GetFramesInFlight(),
+                                                            JobSystem::Get().GetThreadCount(),
+                                                            GetAllocationCallbacks(VK_OBJECT_TYPE_COMMAND_POOL));
+    }
+
+    void Graphics::ReportFrameTimings() {
+        accumulatedCpuFrameTime += std::chrono::steady_clock::now() - cpuFrameStart;
+        accumulatedGpuFrameTime += gpuProfiler->GetLastFrameTime();
+        ++timingSampleCount;
+
+        const auto now = std::chrono::steady_clock::now();
+        if (now - lastTimingReport < std::chrono::seconds(1)) return;
+
+        const double cpuFrameTime = accumulatedCpuFrameTime.count() / timingSampleCount;
+        const double gpuFrameTime = accumulatedGpuFrameTime / timingSampleCount;
+        spdlog::info("CPU {:.3f} ms, GPU {:.3f} ms per frame ({}-bound)", cpuFrameTime, gpuFrameTime,
+                     gpuFrameTime > cpuFrameTime ? "GPU" : "CPU");
+        if (hostAllocator != nullptr) {
+            const HostAllocationCounters host = hostAllocator->GetTotalCounters();
+            spdlog::info("Driver host memory {:.1f} KiB live in {} allocations, {} allocations so far", host.liveBytes / 1024.0,
+                         host.liveCount, host.allocationCount);
+        }
+
+        accumulatedCpuFrameTime = {};
+        accumulatedGpuFrameTime = 0.0;
+        timingSampleCount = 0;
+        lastTimingReport = now;
+    }
+
+    void Graphics::CreateRenderFinishedSemaphores() {
+        if (IsHeadless()) return;
+
+        VkSemaphoreCreateInfo binarySemaphoreInfo = {};
+        binarySemaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        // Present waits on a binary semaphore, and the image may come back before the frame slot is reused.
+        renderFinishedSemaphores.resize(swapChainImages.size());
+        for (VkSemaphore& semaphore : renderFinishedSemaphores) {
+            VkResult result = vkCreateSemaphore(logicalDevice, &binarySemaphoreInfo, GetAllocationCallbacks(VK_OBJECT_TYPE_SEMAPHORE), &semaphore);
+            if (result != VK_SUCCESS) {
+                std::exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    bool Graphics::RecreateSwapChain() {
+        VENG_PROFILE_FUNCTION();
+        glm::ivec2 size = window->GetFrameBufferSize();
+        if (size.x == 0 || size.y == 0) {
+            return false;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+
+        RetiredSwapChain retired;
+        retired.swapChain = swapChain;
+        retired.imageViews = std::move(swapChainImageViews);
+        retired.renderFinishedSemaphores = std::move(renderFinishedSemaphores);
+        retired.retireTimelineValue = frameNumber;
+
+        const VkFormat previousFormat = surfaceFormat.format;
+
+        CreateSwapChain();
+        CreateImageViews();
+        CreateRenderFinishedSemaphores();
+
+        if (surfaceFormat.format != previousFormat) {
+            spdlog::warn("Surface format changed while recreating the swap chain");
+        }
+
+        retiredSwapChains.push_back(std::move(retired));
+        swapChainNeedsRecreation = false;
+
+        lastRecreationTime = std::chrono::steady_clock::now() - start;
+        spdlog::info("Swap chain recreated at {}x{} in {:.3f} ms", extent.width, extent.height, lastRecreationTime.count());
+
+        return true;
+    }
+
+    void Graphics::DestroySwapChainResources(RetiredSwapChain& resources) {
+        for (VkSemaphore semaphore : resources.renderFinishedSemaphores) {
+            vkDestroySemaphore(logicalDevice, semaphore, GetAllocationCallbacks(VK_OBJECT_TYPE_SEMAPHORE));
+        }
+
+        for (VkImageView imageView : resources.imageViews) {
+            vkDestroyImageView(logicalDevice, imageView, GetAllocationCallbacks(VK_OBJECT_TYPE_IMAGE_VIEW));
+        }
+
+        if (resources.swapChain != VK_NULL_HANDLE) {
+            vkDestroySwapchainKHR(logicalDevice, resources.swapChain, GetAllocationCallbacks(VK_OBJECT_TYPE_SWAPCHAIN_KHR));
+        }
+    }
+
+    void Graphics::DestroyRetiredSwapChains(std::uint64_t completedTimelineValue) {
+        // The timeline does not cover presentation, so wait for a full round of frames submitted after the retired
+        // swap chain's last present; those are queued behind it and prove its semaphores are no longer in use.
+        while (!retiredSwapChains.empty() &&
+               retiredSwapChains.front().retireTimelineValue + frames.size() <= completedTimelineValue) {
+            DestroySwapChainResources(retiredSwapChains.front());
+            retiredSwapChains.pop_front();
+        }
+    }
+
+    void Graphics::WaitForTimelineValue(std::uint64_t value) {
+        if (value == 0) return;
+
+        VkSemaphoreWaitInfo waitInfo = {};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &frameTimeline;
+        waitInfo.pValues = &value;
+
+        const VkResult result = vkWaitSemaphores(logicalDevice, &waitInfo, std::numeric_limits<std::uint64_t>::max());
+        if (result != VK_SUCCESS) {
+            spdlog::error("Cannot wait for frame timeline value {}", value);
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    bool Graphics::BeginFrame(RecordingMode mode) {
+        {
+            VENG_PROFILE_SCOPE("FrameLimiter");
+            frameLimiter.Wait();
+        }
+
+        VENG_PROFILE_FUNCTION();
+        FrameData& frame = frames[frameNumber % frames.size()];
+
+        const auto frameStart = std::chrono::steady_clock::now();
+        if (lastRecreationTime.count() > 0.0) {
+            const std::chrono::duration<double, std::milli> frameTime = frameStart - lastFrameStart;
+            spdlog::info("Frame containing swap chain recreation took {:.3f} ms", frameTime.count());
+            lastRecreationTime = {};
+        }
+        lastFrameStart = frameStart;
+
+        // Only the frame that last used this slot has to be finished, the others keep the GPU busy.
+        {
+            VENG_PROFILE_SCOPE("WaitForFrameSlot");
+            WaitForTimelineValue(frame.submittedTimelineValue);
+        }
+        cpuFrameStart = std::chrono::steady_clock::now();
+
+        if (IsHeadless()) {
+            currentImageIndex = static_cast<std::uint32_t>(frameNumber % swapChainImages.size());
+        } else {
+            std::uint64_t completedTimelineValue = 0;
+            vkGetSemaphoreCounterValue(logicalDevice, frameTimeline, &completedTimelineValue);
+            DestroyRetiredSwapChains(completedTimelineValue);
+
+            if (window->ConsumeFrameBufferResized()) {
+                swapChainNeedsRecreation = true;
+            }
+
+            if (swapChainNeedsRecreation && !RecreateSwapChain()) {
+                return false;
+            }
+
+            VENG_PROFILE_SCOPE("AcquireNextImage");
+            VkResult acquireResult = vkAcquireNextImageKHR(logicalDevice, swapChain, std::numeric_limits<std::uint64_t>::max(),
+                                                           frame.imageAvailableSemaphore, VK_NULL_HANDLE, &currentImageIndex);
+            if (acquireResult == VK_ERROR_OUT_OF_DATE_KHR) {
+                swapChainNeedsRecreation = true;
+                return false;
+            }
+
+            if (acquireResult == VK_SUBOPTIMAL_KHR) {
+                swapChainNeedsRecreation = true;
+            } else if (acquireResult != VK_SUCCESS) {
+                spdlog::error("Cannot acquire swap chain image (VkResult {})", static_cast<std::int32_t>(acquireResult));
+                std::exit(EXIT_FAILURE);
+            }
+        }
+
+        // Reset only once this frame is sure to be recorded, so an early return leaves the per-frame allocators alone.
+        instanceBuffer->BeginFrame(static_cast<std::uint32_t>(frameNumber % frames.size()));
+        uniformAllocator->BeginFrame(static_cast<std::uint32_t>(frameNumber % frames.size()), frame.submittedTimelineValue);
+        bindlessHeap->BeginFrame(frame.submittedTimelineValue);
+
+        vkResetCommandPool(logicalDevice, frame.commandPool, 0);
+
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        VkResult beginResult = vkBeginCommandBuffer(frame.commandBuffer, &beginInfo);
+        if (beginResult != VK_SUCCESS) {
+            std::exit(EXIT_FAILURE);
+        }
+
+        // Uploads queued since the last frame go out now and are picked up by this frame.
+        uploadService->Flush();
+        frame.uploadWaitValue = uploadService->RecordAcquireBarriers(frame.commandBuffer);
+
+        gpuProfiler->BeginFrame(frame.commandBuffer, static_cast<std::uint32_t>(frameNumber % frames.size()));
+
+        // Culling writes the frame's draw commands, which has to happen before the render pass begins.
+        if (gpuCulling != nullptr && gpuCulling->GetObjectCount() > 0) {
+            VENG_GPU_PROFILE_SCOPE(*gpuProfiler, frame.commandBuffer, "Culling");
+            gpuCulling->Record(frame.commandBuffer, static_cast<std::uint32_t>(frameNumber % frames.size()), cullingFrustum);
+        }
+
+        frameGraph->SetImportedImage(backBuffer, swapChainImages[currentImageIndex], swapChainImageViews[currentImageIndex], extent);
+
+        // Secondary command buffers do not inherit dynamic state, so parallel frames set it in every slice.
+        recordingMode = mode;
+        if (recordingMode == RecordingMode::Parallel) {
+            frameGraph->BeginPass(frame.commandBuffer, scenePass, VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT_KHR);
+        } else {
+            frameGraph->BeginPass(frame.commandBuffer, scenePass);
+            SetViewportAndScissor(frame.commandBuffer);
+            BindFrameResources(frame.commandBuffer);
+        }
+
+        return true;
+    }
+
+    void Graphics::SetViewportAndScissor(VkCommandBuffer commandBuffer) {
+        VkViewport viewport = {};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = static_cast<std::float_t>(extent.width);
+        viewport.height = static_cast<std::float_t>(extent.height);
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+        VkRect2D scissor = {};
+        scissor.offset = {0, 0};
+        scissor.extent = extent;
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    }
+
+    void Graphics::RenderTriangle() {
+        if (recordingMode != RecordingMode::Inline) {
+            spdlog::error("Inline draws need a frame begun with RecordingMode::Inline");
+            return;
+        }
+
+        const std::optional<InstanceRange> instance = AllocateDefaultInstance();
+        if (!instance.has_value()) return;
+
+        VkCommandBuffer commandBuffer = frames[frameNumber % frames.size()].commandBuffer;
+        VENG_GPU_PROFILE_SCOPE(*gpuProfiler, commandBuffer, "Triangle");
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[static_cast<std::size_t>(triangleMesh->GetLayout())]);
+        triangleMesh->Bind(commandBuffer);
+        triangleMesh->Draw(commandBuffer, 1, instance->firstInstance);
+    }
+
+    void Graphics::RenderMesh(const Mesh& mesh) {
+        const std::optional<InstanceRange> instance = AllocateDefaultInstance();
+        if (!instance.has_value()) return;
+
+        RenderMesh(mesh, instance.value());
+    }
+
+    void Graphics::RenderMesh(const Mesh& mesh, const InstanceRange& instances) {
+        if (recordingMode != RecordingMode::Inline) {
+            spdlog::error("Inline draws need a frame begun with RecordingMode::Inline");
+            return;
+        }
+        if (instances.GetCount() == 0) return;
+
+        VkCommandBuffer commandBuffer = frames[frameNumber % frames.size()].commandBuffer;
+        VENG_GPU_PROFILE_SCOPE(*gpuProfiler, commandBuffer, "Mesh");
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[static_cast<std::size_t>(mesh.GetLayout())]);
+        mesh.Bind(commandBuffer);
+        mesh.Draw(commandBuffer, instances.GetCount(), instances.firstInstance);
+    }
+
+    std::optional<InstanceRange> Graphics::AllocateInstances(std::uint32_t count) {
+        return instanceBuffer->Allocate(count);
+    }
+
+    void Graphics::ReserveInstances(std::uint32_t count) {
+        if (count <= instanceBuffer->GetCapacity()) return;
+
+        // Every frame in flight reads the buffer that is about to be replaced.
+        vkDeviceWaitIdle(logicalDevice);
+        instanceBuffer->Reserve(count);
+        spdlog::info("Instance buffer grown to {} instances per frame", count);
+    }
+
+    void Graphics::SetIndirectObjects(gsl::span<const IndirectObject> objects) {
+        if (gpuCulling == nullptr) {
+            spdlog::error("GPU culling is not available on this device or in this build");
+            return;
+        }
+
+        // The object and command buffers are replaced, so no frame may still read them.
+        vkDeviceWaitIdle(logicalDevice);
+        gpuCulling->SetObjects(objects);
+    }
+
+    void Graphics::RenderMeshIndirect(const Mesh& mesh) {
+        if (recordingMode != RecordingMode::Inline) {
+            spdlog::error("Inline draws need a frame begun with RecordingMode::Inline");
+            return;
+        }
+        if (gpuCulling == nullptr) return;
+
+        VkCommandBuffer commandBuffer = frames[frameNumber % frames.size()].commandBuffer;
+        VENG_GPU_PROFILE_SCOPE(*gpuProfiler, commandBuffer, "MeshIndirect");
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[static_cast<std::size_t>(mesh.GetLayout())]);
+        mesh.Bind(commandBuffer);
+        gpuCulling->Draw(commandBuffer, static_cast<std::uint32_t>(frameNumber % frames.size()), pipelineLayout);
+
+        // Later draws in the frame read the per-frame instances again.
+        instanceBuffer->Bind(commandBuffer, pipelineLayout);
+    }
+
+    void Graphics::BindUniforms(VkCommandBuffer commandBuffer, std::uint32_t dynamicOffset) const {
+        uniformAllocator->Bind(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, dynamicOffset);
+    }
+
+    void Graphics::SetTexture(VkCommandBuffer commandBuffer, BindlessHandle texture) const {
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(texture.index), &texture.index);
+    }
+
+    void Graphics::BindFrameResources(VkCommandBuffer commandBuffer) const {
+        instanceBuffer->Bind(commandBuffer, pipelineLayout);
+        bindlessHeap->Bind(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 2);
+        SetTexture(commandBuffer, BindlessHandle{});
+    }
+
+    const VkAllocationCallbacks* Graphics::GetAllocationCallbacks(VkObjectType type) {
+        return HostAllocator::GetCallbacks(hostAllocator.get(), type);
+    }
+
+    std::optional<InstanceRange> Graphics::AllocateDefaultInstance() {
+        // Identity transform in the colour basic.frag used before instances existed.
+        static const InstanceData kDefaultInstance = {
+            {glm::vec4(1.0f, 0.0f, 0.0f, 0.0f), glm::vec4(0.0f, 1.0f, 0.0f, 0.0f), glm::vec4(0.0f, 0.0f, 1.0f, 0.0f)},
+            glm::vec4(1.0f, 0.0f, 0.5f, 1.0f),
+        };
+
+        const std::optional<InstanceRange> instance = instanceBuffer->Allocate(1);
+        if (instance.has_value()) {
+            instance->data[0] = kDefaultInstance;
+        }
+        return instance;
+    }
+
+    void Graphics::RenderTrianglesParallel(std::uint32_t triangleCount, std::uint32_t sliceCount) {
+        const std::optional<InstanceRange> instance = AllocateDefaultInstance();
+        if (!instance.has_value()) return;
+        const std::uint32_t firstInstance = instance->firstInstance;
+
+        RecordParallel(triangleCount, sliceCount, [this, firstInstance](VkCommandBuffer commandBuffer, std::uint32_t, std::uint32_t count) {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[static_cast<std::size_t>(triangleMesh->GetLayout())]);
+            triangleMesh->Bind(commandBuffer);
+            for (std::uint32_t i = 0; i < count; ++i) {
+                triangleMesh->Draw(commandBuffer, 1, firstInstance);
+            }
+        });
+    }
+
+    void Graphics::RecordParallel(std::uint32_t itemCount, std::uint32_t sliceCount, const CommandRecorder::RecordFunction& record) {
+        VENG_PROFILE_FUNCTION();
+        if (recordingMode != RecordingMode::Parallel) {
+            spdlog::error("Parallel recording needs a frame begun with RecordingMode::Parallel");
+            return;
+        }
+
+        const std::uint32_t frameIndex = static_cast<std::uint32_t>(frameNumber % frames.size());
+
+        // Secondaries continue the scene pass's dynamic rendering, which they only know by its formats.
+        VkCommandBufferInheritanceRenderingInfoKHR renderingInheritance = {};
+        renderingInheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO_KHR;
+        renderingInheritance.colorAttachmentCount = 1;
+        renderingInheritance.pColorAttachmentFormats = &surfaceFormat.format;
+        renderingInheritance.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+        VkCommandBufferInheritanceInfo inheritance = {};
+        inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritance.pNext = &renderingInheritance;
+
+        gsl::span<const VkCommandBuffer> secondaries = commandRecorder->Record(frameIndex, inheritance, itemCount, sliceCount,
+            [this, &record](VkCommandBuffer commandBuffer, std::uint32_t first, std::uint32_t count) {
+                SetViewportAndScissor(commandBuffer);
+                BindFrameResources(commandBuffer);
+                record(commandBuffer, first, count);
+            });
+
+        vkCmdExecuteCommands(frames[frameIndex].commandBuffer, static_cast<std::uint32_t>(secondaries.size()), secondaries.data());
+    }
+
+    void Graphics::EndFrame() {
+        VENG_PROFILE_FUNCTION();
+        FrameData& frame = frames[frameNumber % frames.size()];
+
+        frameGraph->EndPass(frame.commandBuffer, scenePass);
+        frameGraph->Finish(frame.commandBuffer);
+        gpuProfiler->EndFrame(frame.commandBuffer, VENG_PROFILE_NOW());
+
+        VkResult endResult = vkEndCommandBuffer(frame.commandBuffer);
+        if (endResult != VK_SUCCESS) {
+            std::exit(EXIT_FAILURE);
+        }
+
+        const std::uint64_t signalValue = frameNumber + 1;
+
+        std::vector<VkSemaphore> waitSemaphores;
+        std::vector<VkPipelineStageFlags> waitStages;
+        std::vector<std::uint64_t> waitValues;
+        std::vector<VkSemaphore> signalSemaphores = {frameTimeline};
+        std::vector<std::uint64_t> signalValues = {signalValue};
+
+        if (!IsHeadless()) {
+            waitSemaphores.push_back(frame.imageAvailableSemaphore);
+            waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+            waitValues.push_back(0);
+
+            signalSemaphores.push_back(renderFinishedSemaphores[currentImageIndex]);
+            signalValues.push_back(0);
+        }
+
+        if (frame.uploadWaitValue != 0) {
+            waitSemaphores.push_back(uploadService->GetTimeline());
+            waitStages.push_back(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+            waitValues.push_back(frame.uploadWaitValue);
+        }
+
+        VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.waitSemaphoreValueCount = waitValues.size();
+        timelineInfo.pWaitSemaphoreValues = waitValues.data();
+        timelineInfo.signalSemaphoreValueCount = signalValues.size();
+        timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.waitSemaphoreCount = waitSemaphores.size();
+        submitInfo.pWaitSemaphores = waitSemaphores.data();
+        submitInfo.pWaitDstStageMask = waitStages.data();
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &frame.commandBuffer;
+        submitInfo.signalSemaphoreCount = signalSemaphores.size();
+        submitInfo.pSignalSemaphores = signalSemaphores.data();
+
+        VkResult submitResult = VK_SUCCESS;
+        {
+            VENG_PROFILE_SCOPE("Submit");
+            submitResult = vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+        }
+        if (submitResult != VK_SUCCESS) {
+            spdlog::error("Failed to submit draw commands");
+            std::exit(EXIT_FAILURE);
+        }
+
+        frame.submittedTimelineValue = signalValue;
+        uniformAllocator->EndFrame(signalValue);
+        bindlessHeap->EndFrame(signalValue);
+        frameNumber = signalValue;
+
+        ReportFrameTimings();
+
+        if (IsHeadless()) return;
+
+        VkPresentInfoKHR presentInfo = {};
+        presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+        presentInfo.waitSemaphoreCount = 1;
+        presentInfo.pWaitSemaphores = &renderFinishedSemaphores[currentImageIndex];
+        presentInfo.swapchainCount = 1;
+        presentInfo.pSwapchains = &swapChain;
+        presentInfo.pImageIndices = &currentImageIndex;
+
+        VkResult presentResult = VK_SUCCESS;
+        {
+            VENG_PROFILE_SCOPE("Present");
+            presentResult = vkQueuePresentKHR(presentQueue, &presentInfo);
+        }
+        if (presentResult == VK_ERROR_OUT_OF_DATE_KHR || presentResult == VK_SUBOPTIMAL_KHR) {
+            swapChainNeedsRecreation = true;
+        } else if (presentResult != VK_SUCCESS) {
+            spdlog::error("Cannot present swap chain image (VkResult {})", static_cast<std::int32_t>(presentResult));
+            std::exit(EXIT_FAILURE);
+        }
+
+        // Measured up to the present call returning; with FIFO this includes any blocking on the presentation queue.
+        const auto presentTime = std::chrono::steady_clock::now();
+        if (inputSampleTime.time_since_epoch().count() != 0) {
+            accumulatedInputToPresent += presentTime - inputSampleTime;
+            ++latencySampleCount;
+        }
+
+        if (presentTime - lastPresentReport >= std::chrono::seconds(1) && latencySampleCount > 0) {
+            presentStats.averageInputToPresent = accumulatedInputToPresent / latencySampleCount;
+            spdlog::info("{} with {} images: input-to-present {:.3f} ms", GetPresentModeName(presentStats.presentMode),
+                         presentStats.imageCount, presentStats.averageInputToPresent.count());
+            accumulatedInputToPresent = {};
+            latencySampleCount = 0;
+            lastPresentReport = presentTime;
+        }
+    }
+
+#pragma endregion
+
+    Graphics::Graphics(gsl::not_null<Window *> window, std::uint32_t framesInFlight) : window (window){
+    #if !defined(NDEBUG)
+        validationEnabled = true;
+    #endif
+        requiredDeviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+        frames.resize(std::max(framesInFlight, 1u));
+
+        InitaliseVulkan();
+    }
+
+    Graphics::Graphics(glm::ivec2 offscreenSize, std::uint32_t framesInFlight) {
     #if !defined(NDEBUG)
         validationEnabled = true;
     #endif
+        frames.resize(std::max(framesInFlight, 1u));
+        extent = {static_cast<std::uint32_t>(offscreenSize.x), static_cast<std::uint32_t>(offscreenSize.y)};
 
         InitaliseVulkan();
     }
 
     Graphics::~Graphics() {
         if (logicalDevice != VK_NULL_HANDLE) {
+            vkDeviceWaitIdle(logicalDevice);
+
+            for (FrameData& frame : frames) {
+                if (frame.imageAvailableSemaphore != VK_NULL_HANDLE) {
+                    vkDestroySemaphore(logicalDevice, frame.imageAvailableSemaphore, GetAllocationCallbacks(VK_OBJECT_TYPE_SEMAPHORE));
+                }
+                if (frame.commandPool != VK_NULL_HANDLE) {
+                    vkDestroyCommandPool(logicalDevice, frame.commandPool, GetAllocationCallbacks(VK_OBJECT_TYPE_COMMAND_POOL));
+                }
+            }
+
+            for (VkSemaphore semaphore : renderFinishedSemaphores) {
+                vkDestroySemaphore(logicalDevice, semaphore, GetAllocationCallbacks(VK_OBJECT_TYPE_SEMAPHORE));
+            }
+
+            for (RetiredSwapChain& retired : retiredSwapChains) {
+                DestroySwapChainResources(retired);
+            }
+
+            gpuProfiler.reset();
+            commandRecorder.reset();
+
+            if (frameTimeline != VK_NULL_HANDLE) {
+                vkDestroySemaphore(logicalDevice, frameTimeline, GetAllocationCallbacks(VK_OBJECT_TYPE_SEMAPHORE));
+            }
+
+            triangleMesh.reset();
+            gpuCulling.reset();
+            instanceBuffer.reset();
+            uniformAllocator.reset();
+            bindlessHeap.reset();
+
+            for (VkPipeline pipeline : pipelines) {
+                if (pipeline != VK_NULL_HANDLE) {
+                    vkDestroyPipeline(logicalDevice, pipeline, GetAllocationCallbacks(VK_OBJECT_TYPE_PIPELINE));
+                }
+            }
+
+            shaderRegistry.reset();
+
+            if (pipelineCache != nullptr) {
+                pipelineCache->Save();
+                pipelineCache.reset();
+            }
+
+            if (pipelineLayout != VK_NULL_HANDLE) {
+                vkDestroyPipelineLayout(logicalDevice, pipelineLayout, GetAllocationCallbacks(VK_OBJECT_TYPE_PIPELINE_LAYOUT));
+            }
+
+            frameGraph.reset();
 
             for (VkImageView imageView : swapChainImageViews) {
-                vkDestroyImageView(logicalDevice, imageView, nullptr);
+                vkDestroyImageView(logicalDevice, imageView, GetAllocationCallbacks(VK_OBJECT_TYPE_IMAGE_VIEW));
             }
 
             if (swapChain != VK_NULL_HANDLE) {
-                vkDestroySwapchainKHR(logicalDevice, swapChain, nullptr);
+                vkDestroySwapchainKHR(logicalDevice, swapChain, GetAllocationCallbacks(VK_OBJECT_TYPE_SWAPCHAIN_KHR));
+            }
+
+            if (IsHeadless()) {
+                for (VkImage image : swapChainImages) {
+                    vkDestroyImage(logicalDevice, image, GetAllocationCallbacks(VK_OBJECT_TYPE_IMAGE));
+                }
+
+                for (Allocation& allocation : offscreenImageMemory) {
+                    memoryAllocator->Free(allocation);
+                }
             }
-            vkDestroyDevice(logicalDevice, nullptr);
+
+            uploadService.reset();
+            memoryAllocator.reset();
+            vkDestroyDevice(logicalDevice, GetAllocationCallbacks(VK_OBJECT_TYPE_DEVICE));
         }
 
         if (vkInstance != VK_NULL_HANDLE) {
             if (surface != VK_NULL_HANDLE) {
-                vkDestroySurfaceKHR(vkInstance, surface, nullptr);
+                vkDestroySurfaceKHR(vkInstance, surface, GetAllocationCallbacks(VK_OBJECT_TYPE_SURFACE_KHR));
             }
 
             if (debugMessenger != VK_NULL_HANDLE) {
-                vkDestroyDebugUtilsMessengerEXT(vkInstance, debugMessenger, nullptr);
+                vkDestroyDebugUtilsMessengerEXT(vkInstance, debugMessenger, GetAllocationCallbacks(VK_OBJECT_TYPE_DEBUG_UTILS_MESSENGER_EXT));
             }
-            vkDestroyInstance(vkInstance, nullptr);
+            vkDestroyInstance(vkInstance, GetAllocationCallbacks(VK_OBJECT_TYPE_INSTANCE));
         }
+
+        validationSink.reset();
     }
 
     void Graphics::InitaliseVulkan() {
+        VENG_PROFILE_FUNCTION();
+        // VENG_TRACK_HOST_ALLOCATIONS routes the driver's host allocations through HostAllocator to account for them.
+        if (std::getenv("VENG_TRACK_HOST_ALLOCATIONS") != nullptr) {
+            hostAllocator = std::make_unique<HostAllocator>();
+        }
         CreateInstance();
         SetupDebugMessenger();
-        CreateSurface();
+        if (!IsHeadless()) {
+            CreateSurface();
+        }
         PickPhysicalDevice();
         CreateLogicalDeviceAndQueues();
-        CreateSwapChain();
+        if (IsHeadless()) {
+            CreateOffscreenImages();
+        } else {
+            CreateSwapChain();
+        }
+        CreateImageViews();
+        CreatePipelineCache();
+        shaderRegistry = std::make_unique<ShaderRegistry>(logicalDevice);
+        CreateInstanceBuffer();
+        CreateUniformAllocator();
+        CreateBindlessHeap();
+        CreateGraphicsPipeline();
+        CreateGpuCulling();
+        CreateTriangleMesh();
+        CreateFrameGraph();
+        CreateFrameResources();
     }
 }
\ No newline at end of file
@@ -2,20 +2,108 @@
 
 #include <vulkan/vulkan.h>
 #include <glfw_window.h>
+#include <frame_limiter.h>
+#include <memory_allocator.h>
+#include <upload_service.h>
+#include <pipeline_cache.h>
+#include <shader_registry.h>
+#include <gpu_profiler.h>
+#include <validation_sink.h>
+#include <command_recorder.h>
+#include <mesh.h>
+#include <instance_buffer.h>
+#include <uniform_allocator.h>
+#include <bindless_heap.h>
+#include <host_allocator.h>
+#include <gpu_culling.h>
+#include <render_graph.h>
+#include <device_functions.h>
 
 namespace veng {
 
+    enum class PresentPolicy {
+        LowLatency,
+        PowerSaving,
+        Throughput,
+    };
+
+    // Parallel frames execute secondary command buffers only, so inline draws are not allowed in them.
+    enum class RecordingMode {
+        Inline,
+        Parallel,
+    };
+
+    struct PresentStats {
+        VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+        std::uint32_t imageCount = 0;
+        std::chrono::duration<double, std::milli> averageInputToPresent{0.0};
+    };
+
     class Graphics final{
     public:
-        Graphics(gsl::not_null<Window*> window);
+        static constexpr std::uint32_t kDefaultFramesInFlight = 2;
+
+        Graphics(gsl::not_null<Window*> window, std::uint32_t framesInFlight = kDefaultFramesInFlight);
+        explicit Graphics(glm::ivec2 offscreenSize, std::uint32_t framesInFlight = kDefaultFramesInFlight);
         ~Graphics();
+
+        bool BeginFrame(RecordingMode mode = RecordingMode::Inline);
+        void RenderTriangle();
+        void RenderTrianglesParallel(std::uint32_t triangleCount, std::uint32_t sliceCount);
+        void RecordParallel(std::uint32_t itemCount, std::uint32_t sliceCount, const CommandRecorder::RecordFunction& record);
+        void RenderMesh(const Mesh& mesh);
+        void RenderMesh(const Mesh& mesh, const InstanceRange& instances);
+        // Empty when the frame's instance region is full, in which case the draw must be skipped.
+        std::optional<InstanceRange> AllocateInstances(std::uint32_t count);
+        // Grows the per-frame instance regions to count instances. Waits for the GPU, so call it outside a frame.
+        void ReserveInstances(std::uint32_t count);
+        // Per-frame constants: push them into the uniform allocator and bind the returned offset as set 1.
+        void BindUniforms(VkCommandBuffer commandBuffer, std::uint32_t dynamicOffset) const;
+        // Texture basic.frag samples for the following draws; an invalid handle draws untextured.
+        void SetTexture(VkCommandBuffer commandBuffer, BindlessHandle texture) const;
+
+        // GPU-driven drawing: objects are uploaded once, culled against the frustum at the start of every frame and
+        // drawn with one indirect call. Every object indexes into the mesh passed to RenderMeshIndirect.
+        void SetIndirectObjects(gsl::span<const IndirectObject> objects);
+        void SetCullingFrustum(const Frustum& frustum) { cullingFrustum = frustum; }
+        void RenderMeshIndirect(const Mesh& mesh);
+        bool IsGpuCullingSupported() const { return gpuCulling != nullptr; }
+
+        std::unique_ptr<Mesh> CreateMesh(gsl::span<const Vertex> vertices, gsl::span<const std::uint32_t> indices,
+                                         VertexLayout layout = VertexLayout::Compact);
+        std::unique_ptr<Mesh> CreateMesh(const MeshView& view);
+        // A graph on this device for passes outside the frame's own, e.g. offscreen work recorded by the caller.
+        std::unique_ptr<RenderGraph> CreateRenderGraph();
+        void WaitIdle();
+        void EndFrame();
+
+        void SetPresentPolicy(PresentPolicy policy, std::uint32_t frameRateLimit = 60);
+        void MarkInputSampled();
+        const PresentStats& GetPresentStats() const { return presentStats; }
+        MemoryAllocator& GetMemoryAllocator() { return *memoryAllocator; }
+        UploadService& GetUploadService() { return *uploadService; }
+        GpuProfiler& GetGpuProfiler() { return *gpuProfiler; }
+        const InstanceBuffer& GetInstanceBuffer() const { return *instanceBuffer; }
+        UniformAllocator& GetUniformAllocator() { return *uniformAllocator; }
+        BindlessHeap& GetBindlessHeap() { return *bindlessHeap; }
+        ValidationSink* GetValidationSink() { return validationSink.get(); }
+        // Only set when VENG_TRACK_HOST_ALLOCATIONS is.
+        const HostAllocator* GetHostAllocator() const { return hostAllocator.get(); }
+        std::uint32_t GetRecordingSliceCount() const { return commandRecorder->GetSliceCount(); }
+        VkCommandBuffer GetCurrentCommandBuffer() const { return frames[frameNumber % frames.size()].commandBuffer; }
+
+        bool IsHeadless() const { return window == nullptr; }
+        std::uint32_t GetFramesInFlight() const { return static_cast<std::uint32_t>(frames.size()); }
     private:
 
         struct QueueFamilyIndices {
             std::optional<std::uint32_t> graphicsFamily = std::nullopt;
             std::optional<std::uint32_t> presentationFamily = std::nullopt;
+            std::optional<std::uint32_t> transferFamily = std::nullopt;
+            std::optional<std::uint32_t> computeFamily = std::nullopt;
 
             bool IsValid() const { return graphicsFamily.has_value() && presentationFamily.has_value();}
+            bool IsValidHeadless() const { return graphicsFamily.has_value();}
         };
 
         struct SwapChainProperties {
@@ -26,6 +114,42 @@ namespace veng {
             bool IsValid() const { return !formats.empty() && !presentModes.empty();}
         };
 
+        // Everything about a physical device that does not change while it is in use, queried once.
+        struct DeviceCapabilities {
+            VkPhysicalDevice device = VK_NULL_HANDLE;
+            VkPhysicalDeviceProperties properties = {};
+            VkPhysicalDeviceFeatures features = {};
+            VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+            // The 1.3 features the engine relies on, from the core struct or from the extensions on 1.2 devices.
+            VkPhysicalDeviceVulkan13Features vulkan13Features = {};
+            VkPhysicalDeviceVulkan12Properties vulkan12Properties = {};
+            // The lower of the device's and the instance's version.
+            std::uint32_t apiVersion = VK_API_VERSION_1_0;
+            VkPhysicalDeviceMemoryProperties memoryProperties = {};
+            std::vector<VkQueueFamilyProperties> queueFamilies;
+            std::vector<VkExtensionProperties> extensions;
+            QueueFamilyIndices queueFamilyIndices;
+
+            bool HasExtension(gsl::czstring name) const;
+            bool HasCoreVulkan13() const { return apiVersion >= VK_API_VERSION_1_3; }
+            VkDeviceSize GetDeviceLocalMemory() const;
+        };
+
+        struct FrameData {
+            VkCommandPool commandPool = VK_NULL_HANDLE;
+            VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+            VkSemaphore imageAvailableSemaphore = VK_NULL_HANDLE;
+            std::uint64_t submittedTimelineValue = 0;
+            std::uint64_t uploadWaitValue = 0;
+        };
+
+        struct RetiredSwapChain {
+            VkSwapchainKHR swapChain = VK_NULL_HANDLE;
+            std::vector<VkImageView> imageViews;
+            std::vector<VkSemaphore> renderFinishedSemaphores;
+            std::uint64_t retireTimelineValue = 0;
+        };
+
         void InitaliseVulkan();
         void CreateInstance();
         void SetupDebugMessenger();
@@ -40,15 +164,43 @@ namespace veng {
         static std::vector<VkLayerProperties> GetSupportedValidationLayers();
         static bool AreAllLayersSupported(gsl::span<gsl::czstring> layers);
 
-        QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device);
+        QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device, gsl::span<const VkQueueFamilyProperties> families);
         SwapChainProperties GetSwapChainProperties(VkPhysicalDevice device);
-        bool IsDeviceSuitable(VkPhysicalDevice device);
+        DeviceCapabilities QueryDeviceCapabilities(VkPhysicalDevice device);
+        // The first requirement the device does not meet, or nothing when it is suitable.
+        std::optional<std::string_view> FindUnmetRequirement(const DeviceCapabilities& capabilities);
+        static bool MeetsRequiredLimits(const DeviceCapabilities& capabilities);
+        static std::optional<std::string_view> FindMissingBindlessFeature(const DeviceCapabilities& capabilities);
+        static std::uint64_t ScoreDevice(const DeviceCapabilities& capabilities);
         std::vector<VkPhysicalDevice> GetAvailableDevices();
 
         void CreateSurface();
         void CreateSwapChain();
         void CreateImageViews();
-        bool AreAllDeviceExtensionsSupported(VkPhysicalDevice device);
+        void CreateOffscreenImages();
+        bool AreAllDeviceExtensionsSupported(const DeviceCapabilities& capabilities);
+
+        void CreatePipelineCache();
+        void CreateInstanceBuffer();
+        void CreateUniformAllocator();
+        void CreateBindlessHeap();
+        // Sets every command buffer of the scene pass binds before its first draw.
+        void BindFrameResources(VkCommandBuffer commandBuffer) const;
+        void CreateGraphicsPipeline();
+        void CreateGpuCulling();
+        void CreateTriangleMesh();
+        void CreateFrameGraph();
+        void CreateFrameResources();
+        void CreateRenderFinishedSemaphores();
+        bool RecreateSwapChain();
+        void DestroyRetiredSwapChains(std::uint64_t completedTimelineValue);
+        void DestroySwapChainResources(RetiredSwapChain& resources);
+        void WaitForTimelineValue(std::uint64_t value);
+        void ReportFrameTimings();
+        void SetViewportAndScissor(VkCommandBuffer commandBuffer);
+        std::optional<InstanceRange> AllocateDefaultInstance();
+        // nullptr, the driver's own allocator, unless host allocations are tracked.
+        const VkAllocationCallbacks* GetAllocationCallbacks(VkObjectType type);
 
         VkSurfaceFormatKHR ChooseSwapSurfaceFormat(gsl::span<VkSurfaceFormatKHR> formats);
         VkPresentModeKHR ChooseSwapPresentMode(gsl::span<VkPresentModeKHR> presentModes);
@@ -56,17 +208,23 @@ namespace veng {
         std::uint32_t ChooseSwapImageCount(const VkSurfaceCapabilitiesKHR& capabilities);
 
 
-        std::array<gsl::czstring, 1> requiredDeviceExtensions = {
-            VK_KHR_SWAPCHAIN_EXTENSION_NAME
-        };
+        std::vector<gsl::czstring> requiredDeviceExtensions;
 
+        // Declared first so it outlives every object allocated through it.
+        std::unique_ptr<HostAllocator> hostAllocator;
         VkInstance vkInstance = VK_NULL_HANDLE;
+        std::uint32_t instanceApiVersion = VK_API_VERSION_1_2;
         VkDebugUtilsMessengerEXT debugMessenger{};
 
         VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+        std::unique_ptr<const DeviceCapabilities> deviceCapabilities;
         VkDevice logicalDevice = VK_NULL_HANDLE;
+        DeviceFunctions deviceFunctions;
         VkQueue graphicsQueue = VK_NULL_HANDLE;
         VkQueue presentQueue = VK_NULL_HANDLE;
+        VkQueue transferQueue = VK_NULL_HANDLE;
+        std::unique_ptr<MemoryAllocator> memoryAllocator;
+        std::unique_ptr<UploadService> uploadService;
 
         VkSurfaceKHR surface  = VK_NULL_HANDLE;
         VkSwapchainKHR swapChain = VK_NULL_HANDLE;
@@ -75,11 +233,61 @@ namespace veng {
         VkExtent2D extent;
         std::vector<VkImage> swapChainImages;
         std::vector<VkImageView> swapChainImageViews;
+        std::vector<Allocation> offscreenImageMemory;
+
+        // Every frame is a render graph that draws into the acquired image with dynamic rendering, so nothing
+        // is created per swap chain image.
+        std::unique_ptr<RenderGraph> frameGraph;
+        RenderGraphImage backBuffer;
+        RenderGraphPass scenePass;
+
+        VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+        std::array<VkPipeline, kVertexLayoutCount> pipelines = {};
+        std::unique_ptr<Mesh> triangleMesh;
+        std::unique_ptr<InstanceBuffer> instanceBuffer;
+        std::unique_ptr<UniformAllocator> uniformAllocator;
+        std::unique_ptr<BindlessHeap> bindlessHeap;
+        std::unique_ptr<GpuCulling> gpuCulling;
+        Frustum cullingFrustum = ExtractFrustum(glm::mat4(1.0f));
+        std::unique_ptr<PipelineCache> pipelineCache;
+        std::unique_ptr<ShaderRegistry> shaderRegistry;
+        bool pipelineCreationFeedbackSupported = false;
+        bool multiDrawIndirectSupported = false;
+        bool drawIndirectCountSupported = false;
+
+        std::vector<FrameData> frames;
+        std::vector<VkSemaphore> renderFinishedSemaphores;
+        VkSemaphore frameTimeline = VK_NULL_HANDLE;
+        std::uint64_t frameNumber = 0;
+        std::uint32_t currentImageIndex = 0;
+
+        std::unique_ptr<GpuProfiler> gpuProfiler;
+        std::unique_ptr<CommandRecorder> commandRecorder;
+        RecordingMode recordingMode = RecordingMode::Inline;
+        std::chrono::steady_clock::time_point cpuFrameStart;
+        std::chrono::duration<double, std::milli> accumulatedCpuFrameTime{0.0};
+        double accumulatedGpuFrameTime = 0.0;
+        std::uint32_t timingSampleCount = 0;
+        std::chrono::steady_clock::time_point lastTimingReport;
+
+        std::deque<RetiredSwapChain> retiredSwapChains;
+        bool swapChainNeedsRecreation = false;
+        std::chrono::steady_clock::time_point lastFrameStart;
+        std::chrono::duration<double, std::milli> lastRecreationTime{0.0};
+
+        PresentPolicy presentPolicy = PresentPolicy::LowLatency;
+        FrameLimiter frameLimiter;
+        PresentStats presentStats;
+        std::chrono::steady_clock::time_point inputSampleTime;
+        std::chrono::duration<double, std::milli> accumulatedInputToPresent{0.0};
+        std::uint32_t latencySampleCount = 0;
+        std::chrono::steady_clock::time_point lastPresentReport;
 
         gsl::span<gsl::czstring> m_suggestedExtensions;
         std::vector<gsl::czstring> m_extensions;
-        gsl::not_null<Window*> window;
+        Window* window = nullptr;
         bool validationEnabled = false;
+        std::unique_ptr<ValidationSink> validationSink;
 
         std::vector<VkExtensionProperties> GetDeviceAvailableExtensions(VkPhysicalDevice device);
 
@@ -0,0 +1,311 @@
+#include <precomp.h>
+#include <host_allocator.h>
+#include <spdlog/spdlog.h>
+
+namespace veng {
+
+    // Precedes every block handed to the driver. Arena blocks are linked through it, pooled blocks remember their
+    // size class.
+    struct HostAllocator::Header {
+        void* base = nullptr;
+        std::size_t size = 0;
+        Header* previous = nullptr;
+        Header* next = nullptr;
+        std::uint32_t sizeClass = 0;
+        std::uint32_t scope = 0;
+    };
+
+    static constexpr std::uint32_t kUnpooled = std::numeric_limits<std::uint32_t>::max();
+    static constexpr std::size_t kSmallestSizeClass = 64;
+    static constexpr std::uint32_t kSizeClassCount = 8;
+    // Blocks a thread keeps per size class before returning them to the system.
+    static constexpr std::size_t kMaxCachedBlocks = 256;
+
+    // Command-scope blocks recycled by the thread that freed them. Blocks are plain heap memory, so a block freed on
+    // another thread than the one that allocated it simply moves caches.
+    struct ThreadBlockCache {
+        std::array<std::vector<void*>, kSizeClassCount> blocks;
+
+        ~ThreadBlockCache() {
+            for (std::vector<void*>& sizeClass : blocks) {
+                for (void* block : sizeClass) {
+                    std::free(block);
+                }
+            }
+        }
+    };
+
+    static thread_local ThreadBlockCache threadBlockCache;
+
+    static std::size_t GetSizeClassBytes(std::uint32_t sizeClass) {
+        return kSmallestSizeClass << sizeClass;
+    }
+
+    static std::uint32_t GetSizeClass(std::size_t blockSize) {
+        for (std::uint32_t sizeClass = 0; sizeClass < kSizeClassCount; ++sizeClass) {
+            if (blockSize <= GetSizeClassBytes(sizeClass)) return sizeClass;
+        }
+        return kUnpooled;
+    }
+
+    static gsl::czstring GetScopeName(std::size_t scope) {
+        switch (scope) {
+            case VK_SYSTEM_ALLOCATION_SCOPE_COMMAND: return "command";
+            case VK_SYSTEM_ALLOCATION_SCOPE_OBJECT: return "object";
+            case VK_SYSTEM_ALLOCATION_SCOPE_CACHE: return "cache";
+            case VK_SYSTEM_ALLOCATION_SCOPE_DEVICE: return "device";
+            case VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE: return "instance";
+            default: return "unknown";
+        }
+    }
+
+    static std::string GetObjectTypeName(VkObjectType type) {
+        switch (type) {
+            case VK_OBJECT_TYPE_INSTANCE: return "instance";
+            case VK_OBJECT_TYPE_DEVICE: return "device";
+            case VK_OBJECT_TYPE_COMMAND_POOL: return "command pool";
+            case VK_OBJECT_TYPE_SEMAPHORE: return "semaphore";
+            case VK_OBJECT_TYPE_IMAGE: return "image";
+            case VK_OBJECT_TYPE_IMAGE_VIEW: return "image view";
+            case VK_OBJECT_TYPE_PIPELINE: return "pipeline";
+            case VK_OBJECT_TYPE_PIPELINE_LAYOUT: return "pipeline layout";
+            case VK_OBJECT_TYPE_SURFACE_KHR: return "surface";
+            case VK_OBJECT_TYPE_SWAPCHAIN_KHR: return "swap chain";
+            case VK_OBJECT_TYPE_DEBUG_UTILS_MESSENGER_EXT: return "debug messenger";
+            default: return fmt::format("type {}", static_cast<std::uint32_t>(type));
+        }
+    }
+
+    void HostAllocator::Counters::Add(std::size_t size) {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        liveCount.fetch_add(1, std::memory_order_relaxed);
+        const std::uint64_t live = liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+
+        std::uint64_t peak = peakBytes.load(std::memory_order_relaxed);
+        while (live > peak && !peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+        }
+    }
+
+    void HostAllocator::Counters::Remove(std::size_t size) {
+        liveCount.fetch_sub(1, std::memory_order_relaxed);
+        liveBytes.fetch_sub(size, std::memory_order_relaxed);
+    }
+
+    HostAllocationCounters HostAllocator::Counters::Snapshot() const {
+        HostAllocationCounters snapshot;
+        snapshot.allocationCount = allocationCount.load(std::memory_order_relaxed);
+        snapshot.liveCount = liveCount.load(std::memory_order_relaxed);
+        snapshot.liveBytes = liveBytes.load(std::memory_order_relaxed);
+        snapshot.peakBytes = peakBytes.load(std::memory_order_relaxed);
+        snapshot.internalBytes = internalBytes.load(std::memory_order_relaxed);
+        return snapshot;
+    }
+
+    HostAllocator::HostAllocator() = default;
+
+    HostAllocator::~HostAllocator() {
+        LogStats();
+
+        // Whatever the arenas still hold was never freed by the driver, which is gone by now.
+        for (std::size_t scope = 0; scope < kScopeCount; ++scope) {
+            std::uint64_t leakedCount = 0;
+            std::uint64_t leakedBytes = 0;
+            for (Header* header = arenas[scope].head; header != nullptr;) {
+                Header* next = header->next;
+                ++leakedCount;
+                leakedBytes += header->size;
+                std::free(header->base);
+                header = next;
+            }
+            if (leakedCount > 0) {
+                spdlog::warn("{} host allocations ({:.1f} KiB) of {} scope were never freed", leakedCount, leakedBytes / 1024.0,
+                             GetScopeName(scope));
+            }
+        }
+    }
+
+    const VkAllocationCallbacks* HostAllocator::GetCallbacks(VkObjectType type) {
+        std::lock_guard lock(tagMutex);
+        std::unique_ptr<TypeTag>& tag = tags[type];
+        if (tag == nullptr) {
+            tag = std::make_unique<TypeTag>();
+            tag->owner = this;
+            tag->type = type;
+            tag->callbacks.pUserData = tag.get();
+            tag->callbacks.pfnAllocation = &HostAllocator::Allocate;
+            tag->callbacks.pfnReallocation = &HostAllocator::Reallocate;
+            tag->callbacks.pfnFree = &HostAllocator::Free;
+            tag->callbacks.pfnInternalAllocation = &HostAllocator::InternalAllocation;
+            tag->callbacks.pfnInternalFree = &HostAllocator::InternalFree;
+        }
+        return &tag->callbacks;
+    }
+
+    void* HostAllocator::AllocateBlock(TypeTag& tag, std::size_t size, std::size_t alignment, VkSystemAllocationScope scope) {
+        if (size == 0) return nullptr;
+
+        alignment = std::max(alignment, alignof(Header));
+        const std::size_t blockSize = sizeof(Header) + alignment - 1 + size;
+
+        void* base = nullptr;
+        std::uint32_t sizeClass = kUnpooled;
+        if (scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND) {
+            pooledAllocations.fetch_add(1, std::memory_order_relaxed);
+            sizeClass = GetSizeClass(blockSize);
+            if (sizeClass != kUnpooled) {
+                std::vector<void*>& cached = threadBlockCache.blocks[sizeClass];
+                if (!cached.empty()) {
+                    base = cached.back();
+                    cached.pop_back();
+                    poolHits.fetch_add(1, std::memory_order_relaxed);
+                } else {
+                    base = std::malloc(GetSizeClassBytes(sizeClass));
+                }
+            } else {
+                base = std::malloc(blockSize);
+            }
+        } else {
+            base = std::malloc(blockSize);
+        }
+        if (base == nullptr) return nullptr;
+
+        const std::uintptr_t user = (reinterpret_cast<std::uintptr_t>(base) + sizeof(Header) + alignment - 1) / alignment * alignment;
+        Header* header = new (reinterpret_cast<void*>(user - sizeof(Header))) Header();
+        header->base = base;
+        header->size = size;
+        header->sizeClass = sizeClass;
+        header->scope = static_cast<std::uint32_t>(scope);
+
+        if (scope != VK_SYSTEM_ALLOCATION_SCOPE_COMMAND) {
+            Arena& arena = arenas[scope];
+            std::lock_guard lock(arena.mutex);
+            header->next = arena.head;
+            if (arena.head != nullptr) {
+                arena.head->previous = header;
+            }
+            arena.head = header;
+        }
+
+        scopeCounters[scope].Add(size);
+        tag.counters.Add(size);
+        return reinterpret_cast<void*>(user);
+    }
+
+    void HostAllocator::FreeBlock(TypeTag& tag, void* memory) {
+        if (memory == nullptr) return;
+
+        Header* header = reinterpret_cast<Header*>(static_cast<std::uint8_t*>(memory) - sizeof(Header));
+        scopeCounters[header->scope].Remove(header->size);
+        tag.counters.Remove(header->size);
+
+        if (header->scope != VK_SYSTEM_ALLOCATION_SCOPE_COMMAND) {
+            Arena& arena = arenas[header->scope];
+            std::lock_guard lock(arena.mutex);
+            if (header->previous != nullptr) {
+                header->previous->next = header->next;
+            } else {
+                arena.head = header->next;
+            }
+            if (header->next != nullptr) {
+                header->next->previous = header->previous;
+            }
+        }
+
+        if (header->sizeClass != kUnpooled && threadBlockCache.blocks[header->sizeClass].size() < kMaxCachedBlocks) {
+            threadBlockCache.blocks[header->sizeClass].push_back(header->base);
+        } else {
+            std::free(header->base);
+        }
+    }
+
+    void* HostAllocator::Allocate(void* userData, std::size_t size, std::size_t alignment, VkSystemAllocationScope scope) {
+        TypeTag& tag = *static_cast<TypeTag*>(userData);
+        return tag.owner->AllocateBlock(tag, size, alignment, scope);
+    }
+
+    void* HostAllocator::Reallocate(void* userData, void* original, std::size_t size, std::size_t alignment,
+                                    VkSystemAllocationScope scope) {
+        TypeTag& tag = *static_cast<TypeTag*>(userData);
+        if (original == nullptr) {
+            return tag.owner->AllocateBlock(tag, size, alignment, scope);
+        }
+        if (size == 0) {
+            tag.owner->FreeBlock(tag, original);
+            return nullptr;
+        }
+
+        // On failure the original must stay valid, so it is only freed once the copy exists.
+        void* memory = tag.owner->AllocateBlock(tag, size, alignment, scope);
+        if (memory == nullptr) return nullptr;
+
+        const Header* header = reinterpret_cast<const Header*>(static_cast<std::uint8_t*>(original) - sizeof(Header));
+        std::memcpy(memory, original, std::min(size, header->size));
+        tag.owner->FreeBlock(tag, original);
+        return memory;
+    }
+
+    void HostAllocator::Free(void* userData, void* memory) {
+        TypeTag& tag = *static_cast<TypeTag*>(userData);
+        tag.owner->FreeBlock(tag, memory);
+    }
+
+    void HostAllocator::InternalAllocation(void* userData, std::size_t size, VkInternalAllocationType, VkSystemAllocationScope scope) {
+        TypeTag& tag = *static_cast<TypeTag*>(userData);
+        tag.owner->scopeCounters[scope].internalBytes.fetch_add(size, std::memory_order_relaxed);
+        tag.counters.internalBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    void HostAllocator::InternalFree(void* userData, std::size_t size, VkInternalAllocationType, VkSystemAllocationScope scope) {
+        TypeTag& tag = *static_cast<TypeTag*>(userData);
+        tag.owner->scopeCounters[scope].internalBytes.fetch_sub(size, std::memory_order_relaxed);
+        tag.counters.internalBytes.fetch_sub(size, std::memory_order_relaxed);
+    }
+
+    HostAllocationCounters HostAllocator::GetScopeCounters(VkSystemAllocationScope scope) const {
+        return scopeCounters[scope].Snapshot();
+    }
+
+    HostAllocationCounters HostAllocator::GetTypeCounters(VkObjectType type) const {
+        std::lock_guard lock(tagMutex);
+        const auto tag = tags.find(type);
+        return tag != tags.end() ? tag->second->counters.Snapshot() : HostAllocationCounters{};
+    }
+
+    HostAllocationCounters HostAllocator::GetTotalCounters() const {
+        HostAllocationCounters total;
+        for (const Counters& counters : scopeCounters) {
+            const HostAllocationCounters snapshot = counters.Snapshot();
+            total.allocationCount += snapshot.allocationCount;
+            total.liveCount += snapshot.liveCount;
+            total.liveBytes += snapshot.liveBytes;
+            // Scopes peak at different times, so this is an upper bound.
+            total.peakBytes += snapshot.peakBytes;
+            total.internalBytes += snapshot.internalBytes;
+        }
+        return total;
+    }
+
+    void HostAllocator::LogStats() const {
+        const auto logRow = [](std::string_view name, const HostAllocationCounters& counters) {
+            spdlog::info("{:>16} {:>12} {:>8} {:>10.1f} {:>10.1f} {:>13.1f}", name, counters.allocationCount, counters.liveCount,
+                         counters.liveBytes / 1024.0, counters.peakBytes / 1024.0, counters.internalBytes / 1024.0);
+        };
+
+        spdlog::info("{:>16} {:>12} {:>8} {:>10} {:>10} {:>13}", "host memory", "allocations", "live", "live KiB", "peak KiB",
+                     "internal KiB");
+        for (std::size_t scope = 0; scope < kScopeCount; ++scope) {
+            logRow(GetScopeName(scope), scopeCounters[scope].Snapshot());
+        }
+
+        std::lock_guard lock(tagMutex);
+        for (const auto& [type, tag] : tags) {
+            logRow(GetObjectTypeName(type), tag->counters.Snapshot());
+        }
+
+        const std::uint64_t pooled = pooledAllocations.load(std::memory_order_relaxed);
+        if (pooled > 0) {
+            spdlog::info("{} of {} command-scope allocations reused a thread-local block", poolHits.load(std::memory_order_relaxed),
+                         pooled);
+        }
+    }
+}
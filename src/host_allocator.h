@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vulkan/vulkan.h>
+
+namespace veng {
+
+    struct HostAllocationCounters {
+        std::uint64_t allocationCount = 0;
+        std::uint64_t liveCount = 0;
+        std::uint64_t liveBytes = 0;
+        std::uint64_t peakBytes = 0;
+        // Memory the driver allocated itself and only reported, e.g. executable code.
+        std::uint64_t internalBytes = 0;
+    };
+
+    // VkAllocationCallbacks that account for every host allocation the driver makes. Command-scope allocations, the
+    // ones made while recording, come from thread-local pools of fixed size classes so hot recording paths avoid the
+    // system allocator. Longer-lived scopes go to arenas that track each live block, so leaks and bloat can be
+    // reported per scope and, through the callbacks handed out per object type, per kind of object.
+    class HostAllocator final {
+    public:
+        HostAllocator();
+        ~HostAllocator();
+
+        HostAllocator(const HostAllocator&) = delete;
+        HostAllocator& operator=(const HostAllocator&) = delete;
+
+        // Callbacks that attribute allocations to type. Objects must be destroyed with the callbacks they were
+        // created with; the pointer stays valid for the allocator's lifetime.
+        const VkAllocationCallbacks* GetCallbacks(VkObjectType type);
+
+        // Callbacks of allocator for type, or nullptr (the driver's own allocator) when host allocations are not tracked.
+        static const VkAllocationCallbacks* GetCallbacks(HostAllocator* allocator, VkObjectType type) {
+            return allocator != nullptr ? allocator->GetCallbacks(type) : nullptr;
+        }
+
+        HostAllocationCounters GetScopeCounters(VkSystemAllocationScope scope) const;
+        HostAllocationCounters GetTypeCounters(VkObjectType type) const;
+        HostAllocationCounters GetTotalCounters() const;
+        void LogStats() const;
+
+    private:
+        static constexpr std::size_t kScopeCount = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+
+        struct Counters {
+            std::atomic<std::uint64_t> allocationCount = 0;
+            std::atomic<std::uint64_t> liveCount = 0;
+            std::atomic<std::uint64_t> liveBytes = 0;
+            std::atomic<std::uint64_t> peakBytes = 0;
+            std::atomic<std::uint64_t> internalBytes = 0;
+
+            void Add(std::size_t size);
+            void Remove(std::size_t size);
+            HostAllocationCounters Snapshot() const;
+        };
+
+        struct TypeTag {
+            HostAllocator* owner = nullptr;
+            VkObjectType type = VK_OBJECT_TYPE_UNKNOWN;
+            Counters counters;
+            VkAllocationCallbacks callbacks = {};
+        };
+
+        struct Header;
+
+        // Live blocks of one long-lived scope, linked through their headers.
+        struct Arena {
+            mutable std::mutex mutex;
+            Header* head = nullptr;
+        };
+
+        static VKAPI_ATTR void* VKAPI_CALL Allocate(void* userData, std::size_t size, std::size_t alignment,
+                                                   VkSystemAllocationScope scope);
+        static VKAPI_ATTR void* VKAPI_CALL Reallocate(void* userData, void* original, std::size_t size, std::size_t alignment,
+                                                     VkSystemAllocationScope scope);
+        static VKAPI_ATTR void VKAPI_CALL Free(void* userData, void* memory);
+        static VKAPI_ATTR void VKAPI_CALL InternalAllocation(void* userData, std::size_t size, VkInternalAllocationType type,
+                                                            VkSystemAllocationScope scope);
+        static VKAPI_ATTR void VKAPI_CALL InternalFree(void* userData, std::size_t size, VkInternalAllocationType type,
+                                                      VkSystemAllocationScope scope);
+
+        void* AllocateBlock(TypeTag& tag, std::size_t size, std::size_t alignment, VkSystemAllocationScope scope);
+        void FreeBlock(TypeTag& tag, void* memory);
+
+        std::array<Counters, kScopeCount> scopeCounters;
+        std::array<Arena, kScopeCount> arenas;
+        std::atomic<std::uint64_t> pooledAllocations = 0;
+        std::atomic<std::uint64_t> poolHits = 0;
+
+        mutable std::mutex tagMutex;
+        std::map<VkObjectType, std::unique_ptr<TypeTag>> tags;
+    };
+}
@@ -0,0 +1,150 @@
+#include <precomp.h>
+#include <instance_buffer.h>
+#include <spdlog/spdlog.h>
+
+namespace veng {
+
+    InstanceBuffer::InstanceBuffer(VkDevice logicalDevice, MemoryAllocator& allocator, VkDeviceSize minOffsetAlignment,
+                                   std::uint32_t framesInFlight, std::uint32_t capacity)
+            : logicalDevice(logicalDevice), allocator(allocator), minOffsetAlignment(std::max<VkDeviceSize>(minOffsetAlignment, 1)),
+              framesInFlight(framesInFlight), capacity(capacity) {
+        CreateBuffer();
+        CreateDescriptorSet();
+    }
+
+    InstanceBuffer::~InstanceBuffer() {
+        vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+        vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
+        DestroyBuffer();
+    }
+
+    void InstanceBuffer::CreateBuffer() {
+        regionSize = (static_cast<VkDeviceSize>(capacity) * sizeof(InstanceData) + minOffsetAlignment - 1) / minOffsetAlignment *
+                     minOffsetAlignment;
+
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = regionSize * framesInFlight;
+        bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        VkResult result = vkCreateBuffer(logicalDevice, &bufferInfo, nullptr, &buffer);
+        if (result != VK_SUCCESS) {
+            std::exit(EXIT_FAILURE);
+        }
+
+        // Coherent memory spares a flush per frame. The vertex shader reads each instance once, so it does not pay
+        // to copy the data into device-local memory first.
+        memory = allocator.AllocateForBuffer(buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        if (!memory.IsValid() || memory.mappedData == nullptr) {
+            spdlog::error("Cannot allocate {} bytes for the instance buffer", bufferInfo.size);
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    void InstanceBuffer::DestroyBuffer() {
+        vkDestroyBuffer(logicalDevice, buffer, nullptr);
+        allocator.Free(memory);
+        buffer = VK_NULL_HANDLE;
+    }
+
+    void InstanceBuffer::Reserve(std::uint32_t capacity) {
+        if (capacity <= this->capacity) return;
+
+        DestroyBuffer();
+        this->capacity = capacity;
+        CreateBuffer();
+        WriteDescriptorSet();
+        usedCount = 0;
+    }
+
+    void InstanceBuffer::CreateDescriptorSet() {
+        VkDescriptorSetLayoutBinding binding = {};
+        binding.binding = 0;
+        binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+        binding.descriptorCount = 1;
+        binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = 1;
+        layoutInfo.pBindings = &binding;
+
+        VkResult result = vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, nullptr, &descriptorSetLayout);
+        if (result != VK_SUCCESS) {
+            std::exit(EXIT_FAILURE);
+        }
+
+        VkDescriptorPoolSize poolSize = {};
+        poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+        poolSize.descriptorCount = 1;
+
+        VkDescriptorPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.maxSets = 1;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+
+        result = vkCreateDescriptorPool(logicalDevice, &poolInfo, nullptr, &descriptorPool);
+        if (result != VK_SUCCESS) {
+            std::exit(EXIT_FAILURE);
+        }
+
+        VkDescriptorSetAllocateInfo allocateInfo = {};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocateInfo.descriptorPool = descriptorPool;
+        allocateInfo.descriptorSetCount = 1;
+        allocateInfo.pSetLayouts = &descriptorSetLayout;
+
+        result = vkAllocateDescriptorSets(logicalDevice, &allocateInfo, &descriptorSet);
+        if (result != VK_SUCCESS) {
+            std::exit(EXIT_FAILURE);
+        }
+
+        WriteDescriptorSet();
+    }
+
+    void InstanceBuffer::WriteDescriptorSet() {
+        // The descriptor covers a single region, the dynamic offset at bind time picks which one.
+        VkDescriptorBufferInfo bufferInfo = {};
+        bufferInfo.buffer = buffer;
+        bufferInfo.offset = 0;
+        bufferInfo.range = regionSize;
+
+        VkWriteDescriptorSet write = {};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = descriptorSet;
+        write.dstBinding = 0;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+        write.pBufferInfo = &bufferInfo;
+
+        vkUpdateDescriptorSets(logicalDevice, 1, &write, 0, nullptr);
+    }
+
+    void InstanceBuffer::BeginFrame(std::uint32_t frameIndex) {
+        this->frameIndex = frameIndex;
+        usedCount = 0;
+    }
+
+    std::optional<InstanceRange> InstanceBuffer::Allocate(std::uint32_t count) {
+        if (count > capacity - usedCount) {
+            spdlog::error("Instance buffer full: {} instances requested, {} of {} left this frame", count,
+                          capacity - usedCount, capacity);
+            return std::nullopt;
+        }
+
+        auto* region = reinterpret_cast<InstanceData*>(static_cast<std::uint8_t*>(memory.mappedData) + regionSize * frameIndex);
+
+        InstanceRange range;
+        range.firstInstance = usedCount;
+        range.data = gsl::span<InstanceData>(region + usedCount, count);
+        usedCount += count;
+        return range;
+    }
+
+    void InstanceBuffer::Bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) const {
+        const auto dynamicOffset = static_cast<std::uint32_t>(regionSize * frameIndex);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 1, &dynamicOffset);
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <memory_allocator.h>
+
+namespace veng {
+
+    // One instance as basic.vert reads it (std430): the rows of a 3x4 affine transform and an RGBA colour.
+    struct InstanceData {
+        std::array<glm::vec4, 3> transform;
+        glm::vec4 color;
+    };
+
+    static_assert(sizeof(InstanceData) == 64, "InstanceData must match the std430 layout in basic.vert");
+
+    // Instances written for the current frame. firstInstance is what the draw passes on, so gl_InstanceIndex
+    // lands on the first element of data.
+    struct InstanceRange {
+        std::uint32_t firstInstance = 0;
+        gsl::span<InstanceData> data;
+
+        std::uint32_t GetCount() const { return static_cast<std::uint32_t>(data.size()); }
+    };
+
+    // Persistently mapped storage buffer with one region of instances per frame in flight. The CPU fills the
+    // current frame's region front to back while the GPU reads the others, and a dynamic offset selects the region.
+    class InstanceBuffer final {
+    public:
+        // 256 KiB per frame in flight. Scenes that need more reserve it up front.
+        static constexpr std::uint32_t kDefaultCapacity = 4096;
+
+        InstanceBuffer(VkDevice logicalDevice, MemoryAllocator& allocator, VkDeviceSize minOffsetAlignment,
+                       std::uint32_t framesInFlight, std::uint32_t capacity = kDefaultCapacity);
+        ~InstanceBuffer();
+
+        InstanceBuffer(const InstanceBuffer&) = delete;
+        InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+        // The frame's previous submission must have completed, its region is overwritten from the start.
+        void BeginFrame(std::uint32_t frameIndex);
+        std::optional<InstanceRange> Allocate(std::uint32_t count);
+        // Grows every region to hold at least capacity instances. The buffer is replaced, so the GPU must be idle and
+        // ranges allocated before the call must not be used after it. The descriptor set layout stays the same.
+        void Reserve(std::uint32_t capacity);
+        void Bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout) const;
+
+        VkDescriptorSetLayout GetDescriptorSetLayout() const { return descriptorSetLayout; }
+        VkBuffer GetBuffer() const { return buffer; }
+        std::uint32_t GetCapacity() const { return capacity; }
+        std::uint32_t GetUsedCount() const { return usedCount; }
+
+    private:
+        void CreateBuffer();
+        void DestroyBuffer();
+        void CreateDescriptorSet();
+        void WriteDescriptorSet();
+
+        VkDevice logicalDevice = VK_NULL_HANDLE;
+        MemoryAllocator& allocator;
+        VkDeviceSize minOffsetAlignment = 1;
+        std::uint32_t framesInFlight = 0;
+        std::uint32_t capacity = 0;
+        VkDeviceSize regionSize = 0;
+
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation memory;
+
+        VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+        VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+
+        std::uint32_t frameIndex = 0;
+        std::uint32_t usedCount = 0;
+    };
+}
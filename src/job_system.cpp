@@ -0,0 +1,271 @@
+#include <precomp.h>
+#include <job_system.h>
+#include <profiler.h>
+#include <spdlog/spdlog.h>
+
+namespace veng {
+
+    namespace {
+        thread_local const JobSystem* tlsOwner = nullptr;
+        thread_local std::uint32_t tlsThreadIndex = 0;
+        thread_local std::uint32_t tlsStealSeed = 0;
+    }
+
+    // Chase-Lev deque with a fixed capacity. The owner pushes and pops at the bottom, thieves take from the top and
+    // only contend with the owner for the last element.
+    class JobSystem::WorkStealingDeque final {
+    public:
+        static constexpr std::int64_t kCapacity = 4096;
+
+        bool Push(Job* job) {
+            const std::int64_t bottomIndex = bottom.load(std::memory_order_relaxed);
+            const std::int64_t topIndex = top.load(std::memory_order_acquire);
+            if (bottomIndex - topIndex >= kCapacity) return false;
+
+            buffer[bottomIndex & (kCapacity - 1)].store(job, std::memory_order_relaxed);
+            bottom.store(bottomIndex + 1, std::memory_order_release);
+            return true;
+        }
+
+        Job* Pop() {
+            const std::int64_t bottomIndex = bottom.load(std::memory_order_relaxed) - 1;
+            bottom.store(bottomIndex, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            std::int64_t topIndex = top.load(std::memory_order_relaxed);
+
+            if (topIndex > bottomIndex) {
+                bottom.store(bottomIndex + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            Job* job = buffer[bottomIndex & (kCapacity - 1)].load(std::memory_order_relaxed);
+            if (topIndex == bottomIndex) {
+                if (!top.compare_exchange_strong(topIndex, topIndex + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                    job = nullptr;
+                }
+                bottom.store(bottomIndex + 1, std::memory_order_relaxed);
+            }
+            return job;
+        }
+
+        Job* Steal() {
+            std::int64_t topIndex = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const std::int64_t bottomIndex = bottom.load(std::memory_order_acquire);
+            if (topIndex >= bottomIndex) return nullptr;
+
+            Job* job = buffer[topIndex & (kCapacity - 1)].load(std::memory_order_relaxed);
+            if (!top.compare_exchange_strong(topIndex, topIndex + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return nullptr;
+            }
+            return job;
+        }
+
+    private:
+        alignas(64) std::atomic<std::int64_t> top = 0;
+        alignas(64) std::atomic<std::int64_t> bottom = 0;
+        std::array<std::atomic<Job*>, kCapacity> buffer{};
+    };
+
+    JobSystem& JobSystem::Get() {
+        static JobSystem jobSystem(std::max(std::thread::hardware_concurrency(), 1u));
+        return jobSystem;
+    }
+
+    JobSystem::JobSystem(std::uint32_t threadCount) : mainThreadId(std::this_thread::get_id()) {
+        threadCount = std::max(threadCount, 1u);
+        for (std::uint32_t i = 0; i < threadCount; ++i) {
+            deques.push_back(std::make_unique<WorkStealingDeque>());
+        }
+
+        tlsOwner = this;
+        tlsThreadIndex = 0;
+
+        for (std::uint32_t threadIndex = 1; threadIndex < threadCount; ++threadIndex) {
+            workers.emplace_back([this, threadIndex] { WorkerLoop(threadIndex); });
+        }
+    }
+
+    JobSystem::~JobSystem() {
+        stopping.store(true, std::memory_order_release);
+        wakeSignal.fetch_add(1, std::memory_order_release);
+        wakeSignal.notify_all();
+        for (std::thread& worker : workers) {
+            // std::exit from inside a job runs this destructor on that worker, which cannot join itself.
+            if (worker.get_id() == std::this_thread::get_id()) {
+                worker.detach();
+            } else {
+                worker.join();
+            }
+        }
+
+        if (tlsOwner == this) tlsOwner = nullptr;
+
+        for (Job* job : injectionQueue) delete job;
+        for (const auto& [dependency, job] : parkedJobs) delete job;
+        for (Job* job : mainThreadQueue) delete job;
+    }
+
+    bool JobSystem::IsMainThread() const {
+        return std::this_thread::get_id() == mainThreadId;
+    }
+
+    void JobSystem::Spawn(JobFunction function, JobCounter* counter, const JobCounter* dependency) {
+        if (counter != nullptr) {
+            counter->pending.fetch_add(1, std::memory_order_relaxed);
+        }
+        Push(new Job{std::move(function), counter, dependency});
+    }
+
+    void JobSystem::SpawnOnMainThread(JobFunction function, JobCounter* counter) {
+        if (counter != nullptr) {
+            counter->pending.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        std::lock_guard lock(mainThreadMutex);
+        mainThreadQueue.push_back(new Job{std::move(function), counter, nullptr});
+    }
+
+    void JobSystem::Push(Job* job) {
+        const bool pushed = tlsOwner == this && deques[tlsThreadIndex]->Push(job);
+        if (!pushed) {
+            std::lock_guard lock(injectionMutex);
+            injectionQueue.push_back(job);
+            injectionCount.fetch_add(1, std::memory_order_release);
+        }
+
+        wakeSignal.fetch_add(1, std::memory_order_release);
+        wakeSignal.notify_one();
+    }
+
+    JobSystem::Job* JobSystem::FindJob() {
+        const bool ownsDeque = tlsOwner == this;
+        if (ownsDeque) {
+            if (Job* job = deques[tlsThreadIndex]->Pop()) return job;
+        }
+
+        if (injectionCount.load(std::memory_order_acquire) > 0) {
+            std::lock_guard lock(injectionMutex);
+            if (!injectionQueue.empty()) {
+                Job* job = injectionQueue.front();
+                injectionQueue.pop_front();
+                injectionCount.fetch_sub(1, std::memory_order_relaxed);
+                return job;
+            }
+        }
+
+        // Start at a different victim every time so thieves do not all hammer the same deque.
+        const std::uint32_t dequeCount = GetThreadCount();
+        const std::uint32_t start = tlsStealSeed++;
+        for (std::uint32_t i = 0; i < dequeCount; ++i) {
+            const std::uint32_t victim = (start + i) % dequeCount;
+            if (ownsDeque && victim == tlsThreadIndex) continue;
+            if (Job* job = deques[victim]->Steal()) return job;
+        }
+        return nullptr;
+    }
+
+    void JobSystem::Execute(Job* job) {
+        if (job->dependency != nullptr && !job->dependency->IsDone()) {
+            // Checking again under the lock closes the race with the dependency's last job: it decrements the counter
+            // before taking the lock to release parked jobs, so either it sees this job or this sees the counter done.
+            std::lock_guard lock(parkedMutex);
+            if (!job->dependency->IsDone()) {
+                parkedJobs.emplace(job->dependency, job);
+                return;
+            }
+        }
+
+        job->function();
+
+        // The counter may be destroyed as soon as it reaches zero, so only its address is used after the decrement.
+        JobCounter* counter = job->counter;
+        delete job;
+        if (counter != nullptr && counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            ReleaseParkedJobs(counter);
+        }
+    }
+
+    void JobSystem::ReleaseParkedJobs(const JobCounter* counter) {
+        std::vector<Job*> released;
+        {
+            std::lock_guard lock(parkedMutex);
+            const auto [first, last] = parkedJobs.equal_range(counter);
+            for (auto it = first; it != last; ++it) {
+                released.push_back(it->second);
+            }
+            parkedJobs.erase(first, last);
+        }
+
+        for (Job* job : released) {
+            Push(job);
+        }
+    }
+
+    void JobSystem::Wait(const JobCounter& counter) {
+        while (!counter.IsDone()) {
+            if (IsMainThread()) {
+                PumpMainThread();
+            }
+
+            if (Job* job = FindJob()) {
+                Execute(job);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void JobSystem::ParallelFor(std::uint32_t count, std::uint32_t grainSize, const RangeFunction& function) {
+        if (count == 0) return;
+        grainSize = std::max(grainSize, 1u);
+
+        JobCounter counter;
+        for (std::uint32_t first = grainSize; first < count; first += grainSize) {
+            const std::uint32_t last = std::min(first + grainSize, count);
+            Spawn([&function, first, last] { function(first, last); }, &counter);
+        }
+
+        // The caller takes the first range itself rather than sitting idle.
+        function(0, std::min(grainSize, count));
+        Wait(counter);
+    }
+
+    void JobSystem::PumpMainThread() {
+        if (!IsMainThread()) return;
+
+        std::vector<Job*> jobs;
+        {
+            std::lock_guard lock(mainThreadMutex);
+            jobs.swap(mainThreadQueue);
+        }
+
+        for (Job* job : jobs) {
+            Execute(job);
+        }
+    }
+
+    void JobSystem::WorkerLoop(std::uint32_t threadIndex) {
+        tlsOwner = this;
+        tlsThreadIndex = threadIndex;
+        tlsStealSeed = threadIndex;
+        VENG_PROFILE_THREAD_NAME("Worker " + std::to_string(threadIndex));
+
+        constexpr std::uint32_t kSpinsBeforeSleep = 64;
+        std::uint32_t idleSpins = 0;
+
+        while (!stopping.load(std::memory_order_acquire)) {
+            const std::uint32_t observedSignal = wakeSignal.load(std::memory_order_acquire);
+            if (Job* job = FindJob()) {
+                Execute(job);
+                idleSpins = 0;
+            } else if (++idleSpins < kSpinsBeforeSleep) {
+                std::this_thread::yield();
+            } else {
+                // Anything pushed after observedSignal was read changes the value, so no wake-up can be missed.
+                wakeSignal.wait(observedSignal, std::memory_order_acquire);
+                idleSpins = 0;
+            }
+        }
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+namespace veng {
+
+    // Counts the jobs spawned against it that have not finished yet.
+    class JobCounter final {
+    public:
+        bool IsDone() const { return pending.load(std::memory_order_acquire) == 0; }
+
+    private:
+        friend class JobSystem;
+        std::atomic<std::uint32_t> pending = 0;
+    };
+
+    // Runs jobs on one thread per core: the thread that first calls Get() takes part as the main thread and every
+    // other core gets a worker. Each thread pushes to and pops from its own work-stealing deque and steals from the
+    // others when it runs dry. Jobs that touch GLFW must be spawned with SpawnOnMainThread.
+    class JobSystem final {
+    public:
+        using JobFunction = std::function<void()>;
+        using RangeFunction = std::function<void(std::uint32_t first, std::uint32_t last)>;
+
+        static JobSystem& Get();
+
+        explicit JobSystem(std::uint32_t threadCount);
+        ~JobSystem();
+
+        JobSystem(const JobSystem&) = delete;
+        JobSystem& operator=(const JobSystem&) = delete;
+
+        // A job with a dependency is held back, without taking up a queue, until that counter reaches zero.
+        void Spawn(JobFunction function, JobCounter* counter = nullptr, const JobCounter* dependency = nullptr);
+        void SpawnOnMainThread(JobFunction function, JobCounter* counter = nullptr);
+
+        // Runs other jobs while waiting, so waiting from inside a job cannot deadlock.
+        void Wait(const JobCounter& counter);
+        void ParallelFor(std::uint32_t count, std::uint32_t grainSize, const RangeFunction& function);
+        void PumpMainThread();
+
+        std::uint32_t GetThreadCount() const { return static_cast<std::uint32_t>(deques.size()); }
+        bool IsMainThread() const;
+
+    private:
+        struct Job {
+            JobFunction function;
+            JobCounter* counter = nullptr;
+            const JobCounter* dependency = nullptr;
+        };
+
+        class WorkStealingDeque;
+
+        void Push(Job* job);
+        Job* FindJob();
+        void Execute(Job* job);
+        void ReleaseParkedJobs(const JobCounter* counter);
+        void WorkerLoop(std::uint32_t threadIndex);
+
+        std::vector<std::unique_ptr<WorkStealingDeque>> deques;
+
+        // Threads that are not part of the system cannot own a deque, so their jobs go through a shared queue.
+        std::mutex injectionMutex;
+        std::deque<Job*> injectionQueue;
+        std::atomic<std::uint32_t> injectionCount = 0;
+
+        // Jobs whose dependency was not done when they came up, keyed by that dependency. They are pushed again once
+        // it completes, so they never occupy a queue while waiting. The key is only compared, never dereferenced.
+        std::mutex parkedMutex;
+        std::unordered_multimap<const JobCounter*, Job*> parkedJobs;
+
+        std::mutex mainThreadMutex;
+        std::vector<Job*> mainThreadQueue;
+        std::thread::id mainThreadId;
+
+        std::atomic<std::uint32_t> wakeSignal = 0;
+        std::atomic<bool> stopping = false;
+        std::vector<std::thread> workers;
+    };
+}
@@ -3,10 +3,56 @@
 #include <glfw_window.h>
 #include <precomp.h>
 #include <graphics.h>
+#include <benchmarks.h>
+#include <job_system.h>
+#include <mesh_file.h>
+#include <obj_loader.h>
+#include <profiler.h>
+#include <spdlog/spdlog.h>
 
 
-int32_t main(int32_t argc, gsl::zstring* argv) {
+std::optional<veng::PresentPolicy> ParsePresentPolicy(gsl::czstring argument) {
+    if (veng::streq(argument, "--present=low-latency")) return veng::PresentPolicy::LowLatency;
+    if (veng::streq(argument, "--present=power-saving")) return veng::PresentPolicy::PowerSaving;
+    if (veng::streq(argument, "--present=throughput")) return veng::PresentPolicy::Throughput;
+    return std::nullopt;
+}
+
+bool ConvertMesh(const std::filesystem::path& input, const std::filesystem::path& output, veng::VertexLayout layout) {
+    std::vector<veng::Vertex> vertices;
+    std::vector<std::uint32_t> indices;
+    if (!veng::LoadObj(input, vertices, indices)) {
+        return false;
+    }
+
+    const veng::EncodedMesh encoded = veng::EncodeMesh(vertices, indices, layout);
+    if (!veng::MeshFile::Write(output, encoded.View())) {
+        return false;
+    }
+
+    spdlog::info("Converted {} to {}: {} vertices, {} indices, {} bytes", input.string(), output.string(), encoded.vertexCount,
+                 encoded.indexCount, std::filesystem::file_size(output));
+    return true;
+}
+
+void RunHeadless() {
+    veng::Graphics graphics(glm::ivec2(800, 600));
+
+    constexpr std::uint32_t kHeadlessFrameCount = 1000;
+    const auto start = std::chrono::steady_clock::now();
+    for (std::uint32_t i = 0; i < kHeadlessFrameCount; ++i) {
+        VENG_PROFILE_SCOPE("Frame");
+        if (graphics.BeginFrame()) {
+            graphics.RenderTriangle();
+            graphics.EndFrame();
+        }
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    spdlog::info("Rendered {} headless frames at {:.1f} fps", kHeadlessFrameCount, kHeadlessFrameCount / elapsed.count());
+    graphics.GetMemoryAllocator().LogStats();
+}
 
+void RunWindowed(std::optional<veng::PresentPolicy> presentPolicy) {
     const veng::GlfwInitialisation glfw;
 
     veng::Window window("Vulkan Engine", {800, 600});
@@ -14,9 +60,73 @@ int32_t main(int32_t argc, gsl::zstring* argv) {
     window.TryMoveToMonitor(1);
 
     veng::Graphics graphics(&window);
+    if (presentPolicy.has_value()) {
+        graphics.SetPresentPolicy(presentPolicy.value());
+    }
+
+    while (!window.ShouldClose()) {
+        VENG_PROFILE_SCOPE("Frame");
+        {
+            VENG_PROFILE_SCOPE("PollEvents");
+            glfwPollEvents();
+        }
+        veng::JobSystem::Get().PumpMainThread();
+        graphics.MarkInputSampled();
+        if (graphics.BeginFrame()) {
+            graphics.RenderTriangle();
+            graphics.EndFrame();
+        } else if (window.IsMinimised()) {
+            // The swap chain cannot be recreated until the window is restored, so sleep until something happens.
+            VENG_PROFILE_SCOPE("WaitWhileMinimised");
+            glfwWaitEvents();
+        }
+    }
+}
+
+int32_t main(int32_t argc, gsl::zstring* argv) {
+
+    bool headless = false;
+    std::optional<std::string_view> benchmark;
+    std::optional<std::pair<gsl::czstring, gsl::czstring>> meshConversion;
+    veng::VertexLayout meshLayout = veng::VertexLayout::Compact;
+    std::optional<veng::PresentPolicy> presentPolicy;
+    for (std::int32_t i = 1; i < argc; ++i) {
+        gsl::czstring argument = argv[i];
+        if (veng::streq(argument, "--headless")) {
+            headless = true;
+        } else if (veng::streq(argument, "--convert-mesh") && i + 2 < argc) {
+            meshConversion = std::make_pair(argv[i + 1], argv[i + 2]);
+            i += 2;
+        } else if (veng::streq(argument, "--layout=float32")) {
+            meshLayout = veng::VertexLayout::Float32;
+        } else if (std::string_view(argument).starts_with("--benchmark=")) {
+            benchmark = std::string_view(argument).substr(std::string_view("--benchmark=").size());
+        } else if (std::optional<veng::PresentPolicy> policy = ParsePresentPolicy(argument)) {
+            presentPolicy = policy;
+        }
+    }
+
+    VENG_PROFILE_THREAD_NAME("Main");
+
+    // The thread that creates the job system is the one it treats as the main thread.
+    veng::JobSystem::Get();
+
+    if (meshConversion.has_value()) {
+        return ConvertMesh(meshConversion->first, meshConversion->second, meshLayout) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (benchmark.has_value()) {
+        if (!veng::RunBenchmark(benchmark.value())) return EXIT_FAILURE;
+    } else if (headless) {
+        RunHeadless();
+    } else {
+        RunWindowed(presentPolicy);
+    }
 
-    while (!window.ShouldClose())
-        glfwPollEvents();
+#if VENG_PROFILER_ENABLED
+    veng::Profiler::Get().WriteChromeTrace("trace.json");
+    veng::Profiler::Get().LogSummary();
+#endif
 
     return EXIT_SUCCESS;
 }
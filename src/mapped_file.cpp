@@ -0,0 +1,94 @@
+#include <precomp.h>
+#include <mapped_file.h>
+#include <spdlog/spdlog.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace veng {
+
+#if defined(_WIN32)
+    std::unique_ptr<MappedFile> MappedFile::Open(const std::filesystem::path& filePath) {
+        HANDLE file = CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            spdlog::error("Cannot open {}", filePath.string());
+            return nullptr;
+        }
+
+        LARGE_INTEGER fileSize = {};
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            CloseHandle(file);
+            return nullptr;
+        }
+
+        HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr) {
+            CloseHandle(file);
+            return nullptr;
+        }
+
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (view == nullptr) {
+            CloseHandle(mapping);
+            CloseHandle(file);
+            return nullptr;
+        }
+
+        std::unique_ptr<MappedFile> mappedFile(new MappedFile());
+        mappedFile->data = view;
+        mappedFile->size = static_cast<std::size_t>(fileSize.QuadPart);
+        mappedFile->fileHandle = file;
+        mappedFile->mappingHandle = mapping;
+        return mappedFile;
+    }
+
+    MappedFile::~MappedFile() {
+        UnmapViewOfFile(data);
+        CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+    }
+#else
+    std::unique_ptr<MappedFile> MappedFile::Open(const std::filesystem::path& filePath) {
+        const int file = open(filePath.c_str(), O_RDONLY);
+        if (file < 0) {
+            spdlog::error("Cannot open {}", filePath.string());
+            return nullptr;
+        }
+
+        struct stat fileStatus = {};
+        if (fstat(file, &fileStatus) != 0 || fileStatus.st_size == 0) {
+            close(file);
+            return nullptr;
+        }
+
+        const auto size = static_cast<std::size_t>(fileStatus.st_size);
+        void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+        // The mapping keeps the file referenced, so the descriptor is not needed any more.
+        close(file);
+        if (view == MAP_FAILED) {
+            return nullptr;
+        }
+
+        // Meshes are read front to back exactly once on their way into staging memory.
+        posix_madvise(view, size, POSIX_MADV_SEQUENTIAL);
+
+        std::unique_ptr<MappedFile> mappedFile(new MappedFile());
+        mappedFile->data = view;
+        mappedFile->size = size;
+        return mappedFile;
+    }
+
+    MappedFile::~MappedFile() {
+        munmap(data, size);
+    }
+#endif
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+namespace veng {
+
+    // Read-only memory mapping of a whole file. Pages are faulted in by the OS as they are touched.
+    class MappedFile final {
+    public:
+        static std::unique_ptr<MappedFile> Open(const std::filesystem::path& filePath);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        gsl::span<const std::uint8_t> GetData() const { return {static_cast<const std::uint8_t*>(data), size}; }
+
+    private:
+        MappedFile() = default;
+
+        void* data = nullptr;
+        std::size_t size = 0;
+#if defined(_WIN32)
+        void* fileHandle = nullptr;
+        void* mappingHandle = nullptr;
+#endif
+    };
+}
@@ -0,0 +1,359 @@
+#include <precomp.h>
+#include <memory_allocator.h>
+#include <spdlog/spdlog.h>
+#include <bit>
+
+namespace veng {
+
+    MemoryAllocator::MemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, bool memoryBudgetSupported,
+                                     const VkAllocationCallbacks* allocationCallbacks)
+            : physicalDevice(physicalDevice), logicalDevice(logicalDevice), memoryBudgetSupported(memoryBudgetSupported),
+              allocationCallbacks(allocationCallbacks) {
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+        VkPhysicalDeviceProperties deviceProperties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+        maxAllocationCount = deviceProperties.limits.maxMemoryAllocationCount;
+
+        constexpr VkDeviceSize kMinAllocationSize = 256;
+        const VkDeviceSize minAllocationSize = std::bit_ceil(std::max(kMinAllocationSize, deviceProperties.limits.bufferImageGranularity));
+        minOrder = std::countr_zero(minAllocationSize);
+        maxOrder = std::countr_zero(kDefaultBlockSize);
+
+        memoryTypes.resize(memoryProperties.memoryTypeCount);
+        heapUsage.resize(memoryProperties.memoryHeapCount, 0);
+    }
+
+    MemoryAllocator::~MemoryAllocator() {
+        for (std::uint32_t typeIndex = 0; typeIndex < memoryTypes.size(); ++typeIndex) {
+            if (memoryTypes[typeIndex].dedicatedCount > 0) {
+                spdlog::warn("{} dedicated allocations leaked in memory type {}", memoryTypes[typeIndex].dedicatedCount, typeIndex);
+            }
+
+            for (Block& block : memoryTypes[typeIndex].blocks) {
+                if (block.allocatedBytes > 0) {
+                    spdlog::warn("{} bytes still allocated in a block of memory type {}", block.allocatedBytes, typeIndex);
+                }
+                FreeDeviceMemory(block.memory, kDefaultBlockSize, typeIndex);
+            }
+        }
+    }
+
+    std::uint32_t MemoryAllocator::FindMemoryType(std::uint32_t typeBits, VkMemoryPropertyFlags properties) const {
+        for (std::uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i) {
+            const bool isAllowed = typeBits & (1u << i);
+            const bool hasProperties = (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties;
+            if (isAllowed && hasProperties) {
+                return i;
+            }
+        }
+
+        spdlog::error("No memory type matches the requested properties");
+        std::exit(EXIT_FAILURE);
+    }
+
+    std::uint32_t MemoryAllocator::GetHeapIndex(std::uint32_t memoryTypeIndex) const {
+        return memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+    }
+
+    HeapBudget MemoryAllocator::GetHeapBudget(std::uint32_t heapIndex) const {
+        std::lock_guard lock(mutex);
+        return QueryHeapBudget(heapIndex);
+    }
+
+    HeapBudget MemoryAllocator::QueryHeapBudget(std::uint32_t heapIndex) const {
+        if (!memoryBudgetSupported) {
+            // Without VK_EXT_memory_budget only our own usage is known, keep some headroom for everybody else.
+            return {memoryProperties.memoryHeaps[heapIndex].size / 10 * 8, heapUsage[heapIndex]};
+        }
+
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {};
+        budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+        VkPhysicalDeviceMemoryProperties2 properties = {};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        properties.pNext = &budgetProperties;
+        vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties);
+
+        return {budgetProperties.heapBudget[heapIndex], budgetProperties.heapUsage[heapIndex]};
+    }
+
+    bool MemoryAllocator::FitsInBudget(std::uint32_t memoryTypeIndex, VkDeviceSize size) const {
+        HeapBudget budget = QueryHeapBudget(GetHeapIndex(memoryTypeIndex));
+        return budget.usage + size <= budget.budget;
+    }
+
+    VkDeviceMemory MemoryAllocator::AllocateDeviceMemory(VkDeviceSize size, std::uint32_t memoryTypeIndex, const void* next) {
+        if (allocationCount >= maxAllocationCount) {
+            spdlog::error("Reached maxMemoryAllocationCount ({})", maxAllocationCount);
+            return VK_NULL_HANDLE;
+        }
+
+        if (!FitsInBudget(memoryTypeIndex, size)) {
+            spdlog::error("Allocating {} bytes would exceed the budget of heap {}", size, GetHeapIndex(memoryTypeIndex));
+            return VK_NULL_HANDLE;
+        }
+
+        VkMemoryAllocateInfo info = {};
+        info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        info.pNext = next;
+        info.allocationSize = size;
+        info.memoryTypeIndex = memoryTypeIndex;
+
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkResult result = vkAllocateMemory(logicalDevice, &info, allocationCallbacks, &memory);
+        if (result != VK_SUCCESS) {
+            spdlog::error("vkAllocateMemory failed for {} bytes of memory type {}", size, memoryTypeIndex);
+            return VK_NULL_HANDLE;
+        }
+
+        ++allocationCount;
+        heapUsage[GetHeapIndex(memoryTypeIndex)] += size;
+        return memory;
+    }
+
+    void MemoryAllocator::FreeDeviceMemory(VkDeviceMemory memory, VkDeviceSize size, std::uint32_t memoryTypeIndex) {
+        vkFreeMemory(logicalDevice, memory, allocationCallbacks);
+        --allocationCount;
+        heapUsage[GetHeapIndex(memoryTypeIndex)] -= size;
+    }
+
+    void* MemoryAllocator::MapMemory(VkDeviceMemory memory) {
+        // Host-visible memory stays mapped for its whole lifetime, so callers write through the pointer directly.
+        void* mappedData = nullptr;
+        const VkResult result = vkMapMemory(logicalDevice, memory, 0, VK_WHOLE_SIZE, 0, &mappedData);
+        if (result != VK_SUCCESS) {
+            spdlog::error("Cannot map host-visible device memory");
+            std::exit(EXIT_FAILURE);
+        }
+        return mappedData;
+    }
+
+    std::uint32_t MemoryAllocator::GetOrderForSize(VkDeviceSize size) const {
+        return std::max<std::uint32_t>(std::countr_zero(std::bit_ceil(size)), minOrder);
+    }
+
+    bool MemoryAllocator::TryAllocateFromBlock(Block& block, std::uint32_t order, Allocation& allocation) const {
+        std::uint32_t foundOrder = order;
+        while (foundOrder <= maxOrder && block.freeLists[foundOrder - minOrder].empty()) {
+            ++foundOrder;
+        }
+
+        if (foundOrder > maxOrder) {
+            return false;
+        }
+
+        std::set<VkDeviceSize>& foundList = block.freeLists[foundOrder - minOrder];
+        const VkDeviceSize offset = *foundList.begin();
+        foundList.erase(foundList.begin());
+
+        // Split down to the requested size, the upper halves become free buddies.
+        for (std::uint32_t splitOrder = foundOrder; splitOrder > order; --splitOrder) {
+            const VkDeviceSize halfSize = VkDeviceSize(1) << (splitOrder - 1);
+            block.freeLists[splitOrder - 1 - minOrder].insert(offset + halfSize);
+        }
+
+        block.allocatedBytes += VkDeviceSize(1) << order;
+
+        allocation.memory = block.memory;
+        allocation.offset = offset;
+        allocation.order = order;
+        allocation.mappedData = block.mappedData != nullptr ? static_cast<std::uint8_t*>(block.mappedData) + offset : nullptr;
+        return true;
+    }
+
+    Allocation MemoryAllocator::AllocateDedicated(const VkMemoryRequirements& requirements, std::uint32_t memoryTypeIndex,
+                                                  VkImage image, VkBuffer buffer) {
+        VkMemoryDedicatedAllocateInfo dedicatedInfo = {};
+        dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+        dedicatedInfo.image = image;
+        dedicatedInfo.buffer = buffer;
+
+        const bool hasResource = image != VK_NULL_HANDLE || buffer != VK_NULL_HANDLE;
+
+        Allocation allocation;
+        allocation.memory = AllocateDeviceMemory(requirements.size, memoryTypeIndex, hasResource ? &dedicatedInfo : nullptr);
+        if (!allocation.IsValid()) {
+            return {};
+        }
+
+        allocation.size = requirements.size;
+        allocation.memoryTypeIndex = memoryTypeIndex;
+
+        if (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+            allocation.mappedData = MapMemory(allocation.memory);
+        }
+
+        MemoryTypeState& state = memoryTypes[memoryTypeIndex];
+        ++state.dedicatedCount;
+        state.dedicatedBytes += requirements.size;
+
+        return allocation;
+    }
+
+    Allocation MemoryAllocator::AllocateInternal(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties,
+                                                 bool dedicated, VkImage image, VkBuffer buffer) {
+        const std::uint32_t memoryTypeIndex = FindMemoryType(requirements.memoryTypeBits, properties);
+        std::lock_guard lock(mutex);
+
+        // Anything bigger than half a block would waste most of it to internal fragmentation.
+        if (dedicated || requirements.size > kDefaultBlockSize / 2) {
+            return AllocateDedicated(requirements, memoryTypeIndex, image, buffer);
+        }
+
+        const std::uint32_t order = GetOrderForSize(std::max(requirements.size, requirements.alignment));
+
+        Allocation allocation;
+        allocation.size = requirements.size;
+        allocation.memoryTypeIndex = memoryTypeIndex;
+
+        MemoryTypeState& state = memoryTypes[memoryTypeIndex];
+        for (std::uint32_t i = 0; i < state.blocks.size(); ++i) {
+            if (TryAllocateFromBlock(state.blocks[i], order, allocation)) {
+                allocation.blockIndex = i;
+                return allocation;
+            }
+        }
+
+        Block block;
+        block.memory = AllocateDeviceMemory(kDefaultBlockSize, memoryTypeIndex, nullptr);
+        if (block.memory == VK_NULL_HANDLE) {
+            return {};
+        }
+
+        if (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+            block.mappedData = MapMemory(block.memory);
+        }
+
+        block.freeLists.resize(maxOrder - minOrder + 1);
+        block.freeLists.back().insert(0);
+
+        state.blocks.push_back(std::move(block));
+        TryAllocateFromBlock(state.blocks.back(), order, allocation);
+        allocation.blockIndex = static_cast<std::uint32_t>(state.blocks.size() - 1);
+
+        return allocation;
+    }
+
+    Allocation MemoryAllocator::Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool dedicated) {
+        return AllocateInternal(requirements, properties, dedicated, VK_NULL_HANDLE, VK_NULL_HANDLE);
+    }
+
+    Allocation MemoryAllocator::AllocateForImage(VkImage image, VkMemoryPropertyFlags properties) {
+        VkImageMemoryRequirementsInfo2 requirementsInfo = {};
+        requirementsInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+        requirementsInfo.image = image;
+
+        VkMemoryDedicatedRequirements dedicatedRequirements = {};
+        dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+        VkMemoryRequirements2 requirements = {};
+        requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+        requirements.pNext = &dedicatedRequirements;
+        vkGetImageMemoryRequirements2(logicalDevice, &requirementsInfo, &requirements);
+
+        const bool dedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+        Allocation allocation = AllocateInternal(requirements.memoryRequirements, properties, dedicated, image, VK_NULL_HANDLE);
+        if (allocation.IsValid()) {
+            vkBindImageMemory(logicalDevice, image, allocation.memory, allocation.offset);
+        }
+
+        return allocation;
+    }
+
+    Allocation MemoryAllocator::AllocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties) {
+        VkBufferMemoryRequirementsInfo2 requirementsInfo = {};
+        requirementsInfo.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+        requirementsInfo.buffer = buffer;
+
+        VkMemoryDedicatedRequirements dedicatedRequirements = {};
+        dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+        VkMemoryRequirements2 requirements = {};
+        requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+        requirements.pNext = &dedicatedRequirements;
+        vkGetBufferMemoryRequirements2(logicalDevice, &requirementsInfo, &requirements);
+
+        const bool dedicated = dedicatedRequirements.prefersDedicatedAllocation || dedicatedRequirements.requiresDedicatedAllocation;
+        Allocation allocation = AllocateInternal(requirements.memoryRequirements, properties, dedicated, VK_NULL_HANDLE, buffer);
+        if (allocation.IsValid()) {
+            vkBindBufferMemory(logicalDevice, buffer, allocation.memory, allocation.offset);
+        }
+
+        return allocation;
+    }
+
+    void MemoryAllocator::Free(Allocation& allocation) {
+        if (!allocation.IsValid()) return;
+        std::lock_guard lock(mutex);
+
+        MemoryTypeState& state = memoryTypes[allocation.memoryTypeIndex];
+
+        if (allocation.blockIndex == Allocation::kDedicated) {
+            FreeDeviceMemory(allocation.memory, allocation.size, allocation.memoryTypeIndex);
+            --state.dedicatedCount;
+            state.dedicatedBytes -= allocation.size;
+            allocation = {};
+            return;
+        }
+
+        Block& block = state.blocks[allocation.blockIndex];
+        block.allocatedBytes -= VkDeviceSize(1) << allocation.order;
+
+        // Merge with the buddy for as long as it is free as well.
+        VkDeviceSize offset = allocation.offset;
+        std::uint32_t order = allocation.order;
+        while (order < maxOrder) {
+            const VkDeviceSize buddyOffset = offset ^ (VkDeviceSize(1) << order);
+            std::set<VkDeviceSize>& freeList = block.freeLists[order - minOrder];
+            auto buddyIt = freeList.find(buddyOffset);
+            if (buddyIt == freeList.end()) {
+                break;
+            }
+            freeList.erase(buddyIt);
+            offset = std::min(offset, buddyOffset);
+            ++order;
+        }
+        block.freeLists[order - minOrder].insert(offset);
+
+        allocation = {};
+    }
+
+    void MemoryAllocator::LogStats() const {
+        std::lock_guard lock(mutex);
+        spdlog::info("Device memory: {} of {} allocations used", allocationCount, maxAllocationCount);
+
+        for (std::uint32_t typeIndex = 0; typeIndex < memoryTypes.size(); ++typeIndex) {
+            const MemoryTypeState& state = memoryTypes[typeIndex];
+            if (state.blocks.empty() && state.dedicatedCount == 0) continue;
+
+            VkDeviceSize allocatedBytes = 0;
+            VkDeviceSize freeBytes = 0;
+            VkDeviceSize largestFreeRange = 0;
+            for (const Block& block : state.blocks) {
+                allocatedBytes += block.allocatedBytes;
+                freeBytes += kDefaultBlockSize - block.allocatedBytes;
+                for (std::uint32_t order = maxOrder; order >= minOrder; --order) {
+                    if (!block.freeLists[order - minOrder].empty()) {
+                        largestFreeRange = std::max(largestFreeRange, VkDeviceSize(1) << order);
+                        break;
+                    }
+                }
+            }
+
+            // Share of the free space that cannot be served as one contiguous range.
+            const double fragmentation = freeBytes == 0 ? 0.0 : 1.0 - static_cast<double>(largestFreeRange) / freeBytes;
+
+            spdlog::info("  type {} (heap {}): {} blocks, {} KiB used, {} KiB free, largest free {} KiB, fragmentation {:.1f}%, "
+                         "{} dedicated ({} KiB)",
+                         typeIndex, GetHeapIndex(typeIndex), state.blocks.size(), allocatedBytes / 1024, freeBytes / 1024,
+                         largestFreeRange / 1024, fragmentation * 100.0, state.dedicatedCount, state.dedicatedBytes / 1024);
+        }
+
+        for (std::uint32_t heapIndex = 0; heapIndex < memoryProperties.memoryHeapCount; ++heapIndex) {
+            HeapBudget budget = QueryHeapBudget(heapIndex);
+            spdlog::info("  heap {}: {} MiB owned, {} / {} MiB process usage / budget", heapIndex, heapUsage[heapIndex] >> 20,
+                         budget.usage >> 20, budget.budget >> 20);
+        }
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <mutex>
+
+namespace veng {
+
+    struct Allocation {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        void* mappedData = nullptr;
+        std::uint32_t memoryTypeIndex = 0;
+
+        bool IsValid() const { return memory != VK_NULL_HANDLE; }
+
+    private:
+        friend class MemoryAllocator;
+        static constexpr std::uint32_t kDedicated = std::numeric_limits<std::uint32_t>::max();
+
+        std::uint32_t blockIndex = kDedicated;
+        std::uint32_t order = 0;
+    };
+
+    struct HeapBudget {
+        VkDeviceSize budget = 0;
+        VkDeviceSize usage = 0;
+    };
+
+    // Sub-allocates device memory from large blocks. Every public call takes the allocator's lock, so jobs may
+    // allocate and free from any thread; mapped pointers in an Allocation stay valid until it is freed.
+    class MemoryAllocator final {
+    public:
+        MemoryAllocator(VkPhysicalDevice physicalDevice, VkDevice logicalDevice, bool memoryBudgetSupported,
+                        const VkAllocationCallbacks* allocationCallbacks = nullptr);
+        ~MemoryAllocator();
+
+        MemoryAllocator(const MemoryAllocator&) = delete;
+        MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+
+        Allocation Allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool dedicated = false);
+        Allocation AllocateForImage(VkImage image, VkMemoryPropertyFlags properties);
+        Allocation AllocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags properties);
+        void Free(Allocation& allocation);
+
+        std::uint32_t FindMemoryType(std::uint32_t typeBits, VkMemoryPropertyFlags properties) const;
+        HeapBudget GetHeapBudget(std::uint32_t heapIndex) const;
+        void LogStats() const;
+
+    private:
+        // One large VkDeviceMemory carved up with a buddy allocator. Every range is aligned to its own power-of-two
+        // size, which also keeps linear and optimal resources from sharing a bufferImageGranularity page.
+        struct Block {
+            VkDeviceMemory memory = VK_NULL_HANDLE;
+            void* mappedData = nullptr;
+            std::vector<std::set<VkDeviceSize>> freeLists;
+            VkDeviceSize allocatedBytes = 0;
+        };
+
+        struct MemoryTypeState {
+            std::vector<Block> blocks;
+            std::uint32_t dedicatedCount = 0;
+            VkDeviceSize dedicatedBytes = 0;
+        };
+
+        static constexpr VkDeviceSize kDefaultBlockSize = 64ull * 1024 * 1024;
+
+        VkDeviceMemory AllocateDeviceMemory(VkDeviceSize size, std::uint32_t memoryTypeIndex, const void* next);
+        void FreeDeviceMemory(VkDeviceMemory memory, VkDeviceSize size, std::uint32_t memoryTypeIndex);
+        HeapBudget QueryHeapBudget(std::uint32_t heapIndex) const;
+        bool FitsInBudget(std::uint32_t memoryTypeIndex, VkDeviceSize size) const;
+        void* MapMemory(VkDeviceMemory memory);
+        bool TryAllocateFromBlock(Block& block, std::uint32_t order, Allocation& allocation) const;
+        Allocation AllocateDedicated(const VkMemoryRequirements& requirements, std::uint32_t memoryTypeIndex,
+                                     VkImage image, VkBuffer buffer);
+        Allocation AllocateInternal(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties,
+                                    bool dedicated, VkImage image, VkBuffer buffer);
+        std::uint32_t GetOrderForSize(VkDeviceSize size) const;
+        std::uint32_t GetHeapIndex(std::uint32_t memoryTypeIndex) const;
+
+        VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+        VkDevice logicalDevice = VK_NULL_HANDLE;
+        bool memoryBudgetSupported = false;
+        const VkAllocationCallbacks* allocationCallbacks = nullptr;
+
+        // Guards the blocks, free lists and counters below.
+        mutable std::mutex mutex;
+
+        VkPhysicalDeviceMemoryProperties memoryProperties = {};
+        std::uint32_t maxAllocationCount = 0;
+        std::uint32_t allocationCount = 0;
+        std::uint32_t minOrder = 0;
+        std::uint32_t maxOrder = 0;
+
+        std::vector<MemoryTypeState> memoryTypes;
+        std::vector<VkDeviceSize> heapUsage;
+    };
+}
@@ -0,0 +1,100 @@
+#include <precomp.h>
+#include <mesh.h>
+#include <spdlog/spdlog.h>
+
+namespace veng {
+
+    EncodedMesh EncodeMesh(gsl::span<const Vertex> vertices, gsl::span<const std::uint32_t> indices, VertexLayout layout) {
+        EncodedMesh mesh;
+        mesh.layout = layout;
+        mesh.vertexCount = static_cast<std::uint32_t>(vertices.size());
+        mesh.indexCount = static_cast<std::uint32_t>(indices.size());
+
+        mesh.vertexData.resize(vertices.size() * GetVertexStride(layout));
+        if (layout == VertexLayout::Compact) {
+            std::vector<CompactVertex> compressed(vertices.size());
+            CompressVertices(vertices, compressed);
+            std::memcpy(mesh.vertexData.data(), compressed.data(), mesh.vertexData.size());
+        } else {
+            std::memcpy(mesh.vertexData.data(), vertices.data(), mesh.vertexData.size());
+        }
+
+        if (vertices.size() <= std::numeric_limits<std::uint16_t>::max() + 1ull) {
+            std::vector<std::uint16_t> narrowIndices(indices.begin(), indices.end());
+            mesh.indexType = VK_INDEX_TYPE_UINT16;
+            mesh.indexData.resize(narrowIndices.size() * sizeof(std::uint16_t));
+            std::memcpy(mesh.indexData.data(), narrowIndices.data(), mesh.indexData.size());
+        } else {
+            mesh.indexType = VK_INDEX_TYPE_UINT32;
+            mesh.indexData.resize(indices.size() * sizeof(std::uint32_t));
+            std::memcpy(mesh.indexData.data(), indices.data(), mesh.indexData.size());
+        }
+
+        return mesh;
+    }
+
+    Mesh::Mesh(VkDevice logicalDevice, MemoryAllocator& allocator, UploadService& uploadService, const MeshView& view,
+               const VkAllocationCallbacks* allocationCallbacks)
+            : logicalDevice(logicalDevice), allocator(allocator), allocationCallbacks(allocationCallbacks), layout(view.layout),
+              indexType(view.indexType),
+              vertexCount(view.vertexCount), indexCount(view.indexCount),
+              vertexBytes(view.vertexData.size()), indexBytes(view.indexData.size()) {
+        vertexBuffer = CreateBuffer(vertexBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, vertexMemory);
+        indexBuffer = CreateBuffer(indexBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, indexMemory);
+
+        Upload(uploadService, vertexBuffer, view.vertexData);
+        Upload(uploadService, indexBuffer, view.indexData);
+    }
+
+    Mesh::~Mesh() {
+        vkDestroyBuffer(logicalDevice, indexBuffer, allocationCallbacks);
+        allocator.Free(indexMemory);
+        vkDestroyBuffer(logicalDevice, vertexBuffer, allocationCallbacks);
+        allocator.Free(vertexMemory);
+    }
+
+    VkBuffer Mesh::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, Allocation& allocation) {
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = std::max<VkDeviceSize>(size, 4);
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkResult result = vkCreateBuffer(logicalDevice, &bufferInfo, allocationCallbacks, &buffer);
+        if (result != VK_SUCCESS) {
+            spdlog::error("Cannot create mesh buffer");
+            std::exit(EXIT_FAILURE);
+        }
+
+        allocation = allocator.AllocateForBuffer(buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        if (!allocation.IsValid()) {
+            spdlog::error("Cannot allocate {} bytes for a mesh buffer", size);
+            std::exit(EXIT_FAILURE);
+        }
+        return buffer;
+    }
+
+    void Mesh::Upload(UploadService& uploadService, VkBuffer buffer, gsl::span<const std::uint8_t> data) {
+        // Chunks stay well below the staging ring size so large meshes stream through it instead of failing.
+        constexpr std::size_t kChunkSize = 8ull * 1024 * 1024;
+
+        for (std::size_t offset = 0; offset < data.size(); offset += kChunkSize) {
+            const std::size_t chunkSize = std::min(kChunkSize, data.size() - offset);
+            if (!uploadService.UploadBuffer(buffer, offset, data.subspan(offset, chunkSize))) {
+                spdlog::error("Cannot upload mesh data");
+                std::exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    void Mesh::Bind(VkCommandBuffer commandBuffer) const {
+        const VkDeviceSize offset = 0;
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, &offset);
+        vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, indexType);
+    }
+
+    void Mesh::Draw(VkCommandBuffer commandBuffer, std::uint32_t instanceCount, std::uint32_t firstInstance) const {
+        vkCmdDrawIndexed(commandBuffer, indexCount, instanceCount, 0, 0, firstInstance);
+    }
+}
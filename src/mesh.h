@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <memory_allocator.h>
+#include <upload_service.h>
+#include <vertex_formats.h>
+
+namespace veng {
+
+    // Vertex and index data already in the layout the GPU reads, either freshly encoded or mapped from a mesh file.
+    struct MeshView {
+        VertexLayout layout = VertexLayout::Compact;
+        std::uint32_t vertexCount = 0;
+        gsl::span<const std::uint8_t> vertexData;
+        VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+        std::uint32_t indexCount = 0;
+        gsl::span<const std::uint8_t> indexData;
+    };
+
+    struct EncodedMesh {
+        VertexLayout layout = VertexLayout::Compact;
+        std::uint32_t vertexCount = 0;
+        std::vector<std::uint8_t> vertexData;
+        VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+        std::uint32_t indexCount = 0;
+        std::vector<std::uint8_t> indexData;
+
+        MeshView View() const { return {layout, vertexCount, vertexData, indexType, indexCount, indexData}; }
+    };
+
+    // Indices drop to 16 bits whenever every vertex is addressable with them.
+    EncodedMesh EncodeMesh(gsl::span<const Vertex> vertices, gsl::span<const std::uint32_t> indices, VertexLayout layout);
+
+    // Device-local vertex and index buffers filled through the upload service. The owner must keep the mesh alive
+    // until the GPU has finished with every frame that drew it.
+    class Mesh final {
+    public:
+        Mesh(VkDevice logicalDevice, MemoryAllocator& allocator, UploadService& uploadService, const MeshView& view,
+             const VkAllocationCallbacks* allocationCallbacks = nullptr);
+        ~Mesh();
+
+        Mesh(const Mesh&) = delete;
+        Mesh& operator=(const Mesh&) = delete;
+
+        void Bind(VkCommandBuffer commandBuffer) const;
+        void Draw(VkCommandBuffer commandBuffer, std::uint32_t instanceCount = 1, std::uint32_t firstInstance = 0) const;
+
+        VertexLayout GetLayout() const { return layout; }
+        std::uint32_t GetVertexCount() const { return vertexCount; }
+        std::uint32_t GetIndexCount() const { return indexCount; }
+        VkDeviceSize GetVertexBytes() const { return vertexBytes; }
+        VkDeviceSize GetIndexBytes() const { return indexBytes; }
+
+    private:
+        VkBuffer CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, Allocation& allocation);
+        static void Upload(UploadService& uploadService, VkBuffer buffer, gsl::span<const std::uint8_t> data);
+
+        VkDevice logicalDevice = VK_NULL_HANDLE;
+        MemoryAllocator& allocator;
+        const VkAllocationCallbacks* allocationCallbacks = nullptr;
+
+        VertexLayout layout = VertexLayout::Compact;
+        VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+        std::uint32_t vertexCount = 0;
+        std::uint32_t indexCount = 0;
+        VkDeviceSize vertexBytes = 0;
+        VkDeviceSize indexBytes = 0;
+
+        VkBuffer vertexBuffer = VK_NULL_HANDLE;
+        Allocation vertexMemory;
+        VkBuffer indexBuffer = VK_NULL_HANDLE;
+        Allocation indexMemory;
+    };
+}
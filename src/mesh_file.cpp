@@ -0,0 +1,92 @@
+#include <precomp.h>
+#include <mesh_file.h>
+#include <spdlog/spdlog.h>
+
+namespace veng {
+
+    static std::uint64_t AlignUp(std::uint64_t value, std::uint64_t alignment) {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    bool MeshFile::IsValid(const FileHeader& header, std::uint64_t fileSize) {
+        if (header.magic != kMagic || header.version != kVersion) return false;
+        if (header.vertexLayout >= kVertexLayoutCount) return false;
+        if (header.indexSize != sizeof(std::uint16_t) && header.indexSize != sizeof(std::uint32_t)) return false;
+
+        const VertexLayout layout = static_cast<VertexLayout>(header.vertexLayout);
+        if (header.vertexBytes != static_cast<std::uint64_t>(header.vertexCount) * GetVertexStride(layout)) return false;
+        if (header.indexBytes != static_cast<std::uint64_t>(header.indexCount) * header.indexSize) return false;
+
+        // Checked this way round so a corrupt size cannot wrap the sum past the file size.
+        return header.vertexOffset <= fileSize && header.vertexBytes <= fileSize - header.vertexOffset &&
+               header.indexOffset <= fileSize && header.indexBytes <= fileSize - header.indexOffset;
+    }
+
+    std::optional<MeshFile> MeshFile::Open(const std::filesystem::path& filePath) {
+        std::unique_ptr<MappedFile> mapping = MappedFile::Open(filePath);
+        if (mapping == nullptr) {
+            return std::nullopt;
+        }
+
+        const gsl::span<const std::uint8_t> data = mapping->GetData();
+        FileHeader header = {};
+        if (data.size() < sizeof(header)) {
+            spdlog::error("{} is too small to be a mesh file", filePath.string());
+            return std::nullopt;
+        }
+        std::memcpy(&header, data.data(), sizeof(header));
+
+        if (!IsValid(header, data.size())) {
+            spdlog::error("{} is not a valid version {} mesh file", filePath.string(), kVersion);
+            return std::nullopt;
+        }
+
+        MeshFile meshFile;
+        meshFile.view.layout = static_cast<VertexLayout>(header.vertexLayout);
+        meshFile.view.vertexCount = header.vertexCount;
+        meshFile.view.vertexData = data.subspan(header.vertexOffset, header.vertexBytes);
+        meshFile.view.indexType = header.indexSize == sizeof(std::uint16_t) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+        meshFile.view.indexCount = header.indexCount;
+        meshFile.view.indexData = data.subspan(header.indexOffset, header.indexBytes);
+        meshFile.mapping = std::move(mapping);
+        return meshFile;
+    }
+
+    bool MeshFile::Write(const std::filesystem::path& filePath, const MeshView& view) {
+        FileHeader header = {};
+        header.magic = kMagic;
+        header.version = kVersion;
+        header.vertexLayout = static_cast<std::uint32_t>(view.layout);
+        header.indexSize = view.indexType == VK_INDEX_TYPE_UINT16 ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
+        header.vertexCount = view.vertexCount;
+        header.indexCount = view.indexCount;
+        header.vertexOffset = AlignUp(sizeof(header), kSectionAlignment);
+        header.vertexBytes = view.vertexData.size();
+        header.indexOffset = AlignUp(header.vertexOffset + header.vertexBytes, kSectionAlignment);
+        header.indexBytes = view.indexData.size();
+
+        std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            spdlog::error("Cannot write {}", filePath.string());
+            return false;
+        }
+
+        const std::vector<char> padding(kSectionAlignment, 0);
+        auto writePadding = [&file, &padding](std::uint64_t target) {
+            const auto position = static_cast<std::uint64_t>(file.tellp());
+            file.write(padding.data(), static_cast<std::streamsize>(target - position));
+        };
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        writePadding(header.vertexOffset);
+        file.write(reinterpret_cast<const char*>(view.vertexData.data()), static_cast<std::streamsize>(view.vertexData.size()));
+        writePadding(header.indexOffset);
+        file.write(reinterpret_cast<const char*>(view.indexData.data()), static_cast<std::streamsize>(view.indexData.size()));
+
+        if (!file) {
+            spdlog::error("Failed while writing {}", filePath.string());
+            return false;
+        }
+        return true;
+    }
+}
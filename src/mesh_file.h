@@ -0,0 +1,42 @@
+#pragma once
+
+#include <mapped_file.h>
+#include <mesh.h>
+
+namespace veng {
+
+    // Binary mesh container whose sections hold vertex and index data exactly as the GPU reads them. Sections start
+    // on page boundaries, so an opened file is a header check away from being copied into staging memory. All
+    // values are little-endian.
+    class MeshFile final {
+    public:
+        static constexpr std::uint64_t kSectionAlignment = 4096;
+
+        static std::optional<MeshFile> Open(const std::filesystem::path& filePath);
+        static bool Write(const std::filesystem::path& filePath, const MeshView& view);
+
+        const MeshView& View() const { return view; }
+
+    private:
+        struct FileHeader {
+            std::array<char, 4> magic;
+            std::uint32_t version;
+            std::uint32_t vertexLayout;
+            std::uint32_t indexSize;
+            std::uint32_t vertexCount;
+            std::uint32_t indexCount;
+            std::uint64_t vertexOffset;
+            std::uint64_t vertexBytes;
+            std::uint64_t indexOffset;
+            std::uint64_t indexBytes;
+        };
+
+        static constexpr std::array<char, 4> kMagic = {'V', 'M', 'S', 'H'};
+        static constexpr std::uint32_t kVersion = 1;
+
+        static bool IsValid(const FileHeader& header, std::uint64_t fileSize);
+
+        std::unique_ptr<MappedFile> mapping;
+        MeshView view;
+    };
+}
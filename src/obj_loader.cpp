@@ -0,0 +1,205 @@
+#include <precomp.h>
+#include <obj_loader.h>
+#include <mapped_file.h>
+#include <profiler.h>
+#include <spdlog/spdlog.h>
+#include <charconv>
+
+namespace veng {
+
+    namespace {
+        struct CornerKey {
+            std::int32_t position = -1;
+            std::int32_t uv = -1;
+            std::int32_t normal = -1;
+
+            bool operator==(const CornerKey&) const = default;
+        };
+
+        struct CornerKeyHash {
+            std::size_t operator()(const CornerKey& key) const {
+                std::size_t hash = static_cast<std::uint32_t>(key.position);
+                hash = hash * 0x9e3779b97f4a7c15ull + static_cast<std::uint32_t>(key.uv);
+                hash = hash * 0x9e3779b97f4a7c15ull + static_cast<std::uint32_t>(key.normal);
+                return hash ^ (hash >> 29);
+            }
+        };
+
+        class LineParser {
+        public:
+            LineParser(const char* begin, const char* end) : cursor(begin), end(end) {}
+
+            void SkipSpaces() {
+                while (cursor < end && (*cursor == ' ' || *cursor == '\t')) ++cursor;
+            }
+
+            bool AtEnd() {
+                SkipSpaces();
+                return cursor >= end;
+            }
+
+            bool ReadFloat(float& value) {
+                SkipSpaces();
+                const std::from_chars_result result = std::from_chars(cursor, end, value);
+                if (result.ec != std::errc()) return false;
+                cursor = result.ptr;
+                return true;
+            }
+
+            bool ReadInt(std::int32_t& value) {
+                const std::from_chars_result result = std::from_chars(cursor, end, value);
+                if (result.ec != std::errc()) return false;
+                cursor = result.ptr;
+                return true;
+            }
+
+            // Matches a statement keyword only when whitespace follows, so "v" does not swallow "vt" or "vp".
+            bool ConsumeKeyword(std::string_view keyword) {
+                const auto remaining = static_cast<std::size_t>(end - cursor);
+                if (remaining <= keyword.size() || std::string_view(cursor, keyword.size()) != keyword) return false;
+                const char separator = cursor[keyword.size()];
+                if (separator != ' ' && separator != '\t') return false;
+                cursor += keyword.size();
+                return true;
+            }
+
+            bool Consume(char character) {
+                if (cursor < end && *cursor == character) {
+                    ++cursor;
+                    return true;
+                }
+                return false;
+            }
+
+            // Reads one "v", "v/vt", "v//vn" or "v/vt/vn" face corner with 1-based or negative relative indices.
+            bool ReadCorner(CornerKey& corner, std::size_t positionCount, std::size_t uvCount, std::size_t normalCount) {
+                SkipSpaces();
+                std::int32_t index = 0;
+                if (!ReadInt(index) || !Resolve(index, positionCount, corner.position)) return false;
+
+                corner.uv = -1;
+                corner.normal = -1;
+                if (!Consume('/')) return true;
+                if (!Consume('/')) {
+                    if (!ReadInt(index) || !Resolve(index, uvCount, corner.uv)) return false;
+                    if (!Consume('/')) return true;
+                }
+                return ReadInt(index) && Resolve(index, normalCount, corner.normal);
+            }
+
+        private:
+            static bool Resolve(std::int32_t index, std::size_t count, std::int32_t& resolved) {
+                resolved = index < 0 ? static_cast<std::int32_t>(count) + index : index - 1;
+                return resolved >= 0 && static_cast<std::size_t>(resolved) < count;
+            }
+
+            const char* cursor = nullptr;
+            const char* end = nullptr;
+        };
+    }
+
+    bool LoadObj(const std::filesystem::path& filePath, std::vector<Vertex>& vertices, std::vector<std::uint32_t>& indices) {
+        VENG_PROFILE_FUNCTION();
+        std::unique_ptr<MappedFile> file = MappedFile::Open(filePath);
+        if (file == nullptr) {
+            return false;
+        }
+
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec2> uvs;
+        std::vector<glm::vec3> normals;
+        std::unordered_map<CornerKey, std::uint32_t, CornerKeyHash> cornerVertices;
+        std::vector<std::uint32_t> polygon;
+        // Position index of every vertex, and the vertices whose corner had no vn, paired with their position.
+        std::vector<std::int32_t> vertexPositions;
+        std::vector<std::pair<std::uint32_t, std::int32_t>> missingNormalPositions;
+
+        vertices.clear();
+        indices.clear();
+
+        const gsl::span<const std::uint8_t> data = file->GetData();
+        const char* cursor = reinterpret_cast<const char*>(data.data());
+        const char* const fileEnd = cursor + data.size();
+        std::size_t lineNumber = 0;
+
+        while (cursor < fileEnd) {
+            const char* lineEnd = static_cast<const char*>(std::memchr(cursor, '\n', fileEnd - cursor));
+            if (lineEnd == nullptr) lineEnd = fileEnd;
+            const char* contentEnd = lineEnd > cursor && lineEnd[-1] == '\r' ? lineEnd - 1 : lineEnd;
+            ++lineNumber;
+
+            LineParser line(cursor, contentEnd);
+            cursor = lineEnd + 1;
+            line.SkipSpaces();
+
+            bool parsed = true;
+            if (line.ConsumeKeyword("v")) {
+                glm::vec3 position(0.0f);
+                parsed = line.ReadFloat(position.x) && line.ReadFloat(position.y) && line.ReadFloat(position.z);
+                positions.push_back(position);
+            } else if (line.ConsumeKeyword("vt")) {
+                glm::vec2 uv(0.0f);
+                parsed = line.ReadFloat(uv.x) && (line.AtEnd() || line.ReadFloat(uv.y));
+                // OBJ puts the texture origin at the bottom left, Vulkan samples from the top left.
+                uvs.emplace_back(uv.x, 1.0f - uv.y);
+            } else if (line.ConsumeKeyword("vn")) {
+                glm::vec3 normal(0.0f);
+                parsed = line.ReadFloat(normal.x) && line.ReadFloat(normal.y) && line.ReadFloat(normal.z);
+                normals.push_back(normal);
+            } else if (line.ConsumeKeyword("f")) {
+                polygon.clear();
+                while (parsed && !line.AtEnd()) {
+                    CornerKey corner;
+                    parsed = line.ReadCorner(corner, positions.size(), uvs.size(), normals.size());
+                    if (!parsed) break;
+
+                    auto [it, inserted] = cornerVertices.try_emplace(corner, static_cast<std::uint32_t>(vertices.size()));
+                    if (inserted) {
+                        Vertex vertex;
+                        vertex.position = positions[corner.position];
+                        vertex.uv = corner.uv >= 0 ? uvs[corner.uv] : glm::vec2(0.0f);
+                        vertex.normal = corner.normal >= 0 ? normals[corner.normal] : glm::vec3(0.0f);
+                        vertexPositions.push_back(corner.position);
+                        if (corner.normal < 0) {
+                            missingNormalPositions.emplace_back(it->second, corner.position);
+                        }
+                        vertices.push_back(vertex);
+                    }
+                    polygon.push_back(it->second);
+                }
+
+                for (std::size_t i = 2; parsed && i < polygon.size(); ++i) {
+                    indices.insert(indices.end(), {polygon[0], polygon[i - 1], polygon[i]});
+                }
+            }
+
+            if (!parsed) {
+                spdlog::error("{}:{}: malformed line", filePath.string(), lineNumber);
+                return false;
+            }
+        }
+
+        // Corners without a vn get a smooth normal. It is accumulated per position rather than per vertex, so corners
+        // that share a position but differ in uv still agree, and an explicit "vn 0 0 0" is left alone.
+        if (!missingNormalPositions.empty()) {
+            std::vector<glm::vec3> positionNormals(positions.size(), glm::vec3(0.0f));
+            for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+                const std::int32_t a = vertexPositions[indices[i]];
+                const std::int32_t b = vertexPositions[indices[i + 1]];
+                const std::int32_t c = vertexPositions[indices[i + 2]];
+                // The unnormalised cross product weights each face by its area.
+                const glm::vec3 faceNormal = glm::cross(positions[b] - positions[a], positions[c] - positions[a]);
+                positionNormals[a] = positionNormals[a] + faceNormal;
+                positionNormals[b] = positionNormals[b] + faceNormal;
+                positionNormals[c] = positionNormals[c] + faceNormal;
+            }
+
+            for (const auto& [vertex, position] : missingNormalPositions) {
+                const float length = glm::length(positionNormals[position]);
+                vertices[vertex].normal = length > 0.0f ? positionNormals[position] / length : glm::vec3(0.0f, 0.0f, 1.0f);
+            }
+        }
+
+        return true;
+    }
+}
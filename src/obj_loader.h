@@ -0,0 +1,11 @@
+#pragma once
+
+#include <vertex_formats.h>
+
+namespace veng {
+
+    // Reads positions, texture coordinates, normals and faces from a Wavefront OBJ file. Polygons are fanned into
+    // triangles, identical position/uv/normal corners share one vertex, and vertices without a normal get a smooth
+    // one from the faces around them.
+    bool LoadObj(const std::filesystem::path& filePath, std::vector<Vertex>& vertices, std::vector<std::uint32_t>& indices);
+}
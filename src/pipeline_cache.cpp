@@ -0,0 +1,139 @@
+#include <precomp.h>
+#include <pipeline_cache.h>
+#include <spdlog/spdlog.h>
+
+namespace veng {
+
+    static std::uint64_t HashBytes(gsl::span<const std::uint8_t> data) {
+        // FNV-1a, enough to catch truncated or partially written files.
+        std::uint64_t hash = 14695981039346656037ull;
+        for (std::uint8_t byte : data) {
+            hash ^= byte;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    PipelineCache::PipelineCache(VkDevice logicalDevice, const VkPhysicalDeviceProperties& deviceProperties,
+                                 std::filesystem::path filePath, const VkAllocationCallbacks* allocationCallbacks)
+            : logicalDevice(logicalDevice), allocationCallbacks(allocationCallbacks), deviceProperties(deviceProperties),
+              filePath(std::move(filePath)) {
+        const auto start = std::chrono::steady_clock::now();
+
+        std::vector<std::uint8_t> initialData = LoadValidatedData();
+
+        VkPipelineCacheCreateInfo info = {};
+        info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        info.initialDataSize = initialData.size();
+        info.pInitialData = initialData.empty() ? nullptr : initialData.data();
+
+        VkResult result = vkCreatePipelineCache(logicalDevice, &info, allocationCallbacks, &cache);
+        if (result != VK_SUCCESS && !initialData.empty()) {
+            spdlog::warn("Driver rejected the pipeline cache, starting cold");
+            info.initialDataSize = 0;
+            info.pInitialData = nullptr;
+            initialData.clear();
+            result = vkCreatePipelineCache(logicalDevice, &info, allocationCallbacks, &cache);
+        }
+
+        if (result != VK_SUCCESS) {
+            std::exit(EXIT_FAILURE);
+        }
+
+        warm = !initialData.empty();
+
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        spdlog::info("Pipeline cache {} ({} bytes) in {:.3f} ms", warm ? "loaded" : "created empty", initialData.size(), elapsed.count());
+    }
+
+    PipelineCache::~PipelineCache() {
+        if (cache != VK_NULL_HANDLE) {
+            vkDestroyPipelineCache(logicalDevice, cache, allocationCallbacks);
+        }
+    }
+
+    PipelineCache::FileHeader PipelineCache::MakeHeader(gsl::span<const std::uint8_t> data) const {
+        FileHeader header = {};
+        header.magic = kMagic;
+        header.headerVersion = kHeaderVersion;
+        header.vendorId = deviceProperties.vendorID;
+        header.deviceId = deviceProperties.deviceID;
+        header.driverVersion = deviceProperties.driverVersion;
+        std::copy(std::begin(deviceProperties.pipelineCacheUUID), std::end(deviceProperties.pipelineCacheUUID),
+                  header.pipelineCacheUuid.begin());
+        header.dataSize = data.size();
+        header.dataHash = HashBytes(data);
+        return header;
+    }
+
+    std::vector<std::uint8_t> PipelineCache::LoadValidatedData() const {
+        std::vector<std::uint8_t> file = ReadFile(filePath);
+        if (file.empty()) {
+            return {};
+        }
+
+        if (file.size() < sizeof(FileHeader)) {
+            spdlog::warn("Pipeline cache {} is truncated", filePath.string());
+            return {};
+        }
+
+        FileHeader header;
+        std::memcpy(&header, file.data(), sizeof(FileHeader));
+        gsl::span<const std::uint8_t> data(file.data() + sizeof(FileHeader), file.size() - sizeof(FileHeader));
+
+        FileHeader expected = MakeHeader(data);
+        const bool sameDevice = header.magic == expected.magic && header.headerVersion == expected.headerVersion &&
+                                header.vendorId == expected.vendorId && header.deviceId == expected.deviceId &&
+                                header.driverVersion == expected.driverVersion &&
+                                header.pipelineCacheUuid == expected.pipelineCacheUuid;
+        if (!sameDevice) {
+            spdlog::info("Pipeline cache {} was written by another device or driver", filePath.string());
+            return {};
+        }
+
+        if (header.dataSize != expected.dataSize || header.dataHash != expected.dataHash) {
+            spdlog::warn("Pipeline cache {} is corrupt", filePath.string());
+            return {};
+        }
+
+        return {data.begin(), data.end()};
+    }
+
+    void PipelineCache::Save() const {
+        std::size_t size = 0;
+        vkGetPipelineCacheData(logicalDevice, cache, &size, nullptr);
+
+        std::vector<std::uint8_t> data(size);
+        VkResult result = vkGetPipelineCacheData(logicalDevice, cache, &size, data.data());
+        if (result != VK_SUCCESS) {
+            spdlog::warn("Cannot read back the pipeline cache");
+            return;
+        }
+        data.resize(size);
+
+        FileHeader header = MakeHeader(data);
+
+        std::filesystem::path temporaryPath = filePath;
+        temporaryPath += ".tmp";
+
+        {
+            std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
+            file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+            if (!file.good()) {
+                spdlog::warn("Cannot write the pipeline cache to {}", temporaryPath.string());
+                return;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporaryPath, filePath, error);
+        if (error) {
+            spdlog::warn("Cannot replace the pipeline cache {}: {}", filePath.string(), error.message());
+            std::filesystem::remove(temporaryPath, error);
+            return;
+        }
+
+        spdlog::info("Saved {} bytes of pipeline cache to {}", data.size(), filePath.string());
+    }
+}
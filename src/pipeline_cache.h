@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+namespace veng {
+
+    // VkPipelineCache persisted between runs. The file is only used when it was written by the same device and
+    // driver, and it is replaced atomically so an interrupted save never leaves a corrupt cache behind.
+    class PipelineCache final {
+    public:
+        PipelineCache(VkDevice logicalDevice, const VkPhysicalDeviceProperties& deviceProperties, std::filesystem::path filePath,
+                      const VkAllocationCallbacks* allocationCallbacks = nullptr);
+        ~PipelineCache();
+
+        PipelineCache(const PipelineCache&) = delete;
+        PipelineCache& operator=(const PipelineCache&) = delete;
+
+        void Save() const;
+
+        VkPipelineCache GetHandle() const { return cache; }
+        bool IsWarm() const { return warm; }
+
+    private:
+        struct FileHeader {
+            std::array<char, 4> magic;
+            std::uint32_t headerVersion;
+            std::uint32_t vendorId;
+            std::uint32_t deviceId;
+            std::uint32_t driverVersion;
+            std::array<std::uint8_t, VK_UUID_SIZE> pipelineCacheUuid;
+            std::uint64_t dataSize;
+            std::uint64_t dataHash;
+        };
+
+        static constexpr std::array<char, 4> kMagic = {'V', 'P', 'C', 'F'};
+        static constexpr std::uint32_t kHeaderVersion = 1;
+
+        FileHeader MakeHeader(gsl::span<const std::uint8_t> data) const;
+        std::vector<std::uint8_t> LoadValidatedData() const;
+
+        VkDevice logicalDevice = VK_NULL_HANDLE;
+        const VkAllocationCallbacks* allocationCallbacks = nullptr;
+        VkPhysicalDeviceProperties deviceProperties;
+        std::filesystem::path filePath;
+        VkPipelineCache cache = VK_NULL_HANDLE;
+        bool warm = false;
+    };
+}
@@ -3,12 +3,21 @@
 #include <cmath>
 #include <cstdlib>
 #include <cstdint>
+#include <chrono>
 #include <gsl/gsl>
 #include <string>
 #include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <vector>
 #include <string_view>
 #include <glm/glm.hpp>
 #include <utilities.h>
 #include <functional>
 #include <optional>
-#include <set>
\ No newline at end of file
+#include <set>
+#include <map>
+#include <deque>
+#include <array>
+#include <unordered_map>
+#include <memory>
\ No newline at end of file
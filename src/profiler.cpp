@@ -0,0 +1,167 @@
+#include <precomp.h>
+#include <profiler.h>
+#include <spdlog/spdlog.h>
+#include <map>
+
+namespace veng {
+
+    Profiler& Profiler::Get() {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    Profiler::Profiler() : origin(std::chrono::steady_clock::now()) {
+    }
+
+    std::int64_t Profiler::Now() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+    Profiler::Track& Profiler::GetThreadTrack() {
+        thread_local Track* threadTrack = nullptr;
+        if (threadTrack != nullptr) {
+            return *threadTrack;
+        }
+
+        std::lock_guard lock(tracksMutex);
+        auto track = std::make_unique<Track>();
+        track->id = nextThreadTrackId++;
+        track->name = fmt::format("Thread {}", track->id);
+        threadTrack = track.get();
+        tracks.push_back(std::move(track));
+        return *threadTrack;
+    }
+
+    Profiler::Track& Profiler::GetTrack(std::uint32_t trackId, gsl::czstring trackName) {
+        if (trackId < kFirstCustomTrackId) {
+            spdlog::error("Profiler track {} ({}) overlaps the thread track range", trackId, trackName);
+            std::exit(EXIT_FAILURE);
+        }
+
+        std::lock_guard lock(tracksMutex);
+        auto it = std::find_if(tracks.begin(), tracks.end(), [trackId](const std::unique_ptr<Track>& track) {
+            return track->id == trackId;
+        });
+        if (it != tracks.end()) {
+            return **it;
+        }
+
+        auto track = std::make_unique<Track>();
+        track->id = trackId;
+        track->name = trackName;
+        tracks.push_back(std::move(track));
+        return *tracks.back();
+    }
+
+    void Profiler::SetThreadName(std::string name) {
+        Track& track = GetThreadTrack();
+        std::lock_guard lock(tracksMutex);
+        track.name = std::move(name);
+    }
+
+    void Profiler::Append(Track& track, const ProfileEvent& event) {
+        std::lock_guard lock(track.mutex);
+        if (track.events.size() >= kMaxEventsPerTrack) {
+            ++track.droppedEvents;
+            return;
+        }
+        track.events.push_back(event);
+    }
+
+    void Profiler::Record(gsl::czstring name, std::int64_t start, std::int64_t duration) {
+        Append(GetThreadTrack(), {name, start, duration});
+    }
+
+    void Profiler::RecordOnTrack(std::uint32_t trackId, gsl::czstring trackName, gsl::czstring name, std::int64_t start,
+                                 std::int64_t duration) {
+        Append(GetTrack(trackId, trackName), {name, start, duration});
+    }
+
+    // Zone and thread names are arbitrary strings, so quotes, backslashes and control characters must be escaped.
+    static std::string EscapeJson(std::string_view text) {
+        std::string escaped;
+        escaped.reserve(text.size());
+        for (const char c : text) {
+            switch (c) {
+                case '"': escaped += "\\\""; break;
+                case '\\': escaped += "\\\\"; break;
+                case '\n': escaped += "\\n"; break;
+                case '\r': escaped += "\\r"; break;
+                case '\t': escaped += "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        escaped += fmt::format("\\u{:04x}", static_cast<unsigned char>(c));
+                    } else {
+                        escaped += c;
+                    }
+            }
+        }
+        return escaped;
+    }
+
+    bool Profiler::WriteChromeTrace(const std::filesystem::path& filePath) {
+        std::ofstream file(filePath, std::ios::trunc);
+        if (!file.is_open()) {
+            spdlog::error("Cannot write the trace to {}", filePath.string());
+            return false;
+        }
+
+        std::lock_guard lock(tracksMutex);
+
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        // Zone names are long-lived strings repeated across millions of events, so each is escaped once.
+        std::unordered_map<gsl::czstring, std::string> escapedNames;
+        bool first = true;
+        for (const std::unique_ptr<Track>& track : tracks) {
+            std::lock_guard trackLock(track->mutex);
+
+            file << (first ? "" : ",\n")
+                 << fmt::format(R"({{"name":"thread_name","ph":"M","pid":0,"tid":{},"args":{{"name":"{}"}}}})", track->id,
+                                EscapeJson(track->name));
+            first = false;
+
+            // Chrome expects microseconds, keep the nanosecond precision as fractions.
+            for (const ProfileEvent& event : track->events) {
+                auto [escapedName, inserted] = escapedNames.try_emplace(event.name);
+                if (inserted) {
+                    escapedName->second = EscapeJson(event.name);
+                }
+                file << fmt::format(",\n{{\"name\":\"{}\",\"ph\":\"X\",\"pid\":0,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}}}",
+                                    escapedName->second, track->id, event.start / 1000.0, event.duration / 1000.0);
+            }
+        }
+        file << "\n]}\n";
+
+        spdlog::info("Wrote trace to {}", filePath.string());
+        return file.good();
+    }
+
+    void Profiler::LogSummary() {
+        std::map<std::string, std::vector<std::int64_t>> durationsByZone;
+
+        {
+            std::lock_guard lock(tracksMutex);
+            for (const std::unique_ptr<Track>& track : tracks) {
+                std::lock_guard trackLock(track->mutex);
+                for (const ProfileEvent& event : track->events) {
+                    durationsByZone[fmt::format("{}/{}", track->name, event.name)].push_back(event.duration);
+                }
+                if (track->droppedEvents > 0) {
+                    spdlog::warn("{} dropped {} profile events", track->name, track->droppedEvents);
+                }
+            }
+        }
+
+        auto percentile = [](const std::vector<std::int64_t>& sorted, double fraction) {
+            const std::size_t index = static_cast<std::size_t>(fraction * (sorted.size() - 1) + 0.5);
+            return sorted[index] / 1.0e6;
+        };
+
+        spdlog::info("{:<48} {:>8} {:>10} {:>10} {:>10} {:>10}", "zone", "count", "p50 ms", "p90 ms", "p99 ms", "max ms");
+        for (auto& [zone, durations] : durationsByZone) {
+            std::sort(durations.begin(), durations.end());
+            spdlog::info("{:<48} {:>8} {:>10.3f} {:>10.3f} {:>10.3f} {:>10.3f}", zone, durations.size(), percentile(durations, 0.5),
+                         percentile(durations, 0.9), percentile(durations, 0.99), durations.back() / 1.0e6);
+        }
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <mutex>
+
+// Defining VENG_DISABLE_PROFILER compiles every zone out.
+#if defined(VENG_DISABLE_PROFILER)
+#define VENG_PROFILER_ENABLED 0
+#else
+#define VENG_PROFILER_ENABLED 1
+#endif
+
+#define VENG_PROFILE_CONCAT_INNER(a, b) a##b
+#define VENG_PROFILE_CONCAT(a, b) VENG_PROFILE_CONCAT_INNER(a, b)
+
+// Code outside the profiler goes through these, so a disabled profiler is never instantiated and its arguments are
+// never evaluated.
+#if VENG_PROFILER_ENABLED
+#define VENG_PROFILE_SCOPE(name) const veng::ProfileScope VENG_PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define VENG_PROFILE_FUNCTION() VENG_PROFILE_SCOPE(__func__)
+#define VENG_PROFILE_THREAD_NAME(name) veng::Profiler::Get().SetThreadName(name)
+#define VENG_PROFILE_NOW() veng::Profiler::Get().Now()
+#define VENG_PROFILE_ON_TRACK(trackId, trackName, name, start, duration) \
+    veng::Profiler::Get().RecordOnTrack(trackId, trackName, name, start, duration)
+#else
+#define VENG_PROFILE_SCOPE(name) ((void)0)
+#define VENG_PROFILE_FUNCTION() ((void)0)
+#define VENG_PROFILE_THREAD_NAME(name) ((void)0)
+#define VENG_PROFILE_NOW() std::int64_t{0}
+#define VENG_PROFILE_ON_TRACK(trackId, trackName, name, start, duration) ((void)0)
+#endif
+
+namespace veng {
+
+    // Zone names must outlive the profiler, string literals and __func__ are fine.
+    struct ProfileEvent {
+        gsl::czstring name = nullptr;
+        std::int64_t start = 0;
+        std::int64_t duration = 0;
+    };
+
+    class Profiler final {
+    public:
+        // Thread tracks are numbered from zero, tracks recorded through RecordOnTrack take IDs from here up.
+        static constexpr std::uint32_t kFirstCustomTrackId = 1u << 31;
+
+        static Profiler& Get();
+
+        std::int64_t Now() const;
+        void Record(gsl::czstring name, std::int64_t start, std::int64_t duration);
+        void SetThreadName(std::string name);
+        void RecordOnTrack(std::uint32_t trackId, gsl::czstring trackName, gsl::czstring name, std::int64_t start, std::int64_t duration);
+
+        bool WriteChromeTrace(const std::filesystem::path& filePath);
+        void LogSummary();
+
+    private:
+        // Each thread appends to its own buffer, the lock is only ever contended while dumping.
+        struct Track {
+            std::uint32_t id = 0;
+            std::string name;
+            std::mutex mutex;
+            std::vector<ProfileEvent> events;
+            std::uint64_t droppedEvents = 0;
+        };
+
+        static constexpr std::size_t kMaxEventsPerTrack = 4 * 1024 * 1024;
+
+        Profiler();
+        Track& GetThreadTrack();
+        Track& GetTrack(std::uint32_t trackId, gsl::czstring trackName);
+        static void Append(Track& track, const ProfileEvent& event);
+
+        std::chrono::steady_clock::time_point origin;
+        std::mutex tracksMutex;
+        std::vector<std::unique_ptr<Track>> tracks;
+        std::uint32_t nextThreadTrackId = 0;
+    };
+
+    class ProfileScope {
+    public:
+        explicit ProfileScope(gsl::czstring name) : name(name), start(Profiler::Get().Now()) {}
+        ~ProfileScope() { Profiler::Get().Record(name, start, Profiler::Get().Now() - start); }
+
+        ProfileScope(const ProfileScope&) = delete;
+        ProfileScope& operator=(const ProfileScope&) = delete;
+
+    private:
+        gsl::czstring name;
+        std::int64_t start;
+    };
+}
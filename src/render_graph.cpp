@@ -0,0 +1,622 @@
+#include <precomp.h>
+#include <render_graph.h>
+#include <spdlog/spdlog.h>
+
+namespace veng {
+
+    struct AccessInfo {
+        VkPipelineStageFlags2 stages = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 readAccess = VK_ACCESS_2_NONE;
+        VkAccessFlags2 writeAccess = VK_ACCESS_2_NONE;
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkImageUsageFlags usage = 0;
+        bool attachment = false;
+    };
+
+    static AccessInfo GetAccessInfo(ImageAccess access) {
+        constexpr VkPipelineStageFlags2 kShaderStages = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+        constexpr VkPipelineStageFlags2 kDepthStages = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+
+        switch (access) {
+            case ImageAccess::ColorAttachment:
+                return {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT,
+                        VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, true};
+            case ImageAccess::DepthAttachment:
+                return {kDepthStages, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, true};
+            case ImageAccess::SampledRead:
+                return {kShaderStages, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                        VK_IMAGE_USAGE_SAMPLED_BIT, false};
+            case ImageAccess::StorageRead:
+                return {kShaderStages, VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_GENERAL,
+                        VK_IMAGE_USAGE_STORAGE_BIT, false};
+            case ImageAccess::StorageWrite:
+                return {kShaderStages, VK_ACCESS_2_NONE, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL,
+                        VK_IMAGE_USAGE_STORAGE_BIT, false};
+            case ImageAccess::TransferSource:
+                return {VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_ACCESS_2_NONE,
+                        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT, false};
+            case ImageAccess::TransferDestination:
+                return {VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_NONE, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT, false};
+        }
+        return {};
+    }
+
+    static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    RenderGraph::RenderGraph(VkDevice logicalDevice, MemoryAllocator& allocator, const DeviceFunctions& functions,
+                             HostAllocator* hostAllocator)
+        : logicalDevice(logicalDevice), allocator(allocator), functions(functions), hostAllocator(hostAllocator) {
+    }
+
+    RenderGraph::~RenderGraph() {
+        DestroyCompiledResources();
+    }
+
+    RenderGraphImage RenderGraph::ImportImage(std::string_view name, const ImportedImage& image) {
+        ImageResource resource;
+        resource.name = name;
+        resource.imported = true;
+        resource.description = image;
+        resource.image = image.image;
+        resource.view = image.view;
+        images.push_back(std::move(resource));
+        compiled = false;
+        return {static_cast<std::uint32_t>(images.size() - 1)};
+    }
+
+    RenderGraphImage RenderGraph::CreateImage(std::string_view name, VkFormat format, VkExtent2D extent) {
+        ImageResource resource;
+        resource.name = name;
+        resource.description.format = format;
+        resource.description.extent = extent;
+        images.push_back(std::move(resource));
+        compiled = false;
+        return {static_cast<std::uint32_t>(images.size() - 1)};
+    }
+
+    void RenderGraph::SetImportedImage(RenderGraphImage image, VkImage handle, VkImageView view, VkExtent2D extent) {
+        ImageResource& resource = images[image.index];
+        resource.image = handle;
+        resource.view = view;
+        resource.description.image = handle;
+        resource.description.view = view;
+        resource.description.extent = extent;
+    }
+
+    RenderGraphPass RenderGraph::AddPass(std::string_view name, ExecuteFunction execute) {
+        PassResource pass;
+        pass.name = name;
+        pass.execute = std::move(execute);
+        passes.push_back(std::move(pass));
+        compiled = false;
+        return {static_cast<std::uint32_t>(passes.size() - 1)};
+    }
+
+    RenderGraph::ImageUse& RenderGraph::AddUse(RenderGraphPass pass, RenderGraphImage image, ImageAccess access, bool write) {
+        const AccessInfo info = GetAccessInfo(access);
+        ImageResource& resource = images[image.index];
+        resource.usage |= info.usage;
+        if (access == ImageAccess::DepthAttachment) {
+            resource.aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+        }
+        compiled = false;
+
+        const VkAccessFlags2 readAccess = write ? VK_ACCESS_2_NONE : info.readAccess;
+        const VkAccessFlags2 writeAccess = write ? (info.writeAccess != VK_ACCESS_2_NONE ? info.writeAccess : info.readAccess) : VK_ACCESS_2_NONE;
+
+        // A pass touching an image twice gets one combined use, in the general layout if the two disagree.
+        std::vector<ImageUse>& uses = passes[pass.index].uses;
+        auto existing = std::find_if(uses.begin(), uses.end(), [&image](const ImageUse& use) { return use.image == image.index; });
+        if (existing != uses.end()) {
+            existing->stages |= info.stages;
+            existing->readAccess |= readAccess;
+            existing->writeAccess |= writeAccess;
+            existing->attachment = existing->attachment && info.attachment;
+            if (existing->layout != info.layout) {
+                existing->layout = VK_IMAGE_LAYOUT_GENERAL;
+            }
+            return *existing;
+        }
+
+        ImageUse use;
+        use.image = image.index;
+        use.stages = info.stages;
+        use.readAccess = readAccess;
+        use.writeAccess = writeAccess;
+        use.layout = info.layout;
+        use.attachment = info.attachment;
+        uses.push_back(use);
+        return uses.back();
+    }
+
+    void RenderGraph::Read(RenderGraphPass pass, RenderGraphImage image, ImageAccess access) {
+        AddUse(pass, image, access, false);
+    }
+
+    void RenderGraph::Write(RenderGraphPass pass, RenderGraphImage image, ImageAccess access) {
+        AddUse(pass, image, access, true);
+    }
+
+    void RenderGraph::ClearColor(RenderGraphPass pass, RenderGraphImage image, VkClearColorValue value) {
+        VkClearValue clear = {};
+        clear.color = value;
+        AddUse(pass, image, ImageAccess::ColorAttachment, true).clear = clear;
+    }
+
+    void RenderGraph::ClearDepth(RenderGraphPass pass, RenderGraphImage image, float depth) {
+        VkClearValue clear = {};
+        clear.depthStencil = {depth, 0};
+        AddUse(pass, image, ImageAccess::DepthAttachment, true).clear = clear;
+    }
+
+    void RenderGraph::SetSideEffects(RenderGraphPass pass) {
+        passes[pass.index].sideEffects = true;
+        compiled = false;
+    }
+
+#pragma region COMPILATION
+
+    void RenderGraph::Compile() {
+        const auto start = std::chrono::steady_clock::now();
+        DestroyCompiledResources();
+
+        CullPasses();
+        CreateTransientImages();
+        PlaceTransientImages();
+        DeriveBarriers();
+        PrepareAttachments();
+        compiled = true;
+
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        stats.compileMilliseconds = elapsed.count();
+    }
+
+    void RenderGraph::LogStats() const {
+        spdlog::info("Render graph compiled in {:.3f} ms: {} of {} passes culled, {} barriers, {} transient images "
+                     "using {:.2f} MiB ({:.2f} MiB before aliasing)", stats.compileMilliseconds, stats.culledPassCount, stats.passCount,
+                     stats.barrierCount, stats.transientImageCount, stats.aliasedTransientBytes / (1024.0 * 1024.0),
+                     stats.transientBytes / (1024.0 * 1024.0));
+    }
+
+    void RenderGraph::CullPasses() {
+        // Walking backwards, a pass is needed when it writes an image that a later needed pass reads. Imported images
+        // outlive the frame, so their final contents are always needed.
+        std::vector<bool> imageNeeded(images.size());
+        for (std::size_t i = 0; i < images.size(); ++i) {
+            imageNeeded[i] = images[i].imported;
+        }
+
+        stats = {};
+        stats.passCount = static_cast<std::uint32_t>(passes.size());
+        for (auto pass = passes.rbegin(); pass != passes.rend(); ++pass) {
+            const bool needed = pass->sideEffects || std::any_of(pass->uses.begin(), pass->uses.end(), [&imageNeeded](const ImageUse& use) {
+                return use.IsWrite() && imageNeeded[use.image];
+            });
+            pass->culled = !needed;
+            if (!needed) {
+                ++stats.culledPassCount;
+                continue;
+            }
+
+            // A cleared attachment does not depend on earlier writes to it; everything else the pass touches does.
+            for (const ImageUse& use : pass->uses) {
+                imageNeeded[use.image] = use.KeepsContents();
+            }
+        }
+
+        for (ImageResource& image : images) {
+            image.used = false;
+            image.allStages = VK_PIPELINE_STAGE_2_NONE;
+            image.allWrites = VK_ACCESS_2_NONE;
+        }
+
+        for (std::uint32_t passIndex = 0; passIndex < passes.size(); ++passIndex) {
+            if (passes[passIndex].culled) continue;
+            for (const ImageUse& use : passes[passIndex].uses) {
+                ImageResource& image = images[use.image];
+                if (!image.used) {
+                    image.firstPass = passIndex;
+                }
+                image.used = true;
+                image.lastPass = passIndex;
+                image.allStages |= use.stages;
+                image.allWrites |= use.writeAccess;
+            }
+        }
+    }
+
+    void RenderGraph::CreateTransientImages() {
+        for (ImageResource& image : images) {
+            if (image.imported || !image.used) continue;
+
+            VkImageCreateInfo info = {};
+            info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            info.imageType = VK_IMAGE_TYPE_2D;
+            info.format = image.description.format;
+            info.extent = {image.description.extent.width, image.description.extent.height, 1};
+            info.mipLevels = 1;
+            info.arrayLayers = 1;
+            info.samples = VK_SAMPLE_COUNT_1_BIT;
+            info.tiling = VK_IMAGE_TILING_OPTIMAL;
+            info.usage = image.usage;
+            info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+            const VkAllocationCallbacks* callbacks = HostAllocator::GetCallbacks(hostAllocator, VK_OBJECT_TYPE_IMAGE);
+            VkResult result = vkCreateImage(logicalDevice, &info, callbacks, &image.image);
+            if (result != VK_SUCCESS) {
+                spdlog::error("Cannot create render graph image {}", image.name);
+                std::exit(EXIT_FAILURE);
+            }
+            vkGetImageMemoryRequirements(logicalDevice, image.image, &image.requirements);
+
+            ++stats.transientImageCount;
+            stats.transientBytes += image.requirements.size;
+        }
+    }
+
+    void RenderGraph::PlaceTransientImages() {
+        std::vector<std::uint32_t> order;
+        for (std::uint32_t i = 0; i < images.size(); ++i) {
+            if (images[i].image != VK_NULL_HANDLE && !images[i].imported) {
+                order.push_back(i);
+            }
+        }
+
+        // Largest first, each at the lowest offset that does not overlap an image alive at the same time.
+        std::stable_sort(order.begin(), order.end(), [this](std::uint32_t a, std::uint32_t b) {
+            return images[a].requirements.size > images[b].requirements.size;
+        });
+
+        std::vector<std::uint32_t> placed;
+        for (std::uint32_t index : order) {
+            ImageResource& image = images[index];
+            const std::uint32_t memoryTypeIndex = allocator.FindMemoryType(image.requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+            auto heap = std::find_if(heaps.begin(), heaps.end(), [memoryTypeIndex](const Heap& candidate) {
+                return candidate.memoryTypeIndex == memoryTypeIndex;
+            });
+            if (heap == heaps.end()) {
+                Heap newHeap;
+                newHeap.memoryTypeIndex = memoryTypeIndex;
+                heaps.push_back(newHeap);
+                heap = heaps.end() - 1;
+            }
+            image.heap = static_cast<std::uint32_t>(heap - heaps.begin());
+
+            std::vector<const ImageResource*> conflicts;
+            for (std::uint32_t other : placed) {
+                const ImageResource& candidate = images[other];
+                if (candidate.heap == image.heap && candidate.firstPass <= image.lastPass && image.firstPass <= candidate.lastPass) {
+                    conflicts.push_back(&candidate);
+                }
+            }
+
+            std::vector<VkDeviceSize> offsets = {0};
+            for (const ImageResource* conflict : conflicts) {
+                offsets.push_back(AlignUp(conflict->offset + conflict->requirements.size, image.requirements.alignment));
+            }
+            std::sort(offsets.begin(), offsets.end());
+
+            for (VkDeviceSize offset : offsets) {
+                const bool fits = std::none_of(conflicts.begin(), conflicts.end(), [&image, offset](const ImageResource* conflict) {
+                    return offset < conflict->offset + conflict->requirements.size && conflict->offset < offset + image.requirements.size;
+                });
+                if (fits) {
+                    image.offset = offset;
+                    break;
+                }
+            }
+
+            heap->size = std::max(heap->size, image.offset + image.requirements.size);
+            heap->alignment = std::max(heap->alignment, image.requirements.alignment);
+            placed.push_back(index);
+        }
+
+        for (Heap& heap : heaps) {
+            VkMemoryRequirements requirements = {};
+            requirements.size = heap.size;
+            requirements.alignment = heap.alignment;
+            requirements.memoryTypeBits = 1u << heap.memoryTypeIndex;
+
+            heap.allocation = allocator.Allocate(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+            if (!heap.allocation.IsValid()) {
+                spdlog::error("Cannot allocate {} bytes of transient render graph memory", heap.size);
+                std::exit(EXIT_FAILURE);
+            }
+            stats.aliasedTransientBytes += heap.size;
+        }
+
+        for (std::uint32_t index : placed) {
+            ImageResource& image = images[index];
+            const Allocation& allocation = heaps[image.heap].allocation;
+            vkBindImageMemory(logicalDevice, image.image, allocation.memory, allocation.offset + image.offset);
+
+            VkImageViewCreateInfo viewInfo = {};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = image.image;
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = image.description.format;
+            viewInfo.subresourceRange = {image.aspect, 0, 1, 0, 1};
+
+            const VkAllocationCallbacks* callbacks = HostAllocator::GetCallbacks(hostAllocator, VK_OBJECT_TYPE_IMAGE_VIEW);
+            VkResult result = vkCreateImageView(logicalDevice, &viewInfo, callbacks, &image.view);
+            if (result != VK_SUCCESS) {
+                std::exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    void RenderGraph::DeriveBarriers() {
+        // What the last barrier made available, and which stages touched the image since.
+        struct ImageState {
+            VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            VkPipelineStageFlags2 writeStages = VK_PIPELINE_STAGE_2_NONE;
+            VkAccessFlags2 writeAccess = VK_ACCESS_2_NONE;
+            VkPipelineStageFlags2 readStages = VK_PIPELINE_STAGE_2_NONE;
+            VkPipelineStageFlags2 visibleStages = VK_PIPELINE_STAGE_2_NONE;
+            VkAccessFlags2 visibleAccess = VK_ACCESS_2_NONE;
+            bool hasContents = false;
+        };
+
+        std::vector<ImageState> states(images.size());
+        for (std::uint32_t i = 0; i < images.size(); ++i) {
+            const ImageResource& image = images[i];
+            ImageState& state = states[i];
+            if (image.imported) {
+                state.layout = image.description.initialLayout;
+                state.writeStages = image.description.initialStages;
+                state.hasContents = image.description.initialLayout != VK_IMAGE_LAYOUT_UNDEFINED;
+                continue;
+            }
+
+            // Transient memory is shared with other images, and with this one in the previous frame. The first use
+            // waits for everything any of them did to the overlapping range; earlier submissions on the queue are
+            // part of a barrier's first scope, so this also orders the frames.
+            for (const ImageResource& other : images) {
+                if (other.imported || other.image == VK_NULL_HANDLE || other.heap != image.heap) continue;
+                if (other.offset < image.offset + image.requirements.size && image.offset < other.offset + other.requirements.size) {
+                    state.writeStages |= other.allStages;
+                    state.writeAccess |= other.allWrites;
+                }
+            }
+        }
+
+        auto addBarrier = [this](std::vector<VkImageMemoryBarrier2>& barriers, std::vector<std::uint32_t>& barrierImages,
+                                 std::uint32_t imageIndex, VkPipelineStageFlags2 srcStages, VkAccessFlags2 srcAccess,
+                                 VkPipelineStageFlags2 dstStages, VkAccessFlags2 dstAccess, VkImageLayout oldLayout, VkImageLayout newLayout) {
+            VkImageMemoryBarrier2 barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR;
+            barrier.srcStageMask = srcStages != VK_PIPELINE_STAGE_2_NONE ? srcStages : VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT;
+            barrier.srcAccessMask = srcAccess;
+            barrier.dstStageMask = dstStages;
+            barrier.dstAccessMask = dstAccess;
+            barrier.oldLayout = oldLayout;
+            barrier.newLayout = newLayout;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.subresourceRange = {images[imageIndex].aspect, 0, 1, 0, 1};
+            barriers.push_back(barrier);
+            barrierImages.push_back(imageIndex);
+            ++stats.barrierCount;
+        };
+
+        for (std::uint32_t passIndex = 0; passIndex < passes.size(); ++passIndex) {
+            PassResource& pass = passes[passIndex];
+            if (pass.culled) continue;
+
+            for (ImageUse& use : pass.uses) {
+                ImageState& state = states[use.image];
+                const ImageResource& image = images[use.image];
+
+                if (use.attachment) {
+                    use.loadOp = use.clear.has_value() ? VK_ATTACHMENT_LOAD_OP_CLEAR
+                                 : state.hasContents   ? VK_ATTACHMENT_LOAD_OP_LOAD
+                                                       : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                    use.storeOp = use.IsWrite() && (image.imported || image.lastPass > passIndex) ? VK_ATTACHMENT_STORE_OP_STORE
+                                                                                                  : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+                }
+
+                // Loading an attachment reads it, even when the pass only declared a write.
+                VkAccessFlags2 readAccess = use.readAccess;
+                if (use.attachment && use.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD) {
+                    readAccess |= GetAccessInfo(image.aspect == VK_IMAGE_ASPECT_DEPTH_BIT ? ImageAccess::DepthAttachment
+                                                                                          : ImageAccess::ColorAttachment).readAccess;
+                }
+                const VkAccessFlags2 dstAccess = readAccess | use.writeAccess;
+
+                const bool layoutChange = use.layout != state.layout;
+                const bool unseenWrite = state.writeStages != VK_PIPELINE_STAGE_2_NONE &&
+                                         ((state.visibleStages & use.stages) != use.stages || (state.visibleAccess & readAccess) != readAccess);
+
+                if (!layoutChange && !use.IsWrite() && !unseenWrite) {
+                    // Reads in the same layout after the same write need nothing more between them.
+                    state.readStages |= use.stages;
+                    continue;
+                }
+
+                // Writes and transitions wait for earlier reads too, reads only for the write they need to see.
+                const bool ordersReads = use.IsWrite() || layoutChange;
+                const VkPipelineStageFlags2 srcStages = state.writeStages | (ordersReads ? state.readStages : VK_PIPELINE_STAGE_2_NONE);
+                // Contents that are about to be cleared or ignored can be discarded in the transition.
+                const bool discard = !state.hasContents || (use.attachment && use.loadOp != VK_ATTACHMENT_LOAD_OP_LOAD);
+                addBarrier(pass.barriers, pass.barrierImages, use.image, srcStages, state.writeAccess, use.stages, dstAccess,
+                           discard ? VK_IMAGE_LAYOUT_UNDEFINED : state.layout, use.layout);
+
+                state.layout = use.layout;
+                if (use.IsWrite()) {
+                    state.writeStages = use.stages;
+                    state.writeAccess = use.writeAccess;
+                    state.readStages = VK_PIPELINE_STAGE_2_NONE;
+                    state.visibleStages = VK_PIPELINE_STAGE_2_NONE;
+                    state.visibleAccess = VK_ACCESS_2_NONE;
+                    state.hasContents = true;
+                } else if (layoutChange) {
+                    // The transition itself is a write the later readers in other stages have to wait for.
+                    state.writeStages = use.stages;
+                    state.writeAccess = VK_ACCESS_2_NONE;
+                    state.readStages = use.stages;
+                    state.visibleStages = use.stages;
+                    state.visibleAccess = readAccess;
+                } else {
+                    state.readStages |= use.stages;
+                    state.visibleStages |= use.stages;
+                    state.visibleAccess |= readAccess;
+                }
+            }
+        }
+
+        for (std::uint32_t i = 0; i < images.size(); ++i) {
+            const ImageResource& image = images[i];
+            const ImageState& state = states[i];
+            if (!image.imported || image.description.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED) continue;
+            if (state.layout == image.description.finalLayout && state.writeAccess == VK_ACCESS_2_NONE) continue;
+
+            // Whatever consumes the image next (present, a copy after the frame) synchronizes through the submission.
+            addBarrier(finalBarriers, finalBarrierImages, i, state.writeStages | state.readStages, state.writeAccess,
+                       VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, VK_ACCESS_2_NONE,
+                       state.hasContents ? state.layout : VK_IMAGE_LAYOUT_UNDEFINED, image.description.finalLayout);
+        }
+    }
+
+    void RenderGraph::PrepareAttachments() {
+        for (PassResource& pass : passes) {
+            if (pass.culled) continue;
+
+            for (const ImageUse& use : pass.uses) {
+                if (!use.attachment) continue;
+
+                // The graph's barriers do every layout transition, so rendering happens in the layout of the use.
+                VkRenderingAttachmentInfoKHR attachment = {};
+                attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+                attachment.imageLayout = use.layout;
+                attachment.loadOp = use.loadOp;
+                attachment.storeOp = use.storeOp;
+                attachment.clearValue = use.clear.value_or(VkClearValue{});
+
+                if (images[use.image].aspect == VK_IMAGE_ASPECT_DEPTH_BIT) {
+                    pass.depthAttachment = attachment;
+                    pass.depthImage = use.image;
+                } else {
+                    pass.colorAttachments.push_back(attachment);
+                    pass.colorImages.push_back(use.image);
+                }
+            }
+        }
+    }
+
+    void RenderGraph::DestroyCompiledResources() {
+        for (PassResource& pass : passes) {
+            pass.barriers.clear();
+            pass.barrierImages.clear();
+            pass.colorAttachments.clear();
+            pass.colorImages.clear();
+            pass.depthAttachment.reset();
+            for (ImageUse& use : pass.uses) {
+                use.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+                use.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            }
+        }
+
+        for (ImageResource& image : images) {
+            if (image.imported) continue;
+            if (image.view != VK_NULL_HANDLE) {
+                vkDestroyImageView(logicalDevice, image.view, HostAllocator::GetCallbacks(hostAllocator, VK_OBJECT_TYPE_IMAGE_VIEW));
+                image.view = VK_NULL_HANDLE;
+            }
+            if (image.image != VK_NULL_HANDLE) {
+                vkDestroyImage(logicalDevice, image.image, HostAllocator::GetCallbacks(hostAllocator, VK_OBJECT_TYPE_IMAGE));
+                image.image = VK_NULL_HANDLE;
+            }
+        }
+
+        for (Heap& heap : heaps) {
+            allocator.Free(heap.allocation);
+        }
+        heaps.clear();
+        finalBarriers.clear();
+        finalBarrierImages.clear();
+        compiled = false;
+    }
+
+#pragma endregion
+
+#pragma region EXECUTION
+
+    void RenderGraph::RecordBarriers(VkCommandBuffer commandBuffer, std::vector<VkImageMemoryBarrier2>& barriers,
+                                     const std::vector<std::uint32_t>& barrierImages) {
+        if (barriers.empty()) return;
+
+        // Imported images change every frame, so the handles are filled in when the barriers are recorded.
+        for (std::size_t i = 0; i < barriers.size(); ++i) {
+            barriers[i].image = images[barrierImages[i]].image;
+        }
+
+        VkDependencyInfo dependency = {};
+        dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+        dependency.imageMemoryBarrierCount = barriers.size();
+        dependency.pImageMemoryBarriers = barriers.data();
+        functions.cmdPipelineBarrier2(commandBuffer, &dependency);
+    }
+
+    void RenderGraph::BeginPass(VkCommandBuffer commandBuffer, RenderGraphPass passHandle, VkRenderingFlagsKHR renderingFlags) {
+        if (!compiled) {
+            Compile();
+        }
+
+        PassResource& pass = passes[passHandle.index];
+        if (pass.culled) return;
+
+        RecordBarriers(commandBuffer, pass.barriers, pass.barrierImages);
+        if (pass.colorAttachments.empty() && !pass.depthAttachment.has_value()) return;
+
+        for (std::size_t i = 0; i < pass.colorAttachments.size(); ++i) {
+            pass.colorAttachments[i].imageView = images[pass.colorImages[i]].view;
+        }
+        if (pass.depthAttachment.has_value()) {
+            pass.depthAttachment->imageView = images[pass.depthImage].view;
+        }
+
+        const std::uint32_t extentImage = pass.colorImages.empty() ? pass.depthImage : pass.colorImages.front();
+
+        VkRenderingInfoKHR renderingInfo = {};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+        renderingInfo.flags = renderingFlags;
+        renderingInfo.renderArea.offset = {0, 0};
+        renderingInfo.renderArea.extent = images[extentImage].description.extent;
+        renderingInfo.layerCount = 1;
+        renderingInfo.colorAttachmentCount = pass.colorAttachments.size();
+        renderingInfo.pColorAttachments = pass.colorAttachments.data();
+        renderingInfo.pDepthAttachment = pass.depthAttachment.has_value() ? &pass.depthAttachment.value() : nullptr;
+        functions.cmdBeginRendering(commandBuffer, &renderingInfo);
+    }
+
+    void RenderGraph::EndPass(VkCommandBuffer commandBuffer, RenderGraphPass passHandle) {
+        const PassResource& pass = passes[passHandle.index];
+        if (pass.culled || (pass.colorAttachments.empty() && !pass.depthAttachment.has_value())) return;
+        functions.cmdEndRendering(commandBuffer);
+    }
+
+    void RenderGraph::Finish(VkCommandBuffer commandBuffer) {
+        RecordBarriers(commandBuffer, finalBarriers, finalBarrierImages);
+    }
+
+    void RenderGraph::Execute(VkCommandBuffer commandBuffer) {
+        for (std::uint32_t i = 0; i < passes.size(); ++i) {
+            const RenderGraphPass pass = {i};
+            BeginPass(commandBuffer, pass);
+            if (!passes[i].culled && passes[i].execute) {
+                passes[i].execute(commandBuffer);
+            }
+            EndPass(commandBuffer, pass);
+        }
+        Finish(commandBuffer);
+    }
+
+#pragma endregion
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <memory_allocator.h>
+#include <device_functions.h>
+#include <host_allocator.h>
+
+namespace veng {
+
+    struct RenderGraphImage {
+        static constexpr std::uint32_t kInvalid = std::numeric_limits<std::uint32_t>::max();
+        std::uint32_t index = kInvalid;
+
+        bool IsValid() const { return index != kInvalid; }
+    };
+
+    struct RenderGraphPass {
+        static constexpr std::uint32_t kInvalid = std::numeric_limits<std::uint32_t>::max();
+        std::uint32_t index = kInvalid;
+
+        bool IsValid() const { return index != kInvalid; }
+    };
+
+    // How a pass touches an image. Each access implies the stages, access flags and layout the barriers use.
+    enum class ImageAccess {
+        ColorAttachment,
+        DepthAttachment,
+        SampledRead,
+        StorageRead,
+        StorageWrite,
+        TransferSource,
+        TransferDestination,
+    };
+
+    // An image the graph does not own, such as a swap chain image. Its contents and layout carry over from outside
+    // the graph, and it is left in finalLayout at the end of the frame.
+    struct ImportedImage {
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        VkExtent2D extent = {};
+        VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        // Stages whose earlier work on the image the first barrier waits for, e.g. the stage the acquire semaphore
+        // is waited on.
+        VkPipelineStageFlags2 initialStages = VK_PIPELINE_STAGE_2_NONE;
+        VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    };
+
+    struct RenderGraphStats {
+        std::uint32_t passCount = 0;
+        std::uint32_t culledPassCount = 0;
+        std::uint32_t barrierCount = 0;
+        std::uint32_t transientImageCount = 0;
+        VkDeviceSize transientBytes = 0;
+        VkDeviceSize aliasedTransientBytes = 0;
+        double compileMilliseconds = 0.0;
+    };
+
+    // A frame described as passes that declare which images they read and write. Compiling culls passes whose
+    // results are never used, places transient images whose lifetimes do not overlap in the same memory and
+    // derives the synchronization2 barriers and layout transitions between passes. Passes run in the order they
+    // were added; passes with attachments run inside dynamic rendering the graph begins for them.
+    class RenderGraph final {
+    public:
+        using ExecuteFunction = std::function<void(VkCommandBuffer commandBuffer)>;
+
+        RenderGraph(VkDevice logicalDevice, MemoryAllocator& allocator, const DeviceFunctions& functions,
+                    HostAllocator* hostAllocator = nullptr);
+        ~RenderGraph();
+
+        RenderGraph(const RenderGraph&) = delete;
+        RenderGraph& operator=(const RenderGraph&) = delete;
+
+        RenderGraphImage ImportImage(std::string_view name, const ImportedImage& image);
+        RenderGraphImage CreateImage(std::string_view name, VkFormat format, VkExtent2D extent);
+        // Swaps the imported image for this frame's, e.g. the acquired swap chain image. Format must not change.
+        void SetImportedImage(RenderGraphImage image, VkImage handle, VkImageView view, VkExtent2D extent);
+
+        RenderGraphPass AddPass(std::string_view name, ExecuteFunction execute = {});
+        void Read(RenderGraphPass pass, RenderGraphImage image, ImageAccess access);
+        void Write(RenderGraphPass pass, RenderGraphImage image, ImageAccess access);
+        void ClearColor(RenderGraphPass pass, RenderGraphImage image, VkClearColorValue value);
+        void ClearDepth(RenderGraphPass pass, RenderGraphImage image, float depth);
+        // Keeps a pass whose results leave the graph some other way, e.g. through a buffer.
+        void SetSideEffects(RenderGraphPass pass);
+
+        // Recreates the transient images, so no frame that used them may still be in flight.
+        void Compile();
+
+        // Records every pass that survived compilation, followed by the final layout transitions.
+        void Execute(VkCommandBuffer commandBuffer);
+        // Record a single pass when its commands come from outside the graph. Passes must still be begun in order.
+        void BeginPass(VkCommandBuffer commandBuffer, RenderGraphPass pass, VkRenderingFlagsKHR renderingFlags = 0);
+        void EndPass(VkCommandBuffer commandBuffer, RenderGraphPass pass);
+        void Finish(VkCommandBuffer commandBuffer);
+
+        bool IsPassCulled(RenderGraphPass pass) const { return passes[pass.index].culled; }
+        VkImageView GetImageView(RenderGraphImage image) const { return images[image.index].view; }
+        const RenderGraphStats& GetStats() const { return stats; }
+        // Compile does not log, so graphs compiled often stay quiet; callers log the result when it matters.
+        void LogStats() const;
+
+    private:
+        struct ImageUse {
+            std::uint32_t image = 0;
+            VkPipelineStageFlags2 stages = VK_PIPELINE_STAGE_2_NONE;
+            VkAccessFlags2 readAccess = VK_ACCESS_2_NONE;
+            VkAccessFlags2 writeAccess = VK_ACCESS_2_NONE;
+            VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            bool attachment = false;
+            std::optional<VkClearValue> clear;
+
+            // Filled in by Compile for attachments.
+            VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            VkAttachmentStoreOp storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+            bool IsWrite() const { return writeAccess != VK_ACCESS_2_NONE; }
+            // Attachments that are not cleared keep what earlier passes wrote.
+            bool KeepsContents() const { return !IsWrite() || !attachment || !clear.has_value(); }
+        };
+
+        struct ImageResource {
+            std::string name;
+            bool imported = false;
+            ImportedImage description;
+            VkImageUsageFlags usage = 0;
+            VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+            VkImage image = VK_NULL_HANDLE;
+            VkImageView view = VK_NULL_HANDLE;
+
+            // Filled in by Compile.
+            bool used = false;
+            std::uint32_t firstPass = 0;
+            std::uint32_t lastPass = 0;
+            VkMemoryRequirements requirements = {};
+            std::uint32_t heap = 0;
+            VkDeviceSize offset = 0;
+            VkPipelineStageFlags2 allStages = VK_PIPELINE_STAGE_2_NONE;
+            VkAccessFlags2 allWrites = VK_ACCESS_2_NONE;
+        };
+
+        struct PassResource {
+            std::string name;
+            ExecuteFunction execute;
+            std::vector<ImageUse> uses;
+            bool sideEffects = false;
+
+            // Filled in by Compile.
+            bool culled = false;
+            std::vector<VkImageMemoryBarrier2> barriers;
+            std::vector<std::uint32_t> barrierImages;
+            // Attachment infos with the views left out, as imported images change every frame.
+            std::vector<VkRenderingAttachmentInfoKHR> colorAttachments;
+            std::vector<std::uint32_t> colorImages;
+            std::optional<VkRenderingAttachmentInfoKHR> depthAttachment;
+            std::uint32_t depthImage = 0;
+        };
+
+        struct Heap {
+            std::uint32_t memoryTypeIndex = 0;
+            VkDeviceSize size = 0;
+            VkDeviceSize alignment = 1;
+            Allocation allocation;
+        };
+
+        ImageUse& AddUse(RenderGraphPass pass, RenderGraphImage image, ImageAccess access, bool write);
+        void CullPasses();
+        void CreateTransientImages();
+        void PlaceTransientImages();
+        void DeriveBarriers();
+        void PrepareAttachments();
+        void DestroyCompiledResources();
+        void RecordBarriers(VkCommandBuffer commandBuffer, std::vector<VkImageMemoryBarrier2>& barriers,
+                            const std::vector<std::uint32_t>& barrierImages);
+
+        VkDevice logicalDevice = VK_NULL_HANDLE;
+        MemoryAllocator& allocator;
+        DeviceFunctions functions;
+        HostAllocator* hostAllocator = nullptr;
+
+        std::vector<ImageResource> images;
+        std::vector<PassResource> passes;
+        std::vector<Heap> heaps;
+        std::vector<VkImageMemoryBarrier2> finalBarriers;
+        std::vector<std::uint32_t> finalBarrierImages;
+        RenderGraphStats stats;
+        bool compiled = false;
+    };
+}
@@ -0,0 +1,309 @@
+#include <precomp.h>
+#include <scene.h>
+#include <job_system.h>
+#include <profiler.h>
+#include <spdlog/spdlog.h>
+#include <numeric>
+
+namespace veng {
+
+    using AffineRows = std::array<glm::vec4, 3>;
+
+    static const AffineRows kIdentityRows = {glm::vec4(1.0f, 0.0f, 0.0f, 0.0f), glm::vec4(0.0f, 1.0f, 0.0f, 0.0f),
+                                             glm::vec4(0.0f, 0.0f, 1.0f, 0.0f)};
+
+    // Translation * rotation * scale as the rows InstanceData stores.
+    static AffineRows ComposeTransform(glm::vec3 position, const glm::quat& rotation, glm::vec3 scale) {
+        // glm matrices are column-major, so r[column][row].
+        const glm::mat3 r = glm::mat3_cast(rotation);
+        return {glm::vec4(r[0][0] * scale.x, r[1][0] * scale.y, r[2][0] * scale.z, position.x),
+                glm::vec4(r[0][1] * scale.x, r[1][1] * scale.y, r[2][1] * scale.z, position.y),
+                glm::vec4(r[0][2] * scale.x, r[1][2] * scale.y, r[2][2] * scale.z, position.z)};
+    }
+
+    // parent * child for affine transforms, with the implicit fourth row (0, 0, 0, 1).
+    static AffineRows Multiply(const AffineRows& parent, const AffineRows& child) {
+        AffineRows result;
+        for (std::size_t row = 0; row < 3; ++row) {
+            result[row] = child[0] * parent[row].x + child[1] * parent[row].y + child[2] * parent[row].z +
+                          glm::vec4(0.0f, 0.0f, 0.0f, parent[row].w);
+        }
+        return result;
+    }
+
+    template <typename T>
+    static void Gather(std::vector<T>& values, gsl::span<const std::uint32_t> order) {
+        std::vector<T> gathered(order.size());
+        for (std::size_t i = 0; i < order.size(); ++i) {
+            gathered[i] = values[order[i]];
+        }
+        values.swap(gathered);
+    }
+
+    Scene::Scene(std::uint32_t outputCopies)
+        : outputCopies(std::clamp(outputCopies, 1u, static_cast<std::uint32_t>(std::numeric_limits<std::uint8_t>::max()))) {
+    }
+
+    SceneNode Scene::CreateNode(SceneNode parent) {
+        std::uint32_t parentIndex = kNoParent;
+        std::uint32_t depth = 0;
+        if (parent.IsValid()) {
+            parentIndex = GetDenseIndex(parent);
+            if (parentIndex == kNoParent) return {};
+            depth = depths[parentIndex] + 1;
+        }
+
+        std::uint32_t id = 0;
+        if (!freeIds.empty()) {
+            id = freeIds.back();
+            freeIds.pop_back();
+        } else {
+            id = static_cast<std::uint32_t>(sparse.size());
+            sparse.push_back(kNoParent);
+            generations.push_back(0);
+        }
+
+        // Appending a node shallower than the last one breaks the depth order until the next sort.
+        if (!depths.empty() && depth < depths.back()) {
+            sorted = false;
+        }
+
+        sparse[id] = static_cast<std::uint32_t>(ids.size());
+        ids.push_back(id);
+        parents.push_back(parentIndex);
+        depths.push_back(depth);
+        positions.push_back(glm::vec3(0.0f));
+        rotations.push_back(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+        scales.push_back(glm::vec3(1.0f));
+        colors.push_back(glm::vec4(1.0f));
+        worlds.push_back(kIdentityRows);
+        localDirty.push_back(1);
+        worldChanged.push_back(0);
+        pendingWrites.push_back(0);
+        structureChanged = true;
+
+        return SceneNode{id, generations[id]};
+    }
+
+    void Scene::DestroyNode(SceneNode node) {
+        const std::uint32_t index = GetDenseIndex(node);
+        if (index == kNoParent) return;
+
+        // In depth order a single pass finds the whole subtree, as parents are marked before their children.
+        if (!sorted) {
+            SortByDepth();
+        }
+        const std::uint32_t destroyIndex = sparse[node.id];
+
+        std::vector<std::uint8_t> destroyed(ids.size(), 0);
+        destroyed[destroyIndex] = 1;
+        for (std::size_t i = destroyIndex + 1; i < ids.size(); ++i) {
+            destroyed[i] = parents[i] != kNoParent && destroyed[parents[i]] != 0 ? 1 : 0;
+        }
+
+        // Keeping the survivors in order keeps them sorted.
+        std::vector<std::uint32_t> order;
+        order.reserve(ids.size());
+        for (std::uint32_t i = 0; i < ids.size(); ++i) {
+            if (destroyed[i] != 0) {
+                sparse[ids[i]] = kNoParent;
+                ++generations[ids[i]];
+                freeIds.push_back(ids[i]);
+            } else {
+                order.push_back(i);
+            }
+        }
+        Permute(order);
+    }
+
+    bool Scene::IsAlive(SceneNode node) const {
+        return node.IsValid() && node.id < sparse.size() && generations[node.id] == node.generation && sparse[node.id] != kNoParent;
+    }
+
+    std::uint32_t Scene::GetDenseIndex(SceneNode node) const {
+        if (!IsAlive(node)) {
+            spdlog::error("Scene node {} (generation {}) is not alive", node.id, node.generation);
+            return kNoParent;
+        }
+        return sparse[node.id];
+    }
+
+    SceneNode Scene::GetParent(SceneNode node) const {
+        const std::uint32_t index = GetDenseIndex(node);
+        if (index == kNoParent || parents[index] == kNoParent) return {};
+        const std::uint32_t parentId = ids[parents[index]];
+        return SceneNode{parentId, generations[parentId]};
+    }
+
+    glm::vec3 Scene::GetPosition(SceneNode node) const {
+        const std::uint32_t index = GetDenseIndex(node);
+        return index != kNoParent ? positions[index] : glm::vec3(0.0f);
+    }
+
+    glm::quat Scene::GetRotation(SceneNode node) const {
+        const std::uint32_t index = GetDenseIndex(node);
+        return index != kNoParent ? rotations[index] : glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    }
+
+    glm::vec3 Scene::GetScale(SceneNode node) const {
+        const std::uint32_t index = GetDenseIndex(node);
+        return index != kNoParent ? scales[index] : glm::vec3(1.0f);
+    }
+
+    const std::array<glm::vec4, 3>& Scene::GetWorldTransform(SceneNode node) const {
+        const std::uint32_t index = GetDenseIndex(node);
+        return index != kNoParent ? worlds[index] : kIdentityRows;
+    }
+
+    std::uint32_t Scene::GetInstanceIndex(SceneNode node) const {
+        const std::uint32_t index = GetDenseIndex(node);
+        return index != kNoParent ? index : SceneNode::kInvalid;
+    }
+
+    void Scene::SetPosition(SceneNode node, glm::vec3 position) {
+        const std::uint32_t index = GetDenseIndex(node);
+        if (index == kNoParent) return;
+        positions[index] = position;
+        localDirty[index] = 1;
+    }
+
+    void Scene::SetRotation(SceneNode node, glm::quat rotation) {
+        const std::uint32_t index = GetDenseIndex(node);
+        if (index == kNoParent) return;
+        rotations[index] = rotation;
+        localDirty[index] = 1;
+    }
+
+    void Scene::SetScale(SceneNode node, glm::vec3 scale) {
+        const std::uint32_t index = GetDenseIndex(node);
+        if (index == kNoParent) return;
+        scales[index] = scale;
+        localDirty[index] = 1;
+    }
+
+    void Scene::SetColor(SceneNode node, glm::vec4 color) {
+        const std::uint32_t index = GetDenseIndex(node);
+        if (index == kNoParent) return;
+        // Colour does not affect the hierarchy, only the node's own instance.
+        colors[index] = color;
+        pendingWrites[index] = static_cast<std::uint8_t>(outputCopies);
+    }
+
+    void Scene::SortByDepth() {
+        // Counting sort; stable, so siblings keep their creation order.
+        const std::uint32_t maxDepth = depths.empty() ? 0 : *std::max_element(depths.begin(), depths.end());
+        std::vector<std::uint32_t> offsets(maxDepth + 2, 0);
+        for (std::uint32_t depth : depths) {
+            ++offsets[depth + 1];
+        }
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+        std::vector<std::uint32_t> order(ids.size());
+        for (std::uint32_t i = 0; i < ids.size(); ++i) {
+            order[offsets[depths[i]]++] = i;
+        }
+        Permute(order);
+        sorted = true;
+    }
+
+    void Scene::Permute(gsl::span<const std::uint32_t> order) {
+        std::vector<std::uint32_t> newIndex(ids.size(), kNoParent);
+        for (std::uint32_t i = 0; i < order.size(); ++i) {
+            newIndex[order[i]] = i;
+        }
+
+        Gather(ids, order);
+        Gather(parents, order);
+        Gather(depths, order);
+        Gather(positions, order);
+        Gather(rotations, order);
+        Gather(scales, order);
+        Gather(colors, order);
+        Gather(worlds, order);
+        Gather(localDirty, order);
+        Gather(worldChanged, order);
+        Gather(pendingWrites, order);
+
+        for (std::uint32_t i = 0; i < ids.size(); ++i) {
+            if (parents[i] != kNoParent) {
+                parents[i] = newIndex[parents[i]];
+            }
+            sparse[ids[i]] = i;
+        }
+        structureChanged = true;
+    }
+
+    void Scene::RebuildLevels() {
+        levelOffsets.clear();
+        for (std::uint32_t i = 0; i < ids.size(); ++i) {
+            while (levelOffsets.size() <= depths[i]) {
+                levelOffsets.push_back(i);
+            }
+        }
+        levelOffsets.push_back(static_cast<std::uint32_t>(ids.size()));
+    }
+
+    void Scene::MarkAllForWrite() {
+        // Slots moved, so every output has stale instances.
+        std::fill(pendingWrites.begin(), pendingWrites.end(), static_cast<std::uint8_t>(outputCopies));
+    }
+
+    SceneUpdateStats Scene::Update(gsl::span<InstanceData> instances) {
+        VENG_PROFILE_FUNCTION();
+        SceneUpdateStats stats;
+        if (instances.size() < ids.size()) {
+            spdlog::error("Scene has {} nodes but only {} instances to write to", ids.size(), instances.size());
+            return stats;
+        }
+
+        if (!sorted) {
+            SortByDepth();
+        }
+        if (structureChanged) {
+            RebuildLevels();
+            MarkAllForWrite();
+            structureChanged = false;
+        }
+
+        std::atomic<std::uint32_t> recomputedCount = 0;
+        std::atomic<std::uint32_t> writtenCount = 0;
+        stats.levelCount = levelOffsets.empty() ? 0 : static_cast<std::uint32_t>(levelOffsets.size()) - 1;
+
+        // A level only reads the world transforms of the one above, which is complete by the time it starts.
+        for (std::uint32_t level = 0; level < stats.levelCount; ++level) {
+            const std::uint32_t levelStart = levelOffsets[level];
+            const std::uint32_t levelSize = levelOffsets[level + 1] - levelStart;
+
+            JobSystem::Get().ParallelFor(levelSize, kGrainSize, [&, levelStart](std::uint32_t first, std::uint32_t last) {
+                std::uint32_t recomputed = 0;
+                std::uint32_t written = 0;
+                for (std::uint32_t i = levelStart + first; i < levelStart + last; ++i) {
+                    const std::uint32_t parent = parents[i];
+                    const bool changed = localDirty[i] != 0 || (parent != kNoParent && worldChanged[parent] != 0);
+                    worldChanged[i] = changed ? 1 : 0;
+
+                    if (changed) {
+                        const AffineRows local = ComposeTransform(positions[i], rotations[i], scales[i]);
+                        worlds[i] = parent == kNoParent ? local : Multiply(worlds[parent], local);
+                        localDirty[i] = 0;
+                        pendingWrites[i] = static_cast<std::uint8_t>(outputCopies);
+                        ++recomputed;
+                    }
+
+                    if (pendingWrites[i] > 0) {
+                        instances[i].transform = worlds[i];
+                        instances[i].color = colors[i];
+                        --pendingWrites[i];
+                        ++written;
+                    }
+                }
+                recomputedCount.fetch_add(recomputed, std::memory_order_relaxed);
+                writtenCount.fetch_add(written, std::memory_order_relaxed);
+            });
+        }
+
+        stats.recomputedCount = recomputedCount.load(std::memory_order_relaxed);
+        stats.writtenCount = writtenCount.load(std::memory_order_relaxed);
+        return stats;
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <glm/gtc/quaternion.hpp>
+#include <instance_buffer.h>
+
+namespace veng {
+
+    // Handle of a scene node. The generation tells a live node from one that reused a destroyed node's id.
+    struct SceneNode {
+        static constexpr std::uint32_t kInvalid = std::numeric_limits<std::uint32_t>::max();
+        std::uint32_t id = kInvalid;
+        std::uint32_t generation = 0;
+
+        bool IsValid() const { return id != kInvalid; }
+    };
+
+    struct SceneUpdateStats {
+        // Nodes whose world transform changed, including descendants of the nodes that were moved.
+        std::uint32_t recomputedCount = 0;
+        std::uint32_t writtenCount = 0;
+        std::uint32_t levelCount = 0;
+    };
+
+    // Nodes with a local transform, a colour and an optional parent. Node ids map to dense slots through a sparse
+    // set; the dense slots are stored as structure of arrays sorted by depth, so every parent precedes its children
+    // and the nodes of one level are updated in parallel once the level above is done. Only nodes that were changed
+    // and their descendants recompute their world transform.
+    //
+    // The dense slot is also the node's instance: Update writes InstanceData for slot i to instances[i]. Each slot
+    // is written to outputCopies consecutive outputs after it changes, so with one output per frame in flight
+    // (e.g. the frame's InstanceBuffer range, allocated first every frame so it lands in the same place) every copy
+    // stays current without rewriting unchanged nodes.
+    class Scene final {
+    public:
+        explicit Scene(std::uint32_t outputCopies = 1);
+
+        // The parent must be alive. Structural changes take effect at the next Update.
+        SceneNode CreateNode(SceneNode parent = {});
+        // Destroys the node and its descendants. Compacts the dense arrays, so it costs O(nodes); batch structural
+        // changes between updates.
+        void DestroyNode(SceneNode node);
+        bool IsAlive(SceneNode node) const;
+
+        void SetPosition(SceneNode node, glm::vec3 position);
+        void SetRotation(SceneNode node, glm::quat rotation);
+        void SetScale(SceneNode node, glm::vec3 scale);
+        void SetColor(SceneNode node, glm::vec4 color);
+
+        // Getters log a node that is not alive and return the identity transform for it.
+        glm::vec3 GetPosition(SceneNode node) const;
+        glm::quat GetRotation(SceneNode node) const;
+        glm::vec3 GetScale(SceneNode node) const;
+        // Rows of the 3x4 world transform as of the last Update.
+        const std::array<glm::vec4, 3>& GetWorldTransform(SceneNode node) const;
+        // Where Update writes the node, SceneNode::kInvalid if it is not alive. Only stable between structural changes.
+        std::uint32_t GetInstanceIndex(SceneNode node) const;
+        SceneNode GetParent(SceneNode node) const;
+
+        // instances must hold at least GetNodeCount() elements and be the output passed outputCopies updates ago.
+        SceneUpdateStats Update(gsl::span<InstanceData> instances);
+
+        std::uint32_t GetNodeCount() const { return static_cast<std::uint32_t>(ids.size()); }
+
+    private:
+        static constexpr std::uint32_t kNoParent = std::numeric_limits<std::uint32_t>::max();
+        static constexpr std::uint32_t kGrainSize = 4096;
+
+        std::uint32_t GetDenseIndex(SceneNode node) const;
+        void SortByDepth();
+        // Moves dense slots so slot order[i] ends up at i, remapping parents and the sparse set.
+        void Permute(gsl::span<const std::uint32_t> order);
+        void RebuildLevels();
+        void MarkAllForWrite();
+
+        std::uint32_t outputCopies = 1;
+
+        // Sparse set: node id to dense slot, with recycled ids.
+        std::vector<std::uint32_t> sparse;
+        std::vector<std::uint32_t> generations;
+        std::vector<std::uint32_t> freeIds;
+
+        // Dense slots.
+        std::vector<std::uint32_t> ids;
+        std::vector<std::uint32_t> parents;
+        std::vector<std::uint32_t> depths;
+        std::vector<glm::vec3> positions;
+        std::vector<glm::quat> rotations;
+        std::vector<glm::vec3> scales;
+        std::vector<glm::vec4> colors;
+        std::vector<std::array<glm::vec4, 3>> worlds;
+        std::vector<std::uint8_t> localDirty;
+        std::vector<std::uint8_t> worldChanged;
+        // Outputs that still lack the slot's current instance data.
+        std::vector<std::uint8_t> pendingWrites;
+
+        // First dense slot of each depth, plus one past the last slot.
+        std::vector<std::uint32_t> levelOffsets;
+        bool sorted = true;
+        bool structureChanged = false;
+    };
+}
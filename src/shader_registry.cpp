@@ -0,0 +1,66 @@
+#include <precomp.h>
+#include <shader_registry.h>
+#include <spdlog/spdlog.h>
+
+#if defined(VENG_EMBEDDED_SHADERS)
+#include <embedded_shaders.h>
+#endif
+
+namespace veng {
+
+    ShaderRegistry::ShaderRegistry(VkDevice logicalDevice) : logicalDevice(logicalDevice) {
+    }
+
+    ShaderRegistry::~ShaderRegistry() {
+        for (auto& [name, shaderModule] : modules) {
+            vkDestroyShaderModule(logicalDevice, shaderModule, nullptr);
+        }
+    }
+
+    VkShaderModule ShaderRegistry::CreateModule(gsl::span<const std::uint32_t> code) {
+        VkShaderModuleCreateInfo info = {};
+        info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        info.codeSize = code.size_bytes();
+        info.pCode = code.data();
+
+        VkShaderModule shaderModule = VK_NULL_HANDLE;
+        VkResult result = vkCreateShaderModule(logicalDevice, &info, nullptr, &shaderModule);
+        if (result != VK_SUCCESS) {
+            return VK_NULL_HANDLE;
+        }
+
+        return shaderModule;
+    }
+
+    VkShaderModule ShaderRegistry::GetModule(std::string_view name) {
+        auto it = modules.find(std::string(name));
+        if (it != modules.end()) {
+            return it->second;
+        }
+
+        VkShaderModule shaderModule = VK_NULL_HANDLE;
+
+#if defined(VENG_EMBEDDED_SHADERS)
+        auto embeddedIt = std::find_if(kEmbeddedShaders.begin(), kEmbeddedShaders.end(),
+                                       [name](const EmbeddedShader& shader) { return shader.name == name; });
+        if (embeddedIt != kEmbeddedShaders.end()) {
+            shaderModule = CreateModule(embeddedIt->code);
+        }
+#else
+        std::vector<std::uint8_t> bytes = ReadFile(std::filesystem::path(".") / name);
+        if (!bytes.empty() && bytes.size() % sizeof(std::uint32_t) == 0) {
+            std::vector<std::uint32_t> words(bytes.size() / sizeof(std::uint32_t));
+            std::memcpy(words.data(), bytes.data(), bytes.size());
+            shaderModule = CreateModule(words);
+        }
+#endif
+
+        if (shaderModule == VK_NULL_HANDLE) {
+            spdlog::error("Cannot load shader {}", name);
+            return VK_NULL_HANDLE;
+        }
+
+        modules.emplace(name, shaderModule);
+        return shaderModule;
+    }
+}
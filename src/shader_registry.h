@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+namespace veng {
+
+    // Creates each shader module once per device and hands the same handle to every pipeline that asks for it.
+    // Modules come from the SPIR-V embedded at build time, or otherwise from .spv files in the working directory,
+    // which is where add_shaders writes them when run from the build directory.
+    class ShaderRegistry final {
+    public:
+        explicit ShaderRegistry(VkDevice logicalDevice);
+        ~ShaderRegistry();
+
+        ShaderRegistry(const ShaderRegistry&) = delete;
+        ShaderRegistry& operator=(const ShaderRegistry&) = delete;
+
+        VkShaderModule GetModule(std::string_view name);
+
+    private:
+        VkShaderModule CreateModule(gsl::span<const std::uint32_t> code);
+
+        VkDevice logicalDevice = VK_NULL_HANDLE;
+        std::unordered_map<std::string, VkShaderModule> modules;
+    };
+}
@@ -0,0 +1,146 @@
+#include <precomp.h>
+#include <uniform_allocator.h>
+#include <spdlog/spdlog.h>
+
+namespace veng {
+
+    static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    UniformAllocator::UniformAllocator(VkDevice logicalDevice, MemoryAllocator& allocator, const VkPhysicalDeviceLimits& limits,
+                                       std::uint32_t framesInFlight, VkDeviceSize frameCapacity)
+            : logicalDevice(logicalDevice), allocator(allocator),
+              alignment(std::max<VkDeviceSize>(limits.minUniformBufferOffsetAlignment, 1)),
+              retireTimelineValues(framesInFlight, 0) {
+        this->frameCapacity = AlignUp(frameCapacity, alignment);
+        regionSize = this->frameCapacity;
+
+        // The descriptor always spans kMaxAllocationSize from the dynamic offset, so the last region is padded to
+        // keep an allocation at its very end inside the buffer.
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = regionSize * framesInFlight + kMaxAllocationSize;
+        bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        VkResult result = vkCreateBuffer(logicalDevice, &bufferInfo, nullptr, &buffer);
+        if (result != VK_SUCCESS) {
+            std::exit(EXIT_FAILURE);
+        }
+
+        // Written once by the CPU and read a handful of times by the GPU, so coherent host memory is the cheapest
+        // place for it.
+        memory = allocator.AllocateForBuffer(buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        if (!memory.IsValid() || memory.mappedData == nullptr) {
+            spdlog::error("Cannot allocate {} bytes for the uniform allocator", bufferInfo.size);
+            std::exit(EXIT_FAILURE);
+        }
+
+        CreateDescriptorSet();
+    }
+
+    UniformAllocator::~UniformAllocator() {
+        vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+        vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
+        vkDestroyBuffer(logicalDevice, buffer, nullptr);
+        allocator.Free(memory);
+    }
+
+    void UniformAllocator::CreateDescriptorSet() {
+        VkDescriptorSetLayoutBinding binding = {};
+        binding.binding = 0;
+        binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        binding.descriptorCount = 1;
+        binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = 1;
+        layoutInfo.pBindings = &binding;
+
+        VkResult result = vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, nullptr, &descriptorSetLayout);
+        if (result != VK_SUCCESS) {
+            std::exit(EXIT_FAILURE);
+        }
+
+        VkDescriptorPoolSize poolSize = {};
+        poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        poolSize.descriptorCount = 1;
+
+        VkDescriptorPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.maxSets = 1;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+
+        result = vkCreateDescriptorPool(logicalDevice, &poolInfo, nullptr, &descriptorPool);
+        if (result != VK_SUCCESS) {
+            std::exit(EXIT_FAILURE);
+        }
+
+        VkDescriptorSetAllocateInfo allocateInfo = {};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocateInfo.descriptorPool = descriptorPool;
+        allocateInfo.descriptorSetCount = 1;
+        allocateInfo.pSetLayouts = &descriptorSetLayout;
+
+        result = vkAllocateDescriptorSets(logicalDevice, &allocateInfo, &descriptorSet);
+        if (result != VK_SUCCESS) {
+            std::exit(EXIT_FAILURE);
+        }
+
+        // Written once: every allocation is reached through the dynamic offset alone.
+        VkDescriptorBufferInfo bufferInfo = {};
+        bufferInfo.buffer = buffer;
+        bufferInfo.offset = 0;
+        bufferInfo.range = kMaxAllocationSize;
+
+        VkWriteDescriptorSet write = {};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = descriptorSet;
+        write.dstBinding = 0;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        write.pBufferInfo = &bufferInfo;
+
+        vkUpdateDescriptorSets(logicalDevice, 1, &write, 0, nullptr);
+    }
+
+    void UniformAllocator::BeginFrame(std::uint32_t frameIndex, std::uint64_t completedTimelineValue) {
+        if (retireTimelineValues[frameIndex] > completedTimelineValue) {
+            spdlog::error("Uniform region {} is still in use until timeline value {}, only {} has completed", frameIndex,
+                          retireTimelineValues[frameIndex], completedTimelineValue);
+            std::exit(EXIT_FAILURE);
+        }
+
+        this->frameIndex = frameIndex;
+        usedBytes = 0;
+    }
+
+    void UniformAllocator::EndFrame(std::uint64_t submittedTimelineValue) {
+        retireTimelineValues[frameIndex] = submittedTimelineValue;
+        highWaterMark = std::max(highWaterMark, usedBytes);
+    }
+
+    std::optional<UniformAllocation> UniformAllocator::Allocate(VkDeviceSize size) {
+        const VkDeviceSize offset = AlignUp(usedBytes, alignment);
+        if (size > kMaxAllocationSize || offset + size > frameCapacity) {
+            spdlog::error("Uniform allocator full: {} bytes requested, {} of {} used this frame", size, usedBytes, frameCapacity);
+            return std::nullopt;
+        }
+        usedBytes = offset + size;
+
+        const VkDeviceSize bufferOffset = regionSize * frameIndex + offset;
+
+        UniformAllocation allocation;
+        allocation.dynamicOffset = static_cast<std::uint32_t>(bufferOffset);
+        allocation.data = gsl::span<std::uint8_t>(static_cast<std::uint8_t*>(memory.mappedData) + bufferOffset, size);
+        return allocation;
+    }
+
+    void UniformAllocator::Bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout,
+                                std::uint32_t set, std::uint32_t dynamicOffset) const {
+        vkCmdBindDescriptorSets(commandBuffer, bindPoint, pipelineLayout, set, 1, &descriptorSet, 1, &dynamicOffset);
+    }
+}
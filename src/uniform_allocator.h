@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <memory_allocator.h>
+
+namespace veng {
+
+    // Uniform data written for the current frame. The dynamic offset is what the descriptor set is bound with to
+    // read it.
+    struct UniformAllocation {
+        std::uint32_t dynamicOffset = 0;
+        gsl::span<std::uint8_t> data;
+    };
+
+    // Persistently mapped uniform buffer with one region per frame in flight, handed out front to back. A region is
+    // reset as a whole once the timeline value of the frame that last used it has completed, so per-frame constants
+    // cost a copy into mapped memory and a dynamic offset, with no descriptor writes.
+    class UniformAllocator final {
+    public:
+        static constexpr VkDeviceSize kDefaultFrameCapacity = 4ull * 1024 * 1024;
+        // Largest single allocation, and the range of the descriptor. Every device supports 16 KiB.
+        static constexpr VkDeviceSize kMaxAllocationSize = 16 * 1024;
+
+        UniformAllocator(VkDevice logicalDevice, MemoryAllocator& allocator, const VkPhysicalDeviceLimits& limits,
+                         std::uint32_t framesInFlight, VkDeviceSize frameCapacity = kDefaultFrameCapacity);
+        ~UniformAllocator();
+
+        UniformAllocator(const UniformAllocator&) = delete;
+        UniformAllocator& operator=(const UniformAllocator&) = delete;
+
+        // completedTimelineValue must cover the frame that last used the region, which is then reused from the start.
+        void BeginFrame(std::uint32_t frameIndex, std::uint64_t completedTimelineValue);
+        // The region is in use until the frame's submission reaches this value.
+        void EndFrame(std::uint64_t submittedTimelineValue);
+
+        std::optional<UniformAllocation> Allocate(VkDeviceSize size);
+
+        // Copies value into this frame's region and returns its dynamic offset.
+        template <typename T>
+        std::optional<std::uint32_t> Push(const T& value) {
+            static_assert(std::is_trivially_copyable_v<T>, "Uniform data is copied byte for byte");
+            std::optional<UniformAllocation> allocation = Allocate(sizeof(T));
+            if (!allocation.has_value()) return std::nullopt;
+            std::memcpy(allocation->data.data(), &value, sizeof(T));
+            return allocation->dynamicOffset;
+        }
+
+        void Bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout, std::uint32_t set,
+                  std::uint32_t dynamicOffset) const;
+
+        VkDescriptorSetLayout GetDescriptorSetLayout() const { return descriptorSetLayout; }
+        VkDeviceSize GetAlignment() const { return alignment; }
+        VkDeviceSize GetFrameCapacity() const { return frameCapacity; }
+        VkDeviceSize GetUsedBytes() const { return usedBytes; }
+        // Most bytes any frame has used, alignment padding included.
+        VkDeviceSize GetHighWaterMark() const { return highWaterMark; }
+
+    private:
+        void CreateDescriptorSet();
+
+        VkDevice logicalDevice = VK_NULL_HANDLE;
+        MemoryAllocator& allocator;
+        VkDeviceSize alignment = 1;
+        VkDeviceSize frameCapacity = 0;
+        VkDeviceSize regionSize = 0;
+
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation memory;
+
+        VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+        VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+        VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+
+        std::vector<std::uint64_t> retireTimelineValues;
+        std::uint32_t frameIndex = 0;
+        VkDeviceSize usedBytes = 0;
+        VkDeviceSize highWaterMark = 0;
+    };
+}
@@ -0,0 +1,426 @@
+#include <precomp.h>
+#include <upload_service.h>
+#include <spdlog/spdlog.h>
+
+namespace veng {
+
+    UploadService::UploadService(VkDevice logicalDevice, MemoryAllocator& allocator, const DeviceFunctions& functions, VkQueue transferQueue,
+                                 std::uint32_t transferFamily, std::uint32_t graphicsFamily, VkDeviceSize ringSize,
+                                 HostAllocator* hostAllocator)
+            : logicalDevice(logicalDevice), allocator(allocator), functions(functions), hostAllocator(hostAllocator),
+              transferQueue(transferQueue), transferFamily(transferFamily), graphicsFamily(graphicsFamily), ringSize(ringSize) {
+
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = ringSize;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        VkResult result = vkCreateBuffer(logicalDevice, &bufferInfo, HostAllocator::GetCallbacks(hostAllocator, VK_OBJECT_TYPE_BUFFER),
+                                         &ringBuffer);
+        if (result != VK_SUCCESS) {
+            std::exit(EXIT_FAILURE);
+        }
+
+        ringAllocation = allocator.AllocateForBuffer(ringBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        if (!ringAllocation.IsValid() || ringAllocation.mappedData == nullptr) {
+            spdlog::error("Cannot allocate the staging ring buffer");
+            std::exit(EXIT_FAILURE);
+        }
+
+        for (Batch& batch : batches) {
+            VkCommandPoolCreateInfo poolInfo = {};
+            poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+            poolInfo.queueFamilyIndex = transferFamily;
+
+            result = vkCreateCommandPool(logicalDevice, &poolInfo, HostAllocator::GetCallbacks(hostAllocator, VK_OBJECT_TYPE_COMMAND_POOL),
+                                         &batch.commandPool);
+            if (result != VK_SUCCESS) {
+                std::exit(EXIT_FAILURE);
+            }
+
+            VkCommandBufferAllocateInfo allocateInfo = {};
+            allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocateInfo.commandPool = batch.commandPool;
+            allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocateInfo.commandBufferCount = 1;
+
+            result = vkAllocateCommandBuffers(logicalDevice, &allocateInfo, &batch.commandBuffer);
+            if (result != VK_SUCCESS) {
+                std::exit(EXIT_FAILURE);
+            }
+        }
+
+        VkSemaphoreTypeCreateInfo timelineInfo = {};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        timelineInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreInfo = {};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &timelineInfo;
+
+        result = vkCreateSemaphore(logicalDevice, &semaphoreInfo, HostAllocator::GetCallbacks(hostAllocator, VK_OBJECT_TYPE_SEMAPHORE),
+                                   &timeline);
+        if (result != VK_SUCCESS) {
+            std::exit(EXIT_FAILURE);
+        }
+
+        spdlog::info("Uploads use {} transfer queue (family {})", HasDedicatedQueue() ? "a dedicated" : "the graphics", transferFamily);
+    }
+
+    UploadService::~UploadService() {
+        WaitIdle();
+
+        vkDestroySemaphore(logicalDevice, timeline, HostAllocator::GetCallbacks(hostAllocator, VK_OBJECT_TYPE_SEMAPHORE));
+        for (Batch& batch : batches) {
+            vkDestroyCommandPool(logicalDevice, batch.commandPool, HostAllocator::GetCallbacks(hostAllocator, VK_OBJECT_TYPE_COMMAND_POOL));
+        }
+
+        vkDestroyBuffer(logicalDevice, ringBuffer, HostAllocator::GetCallbacks(hostAllocator, VK_OBJECT_TYPE_BUFFER));
+        allocator.Free(ringAllocation);
+    }
+
+    void UploadService::WaitForTimelineValue(std::uint64_t value) {
+        VkSemaphoreWaitInfo waitInfo = {};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &timeline;
+        waitInfo.pValues = &value;
+
+        const VkResult result = vkWaitSemaphores(logicalDevice, &waitInfo, std::numeric_limits<std::uint64_t>::max());
+        if (result != VK_SUCCESS) {
+            spdlog::error("Cannot wait for upload timeline value {}", value);
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    void UploadService::WaitIdle() {
+        Flush();
+        WaitForTimelineValue(nextTimelineValue - 1);
+        ReclaimCompletedBatches();
+    }
+
+    void UploadService::ReclaimCompletedBatches() {
+        std::uint64_t completedValue = 0;
+        vkGetSemaphoreCounterValue(logicalDevice, timeline, &completedValue);
+
+        while (!inFlightBatches.empty() && inFlightBatches.front()->timelineValue <= completedValue) {
+            const VkDeviceSize batchEnd = inFlightBatches.front()->ringEnd;
+            const VkDeviceSize released = (batchEnd + ringSize - ringTail) % ringSize;
+            ringUsed -= (released == 0 && ringUsed == ringSize) ? ringSize : released;
+            ringTail = batchEnd;
+            inFlightBatches.pop_front();
+        }
+    }
+
+    std::optional<VkDeviceSize> UploadService::AllocateStaging(VkDeviceSize size) {
+        if (size > ringSize) {
+            spdlog::error("Upload of {} bytes does not fit in the {} byte staging ring", size, ringSize);
+            return std::nullopt;
+        }
+
+        ReclaimCompletedBatches();
+
+        for (;;) {
+            if (ringUsed == 0) {
+                ringHead = ringTail = 0;
+            }
+
+            // The used range runs from the tail to the head and includes alignment padding and the space skipped
+            // when wrapping, so it alone decides whether a range fits.
+            const VkDeviceSize alignedHead = (ringHead + kStagingAlignment - 1) & ~(kStagingAlignment - 1);
+            const VkDeviceSize padding = alignedHead - ringHead;
+            if (alignedHead + size <= ringSize && ringUsed + padding + size <= ringSize) {
+                ringHead = alignedHead + size;
+                ringUsed += padding + size;
+                return alignedHead;
+            }
+
+            const VkDeviceSize wrapWaste = ringSize - ringHead;
+            if (ringHead >= ringTail && ringUsed + wrapWaste + size <= ringSize) {
+                ringHead = size;
+                ringUsed += wrapWaste + size;
+                return 0;
+            }
+
+            // The ring is full: push out what has been recorded and wait for the oldest batch. Releases wait for
+            // the next Flush, as more chunks of the same resources may follow.
+            Submit();
+            if (inFlightBatches.empty()) {
+                return std::nullopt;
+            }
+            WaitForTimelineValue(inFlightBatches.front()->timelineValue);
+            ReclaimCompletedBatches();
+        }
+    }
+
+    UploadService::Batch& UploadService::GetRecordingBatch() {
+        Batch& batch = batches[currentBatch];
+        if (batch.recording) {
+            return batch;
+        }
+
+        WaitForTimelineValue(batch.timelineValue);
+        ReclaimCompletedBatches();
+
+        vkResetCommandPool(logicalDevice, batch.commandPool, 0);
+
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(batch.commandBuffer, &beginInfo);
+
+        batch.recording = true;
+        batch.timelineValue = nextTimelineValue;
+        return batch;
+    }
+
+    bool UploadService::UploadBuffer(VkBuffer destination, VkDeviceSize destinationOffset, gsl::span<const std::uint8_t> data) {
+        std::optional<VkDeviceSize> stagingOffset = AllocateStaging(data.size());
+        if (!stagingOffset.has_value()) {
+            return false;
+        }
+
+        std::memcpy(static_cast<std::uint8_t*>(ringAllocation.mappedData) + stagingOffset.value(), data.data(), data.size());
+
+        Batch& batch = GetRecordingBatch();
+
+        VkBufferCopy region = {};
+        region.srcOffset = stagingOffset.value();
+        region.dstOffset = destinationOffset;
+        region.size = data.size();
+        vkCmdCopyBuffer(batch.commandBuffer, ringBuffer, destination, 1, &region);
+
+        if (HasDedicatedQueue()) {
+            AddPendingRelease({destination, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_UNDEFINED});
+        }
+
+        batch.ringEnd = ringHead;
+        return true;
+    }
+
+    bool UploadService::UploadImage(VkImage destination, VkExtent3D extent, gsl::span<const std::uint8_t> data, VkImageLayout finalLayout) {
+        std::optional<VkDeviceSize> stagingOffset = AllocateStaging(data.size());
+        if (!stagingOffset.has_value()) {
+            return false;
+        }
+
+        std::memcpy(static_cast<std::uint8_t*>(ringAllocation.mappedData) + stagingOffset.value(), data.data(), data.size());
+
+        Batch& batch = GetRecordingBatch();
+
+        // The old contents are discarded, so the transition waits for nothing.
+        VkImageMemoryBarrier2KHR toTransfer = {};
+        toTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR;
+        toTransfer.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+        toTransfer.srcAccessMask = VK_ACCESS_2_NONE;
+        toTransfer.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+        toTransfer.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        toTransfer.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        toTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        toTransfer.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toTransfer.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        toTransfer.image = destination;
+        toTransfer.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+        VkDependencyInfoKHR dependency = {};
+        dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+        dependency.imageMemoryBarrierCount = 1;
+        dependency.pImageMemoryBarriers = &toTransfer;
+        functions.cmdPipelineBarrier2(batch.commandBuffer, &dependency);
+
+        VkBufferImageCopy region = {};
+        region.bufferOffset = stagingOffset.value();
+        region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        region.imageExtent = extent;
+        vkCmdCopyBufferToImage(batch.commandBuffer, ringBuffer, destination, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        if (HasDedicatedQueue()) {
+            // The release barrier also moves the image to finalLayout.
+            AddPendingRelease({VK_NULL_HANDLE, destination, finalLayout});
+        } else {
+            // Readers on the graphics queue wait on the upload timeline, which covers the transition as well.
+            VkImageMemoryBarrier2KHR transition = toTransfer;
+            transition.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+            transition.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+            transition.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+            transition.dstAccessMask = VK_ACCESS_2_NONE;
+            transition.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            transition.newLayout = finalLayout;
+
+            dependency.pImageMemoryBarriers = &transition;
+            functions.cmdPipelineBarrier2(batch.commandBuffer, &dependency);
+        }
+
+        batch.ringEnd = ringHead;
+        return true;
+    }
+
+    void UploadService::AddPendingRelease(const PendingRelease& release) {
+        const auto sameResource = [&release](const PendingRelease& pending) {
+            return pending.buffer == release.buffer && pending.image == release.image;
+        };
+        auto it = std::find_if(pendingReleases.begin(), pendingReleases.end(), sameResource);
+        if (it == pendingReleases.end()) {
+            pendingReleases.push_back(release);
+        } else {
+            it->layout = release.layout;
+        }
+    }
+
+    void UploadService::RecordReleaseBarriers(Batch& batch) {
+        // A release only orders the earlier copies on this queue before the ownership transfer, including copies in
+        // batches submitted before this one; the semaphore does the rest.
+        std::vector<VkBufferMemoryBarrier2KHR> bufferBarriers;
+        std::vector<VkImageMemoryBarrier2KHR> imageBarriers;
+
+        for (const PendingRelease& pending : pendingReleases) {
+            if (pending.buffer != VK_NULL_HANDLE) {
+                VkBufferMemoryBarrier2KHR release = {};
+                release.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2_KHR;
+                release.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+                release.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+                release.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+                release.dstAccessMask = VK_ACCESS_2_NONE;
+                release.srcQueueFamilyIndex = transferFamily;
+                release.dstQueueFamilyIndex = graphicsFamily;
+                release.buffer = pending.buffer;
+                release.offset = 0;
+                release.size = VK_WHOLE_SIZE;
+                bufferBarriers.push_back(release);
+            } else {
+                VkImageMemoryBarrier2KHR release = {};
+                release.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR;
+                release.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+                release.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+                release.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+                release.dstAccessMask = VK_ACCESS_2_NONE;
+                release.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                release.newLayout = pending.layout;
+                release.srcQueueFamilyIndex = transferFamily;
+                release.dstQueueFamilyIndex = graphicsFamily;
+                release.image = pending.image;
+                release.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+                imageBarriers.push_back(release);
+            }
+            pendingAcquires.push_back({pending.buffer, pending.image, pending.layout, batch.timelineValue});
+        }
+        pendingReleases.clear();
+
+        VkDependencyInfoKHR dependency = {};
+        dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+        dependency.bufferMemoryBarrierCount = static_cast<std::uint32_t>(bufferBarriers.size());
+        dependency.pBufferMemoryBarriers = bufferBarriers.data();
+        dependency.imageMemoryBarrierCount = static_cast<std::uint32_t>(imageBarriers.size());
+        dependency.pImageMemoryBarriers = imageBarriers.data();
+        functions.cmdPipelineBarrier2(batch.commandBuffer, &dependency);
+    }
+
+    void UploadService::Flush() {
+        if (!pendingReleases.empty()) {
+            RecordReleaseBarriers(GetRecordingBatch());
+        }
+        Submit();
+    }
+
+    void UploadService::Submit() {
+        Batch& batch = batches[currentBatch];
+        if (!batch.recording) return;
+
+        vkEndCommandBuffer(batch.commandBuffer);
+
+        VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &batch.timelineValue;
+
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &batch.commandBuffer;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &timeline;
+
+        VkResult result = vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE);
+        if (result != VK_SUCCESS) {
+            spdlog::error("Failed to submit uploads");
+            std::exit(EXIT_FAILURE);
+        }
+
+        batch.recording = false;
+        inFlightBatches.push_back(&batch);
+        ++nextTimelineValue;
+        currentBatch = (currentBatch + 1) % kBatchCount;
+    }
+
+    std::uint64_t UploadService::RecordAcquireBarriers(VkCommandBuffer graphicsCommandBuffer) {
+        // Everything that has been flushed so far is visible to the graphics queue once it waits for this value.
+        const std::uint64_t submittedValue = nextTimelineValue - 1;
+        if (submittedValue == acquiredTimelineValue) return 0;
+        acquiredTimelineValue = submittedValue;
+
+        // Uploaded buffers end up as vertex, index, storage or indirect data, and images are sampled; the acquire
+        // has to happen before any of those reads and nothing else.
+        constexpr VkPipelineStageFlags2 kBufferStages = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT |
+                                                        VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT |
+                                                        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+        constexpr VkAccessFlags2 kBufferAccess = VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_INDEX_READ_BIT |
+                                                 VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+        constexpr VkPipelineStageFlags2 kImageStages = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+
+        std::vector<VkBufferMemoryBarrier2KHR> bufferBarriers;
+        std::vector<VkImageMemoryBarrier2KHR> imageBarriers;
+
+        auto isSubmitted = [submittedValue](const PendingAcquire& acquire) { return acquire.timelineValue <= submittedValue; };
+
+        for (const PendingAcquire& acquire : pendingAcquires) {
+            if (!isSubmitted(acquire)) continue;
+
+            if (acquire.buffer != VK_NULL_HANDLE) {
+                VkBufferMemoryBarrier2KHR barrier = {};
+                barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2_KHR;
+                barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+                barrier.srcAccessMask = VK_ACCESS_2_NONE;
+                barrier.dstStageMask = kBufferStages;
+                barrier.dstAccessMask = kBufferAccess;
+                barrier.srcQueueFamilyIndex = transferFamily;
+                barrier.dstQueueFamilyIndex = graphicsFamily;
+                barrier.buffer = acquire.buffer;
+                barrier.offset = 0;
+                barrier.size = VK_WHOLE_SIZE;
+                bufferBarriers.push_back(barrier);
+            } else {
+                VkImageMemoryBarrier2KHR barrier = {};
+                barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR;
+                barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+                barrier.srcAccessMask = VK_ACCESS_2_NONE;
+                barrier.dstStageMask = kImageStages;
+                barrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+                barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                barrier.newLayout = acquire.layout;
+                barrier.srcQueueFamilyIndex = transferFamily;
+                barrier.dstQueueFamilyIndex = graphicsFamily;
+                barrier.image = acquire.image;
+                barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+                imageBarriers.push_back(barrier);
+            }
+        }
+
+        std::erase_if(pendingAcquires, isSubmitted);
+
+        if (!bufferBarriers.empty() || !imageBarriers.empty()) {
+            VkDependencyInfoKHR dependency = {};
+            dependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+            dependency.bufferMemoryBarrierCount = bufferBarriers.size();
+            dependency.pBufferMemoryBarriers = bufferBarriers.data();
+            dependency.imageMemoryBarrierCount = imageBarriers.size();
+            dependency.pImageMemoryBarriers = imageBarriers.data();
+            functions.cmdPipelineBarrier2(graphicsCommandBuffer, &dependency);
+        }
+
+        return submittedValue;
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <memory_allocator.h>
+#include <device_functions.h>
+#include <host_allocator.h>
+
+namespace veng {
+
+    // Streams data into device-local resources through a persistently mapped staging ring. Copies are batched
+    // and submitted on the transfer queue; when that queue belongs to its own family, ownership of the results is
+    // released there and acquired by the graphics queue in the next frame.
+    class UploadService final {
+    public:
+        static constexpr VkDeviceSize kDefaultRingSize = 32ull * 1024 * 1024;
+
+        UploadService(VkDevice logicalDevice, MemoryAllocator& allocator, const DeviceFunctions& functions, VkQueue transferQueue,
+                      std::uint32_t transferFamily, std::uint32_t graphicsFamily, VkDeviceSize ringSize = kDefaultRingSize,
+                      HostAllocator* hostAllocator = nullptr);
+        ~UploadService();
+
+        UploadService(const UploadService&) = delete;
+        UploadService& operator=(const UploadService&) = delete;
+
+        bool UploadBuffer(VkBuffer destination, VkDeviceSize destinationOffset, gsl::span<const std::uint8_t> data);
+        bool UploadImage(VkImage destination, VkExtent3D extent, gsl::span<const std::uint8_t> data, VkImageLayout finalLayout);
+
+        // Submits the recorded copies. With a dedicated transfer queue this also releases every resource written
+        // since the last Flush, once per resource, after all of its copies.
+        void Flush();
+        std::uint64_t RecordAcquireBarriers(VkCommandBuffer graphicsCommandBuffer);
+        void WaitIdle();
+
+        VkSemaphore GetTimeline() const { return timeline; }
+        bool HasDedicatedQueue() const { return transferFamily != graphicsFamily; }
+
+    private:
+        struct Batch {
+            VkCommandPool commandPool = VK_NULL_HANDLE;
+            VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+            std::uint64_t timelineValue = 0;
+            VkDeviceSize ringEnd = 0;
+            bool recording = false;
+        };
+
+        struct PendingAcquire {
+            VkBuffer buffer = VK_NULL_HANDLE;
+            VkImage image = VK_NULL_HANDLE;
+            VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            std::uint64_t timelineValue = 0;
+        };
+
+        static constexpr std::uint32_t kBatchCount = 4;
+        static constexpr VkDeviceSize kStagingAlignment = 16;
+
+        struct PendingRelease {
+            VkBuffer buffer = VK_NULL_HANDLE;
+            VkImage image = VK_NULL_HANDLE;
+            VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        };
+
+        std::optional<VkDeviceSize> AllocateStaging(VkDeviceSize size);
+        void AddPendingRelease(const PendingRelease& release);
+        void RecordReleaseBarriers(Batch& batch);
+        void Submit();
+        void ReclaimCompletedBatches();
+        void WaitForTimelineValue(std::uint64_t value);
+        Batch& GetRecordingBatch();
+
+        VkDevice logicalDevice = VK_NULL_HANDLE;
+        MemoryAllocator& allocator;
+        DeviceFunctions functions;
+        // Creates a buffer, command pools and a semaphore, so the callbacks are looked up per object type.
+        HostAllocator* hostAllocator = nullptr;
+        VkQueue transferQueue = VK_NULL_HANDLE;
+        std::uint32_t transferFamily = 0;
+        std::uint32_t graphicsFamily = 0;
+
+        VkBuffer ringBuffer = VK_NULL_HANDLE;
+        Allocation ringAllocation;
+        VkDeviceSize ringSize = 0;
+        VkDeviceSize ringHead = 0;
+        VkDeviceSize ringTail = 0;
+        VkDeviceSize ringUsed = 0;
+
+        std::array<Batch, kBatchCount> batches;
+        std::uint32_t currentBatch = 0;
+        std::deque<Batch*> inFlightBatches;
+
+        VkSemaphore timeline = VK_NULL_HANDLE;
+        std::uint64_t nextTimelineValue = 1;
+        std::uint64_t acquiredTimelineValue = 0;
+
+        // Resources copied to but not yet released. A batch submitted early because the staging ring filled up
+        // leaves them here, so a resource uploaded in chunks across batches is still released only once.
+        std::vector<PendingRelease> pendingReleases;
+        std::vector<PendingAcquire> pendingAcquires;
+    };
+}
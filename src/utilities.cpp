@@ -6,4 +6,26 @@ namespace veng {
     bool streq(gsl::czstring left, gsl::czstring right){
         return std::strcmp(left, right) == 0;
     }
+
+    std::vector<std::uint8_t> ReadFile(std::filesystem::path filePath) {
+        std::ifstream file(filePath, std::ios::binary);
+        if (!file.is_open()) {
+            return {};
+        }
+
+        std::error_code error;
+        const std::uintmax_t fileSize = std::filesystem::file_size(filePath, error);
+        if (error) {
+            return {};
+        }
+
+        std::vector<std::uint8_t> buffer(fileSize);
+        file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(fileSize));
+
+        // A file that shrank after its size was read comes back short; callers treat empty as missing.
+        if (!file || static_cast<std::uintmax_t>(file.gcount()) != fileSize) {
+            return {};
+        }
+        return buffer;
+    }
 }
\ No newline at end of file
@@ -3,4 +3,5 @@
 namespace veng {
 
     bool streq(gsl::czstring left, gsl::czstring right);
+    std::vector<std::uint8_t> ReadFile(std::filesystem::path filePath);
 }
\ No newline at end of file
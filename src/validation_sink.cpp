@@ -0,0 +1,188 @@
+#include <precomp.h>
+#include <validation_sink.h>
+#include <profiler.h>
+#include <spdlog/spdlog.h>
+#include <csignal>
+#include <cstring>
+
+namespace veng {
+
+    static void TriggerBreakpoint() {
+#if defined(_MSC_VER)
+        __debugbreak();
+#elif defined(SIGTRAP)
+        std::raise(SIGTRAP);
+#else
+        std::abort();
+#endif
+    }
+
+    ValidationSink::ValidationSink(std::uint32_t messagesPerSecondPerId) : messagesPerSecondPerId(messagesPerSecondPerId) {
+        for (std::size_t i = 0; i < ring.size(); ++i) {
+            ring[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        worker = std::jthread([this](std::stop_token stopToken) { Run(stopToken); });
+    }
+
+    ValidationSink::~ValidationSink() {
+        worker.request_stop();
+        if (worker.joinable()) worker.join();
+        Drain();
+
+        for (const auto& [key, counter] : counters) {
+            if (counter.suppressed > 0) {
+                spdlog::warn("Vulkan validation message {} ({:#x}) was suppressed {} of {} times", key.first,
+                             static_cast<std::uint32_t>(key.second), counter.suppressed, counter.total);
+            }
+        }
+
+        const std::uint64_t dropped = droppedCount.load(std::memory_order_relaxed);
+        if (dropped > 0) {
+            spdlog::warn("Dropped {} validation messages because the ring was full, the counts above do not include them", dropped);
+            std::uint64_t attributed = 0;
+            for (const DroppedCounter& entry : droppedById) {
+                const std::uint64_t key = entry.key.load(std::memory_order_relaxed);
+                if (key == 0) continue;
+                const std::uint64_t count = entry.count.load(std::memory_order_relaxed);
+                spdlog::warn("  {} dropped with message ID {:#x}", count, static_cast<std::uint32_t>(key));
+                attributed += count;
+            }
+            if (attributed < dropped) {
+                spdlog::warn("  {} dropped with message IDs that were not tracked", dropped - attributed);
+            }
+        }
+    }
+
+    void ValidationSink::SetErrorHook(ErrorHook hook) {
+        std::lock_guard lock(errorHookMutex);
+        errorHook = std::move(hook);
+        hasErrorHook.store(static_cast<bool>(errorHook), std::memory_order_release);
+    }
+
+    void ValidationSink::SetBreakOnError(bool enabled) {
+        SetErrorHook(enabled ? ErrorHook([](const ValidationMessage&) { TriggerBreakpoint(); }) : ErrorHook());
+    }
+
+    static void CopyMessage(ValidationMessage& message, VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+                            const VkDebugUtilsMessengerCallbackDataEXT& data) {
+        message.messageId = data.messageIdNumber;
+        message.severity = severity;
+
+        const char* idName = data.pMessageIdName != nullptr ? data.pMessageIdName : "";
+        std::strncpy(message.idName.data(), idName, message.idName.size() - 1);
+        message.idName.back() = '\0';
+
+        const char* text = data.pMessage != nullptr ? data.pMessage : "";
+        std::strncpy(message.text.data(), text, message.text.size() - 1);
+        message.text.back() = '\0';
+        // The copy only fills every byte when the source is at least that long; the next source byte then decides.
+        message.truncated = message.text[message.text.size() - 2] != '\0' && text[message.text.size() - 1] != '\0';
+    }
+
+    void ValidationSink::CountDropped(std::int32_t messageId) {
+        const std::uint64_t key = (1ull << 32) | static_cast<std::uint32_t>(messageId);
+        const std::size_t start = static_cast<std::uint32_t>(messageId) % droppedById.size();
+        for (std::size_t i = 0; i < droppedById.size(); ++i) {
+            DroppedCounter& entry = droppedById[(start + i) % droppedById.size()];
+            std::uint64_t current = entry.key.load(std::memory_order_relaxed);
+            if (current == 0 && entry.key.compare_exchange_strong(current, key, std::memory_order_relaxed)) {
+                current = key;
+            }
+            if (current == key) {
+                entry.count.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+    }
+
+    void ValidationSink::Push(VkDebugUtilsMessageSeverityFlagBitsEXT severity, const VkDebugUtilsMessengerCallbackDataEXT& data) {
+        // Bounded multi-producer ring: each slot's sequence tells producers whether it is free for their position.
+        std::size_t position = enqueuePosition.load(std::memory_order_relaxed);
+        Slot* slot = nullptr;
+        while (true) {
+            slot = &ring[position % ring.size()];
+            const std::size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            const auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+            if (difference == 0) {
+                if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            } else if (difference < 0) {
+                droppedCount.fetch_add(1, std::memory_order_relaxed);
+                CountDropped(data.messageIdNumber);
+                slot = nullptr;
+                break;
+            } else {
+                position = enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+
+        if (slot != nullptr) {
+            CopyMessage(slot->message, severity, data);
+            slot->sequence.store(position + 1, std::memory_order_release);
+        }
+
+        if ((severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) && hasErrorHook.load(std::memory_order_acquire)) {
+            ValidationMessage message;
+            CopyMessage(message, severity, data);
+
+            std::lock_guard lock(errorHookMutex);
+            if (errorHook) {
+                errorHook(message);
+            }
+        }
+    }
+
+    bool ValidationSink::TryPop(ValidationMessage& message) {
+        Slot& slot = ring[dequeuePosition % ring.size()];
+        if (slot.sequence.load(std::memory_order_acquire) != dequeuePosition + 1) return false;
+
+        message = slot.message;
+        slot.sequence.store(dequeuePosition + ring.size(), std::memory_order_release);
+        ++dequeuePosition;
+        return true;
+    }
+
+    void ValidationSink::Drain() {
+        ValidationMessage message;
+        while (TryPop(message)) {
+            Log(message);
+        }
+    }
+
+    void ValidationSink::Log(const ValidationMessage& message) {
+        const auto now = std::chrono::steady_clock::now();
+        MessageCounter& counter = counters[MessageKey(message.idName.data(), message.messageId)];
+        ++counter.total;
+
+        if (now - counter.windowStart >= std::chrono::seconds(1)) {
+            if (counter.suppressedThisWindow > 0) {
+                spdlog::warn("Vulkan validation message {} ({:#x}) repeated {} more times", message.idName.data(),
+                             static_cast<std::uint32_t>(message.messageId), counter.suppressedThisWindow);
+            }
+            counter.windowStart = now;
+            counter.loggedThisWindow = 0;
+            counter.suppressedThisWindow = 0;
+        }
+
+        if (counter.loggedThisWindow >= messagesPerSecondPerId) {
+            ++counter.suppressed;
+            ++counter.suppressedThisWindow;
+            return;
+        }
+        ++counter.loggedThisWindow;
+
+        const gsl::czstring truncatedMarker = message.truncated ? " [truncated]" : "";
+        if (message.severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
+            spdlog::warn("Vulkan Validation: {}{}", message.text.data(), truncatedMarker);
+        } else {
+            spdlog::error("Vulkan Error: {}{}", message.text.data(), truncatedMarker);
+        }
+    }
+
+    void ValidationSink::Run(std::stop_token stopToken) {
+        VENG_PROFILE_THREAD_NAME("Validation");
+        while (!stopToken.stop_requested()) {
+            Drain();
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+}
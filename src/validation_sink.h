@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace veng {
+
+    struct ValidationMessage {
+        static constexpr std::size_t kMaxTextLength = 1024;
+        static constexpr std::size_t kMaxIdNameLength = 128;
+
+        std::int32_t messageId = 0;
+        VkDebugUtilsMessageSeverityFlagBitsEXT severity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
+        std::array<char, kMaxIdNameLength> idName{};
+        std::array<char, kMaxTextLength> text{};
+        // Set when the message did not fit in text and was cut short.
+        bool truncated = false;
+    };
+
+    // Collects validation messages from whichever thread the driver reports them on without taking a lock or
+    // allocating. A background thread drains the ring, folds repeats of the same message (ID name and number) into
+    // counters and only logs each one a limited number of times per second. Messages dropped because the ring was
+    // full are counted per ID number on the reporting thread.
+    class ValidationSink final {
+    public:
+        using ErrorHook = std::function<void(const ValidationMessage&)>;
+
+        static constexpr std::size_t kRingCapacity = 1024;
+        static constexpr std::size_t kDroppedIdCapacity = 64;
+        static constexpr std::uint32_t kDefaultMessagesPerSecond = 4;
+
+        explicit ValidationSink(std::uint32_t messagesPerSecondPerId = kDefaultMessagesPerSecond);
+        ~ValidationSink();
+
+        ValidationSink(const ValidationSink&) = delete;
+        ValidationSink& operator=(const ValidationSink&) = delete;
+
+        void Push(VkDebugUtilsMessageSeverityFlagBitsEXT severity, const VkDebugUtilsMessengerCallbackDataEXT& data);
+
+        // The hook runs synchronously on the reporting thread so a debugger stops at the offending call. Safe to call
+        // while messages are being reported; the hook must not set the hook again.
+        void SetErrorHook(ErrorHook hook);
+        void SetBreakOnError(bool enabled);
+
+    private:
+        struct Slot {
+            std::atomic<std::size_t> sequence = 0;
+            ValidationMessage message;
+        };
+
+        // Key is the message ID number tagged with bit 32, so zero marks an unused entry.
+        struct DroppedCounter {
+            std::atomic<std::uint64_t> key = 0;
+            std::atomic<std::uint64_t> count = 0;
+        };
+
+        using MessageKey = std::pair<std::string, std::int32_t>;
+
+        struct MessageCounter {
+            std::uint64_t total = 0;
+            std::uint64_t suppressed = 0;
+            std::uint64_t suppressedThisWindow = 0;
+            std::uint32_t loggedThisWindow = 0;
+            std::chrono::steady_clock::time_point windowStart;
+        };
+
+        void CountDropped(std::int32_t messageId);
+        bool TryPop(ValidationMessage& message);
+        void Drain();
+        void Log(const ValidationMessage& message);
+        void Run(std::stop_token stopToken);
+
+        std::array<Slot, kRingCapacity> ring;
+        std::atomic<std::size_t> enqueuePosition = 0;
+        std::size_t dequeuePosition = 0;
+        std::atomic<std::uint64_t> droppedCount = 0;
+        std::array<DroppedCounter, kDroppedIdCapacity> droppedById;
+
+        std::uint32_t messagesPerSecondPerId = kDefaultMessagesPerSecond;
+        std::map<MessageKey, MessageCounter> counters;
+        // Only errors touch the hook, so the lock stays off the path of ordinary messages.
+        std::mutex errorHookMutex;
+        std::atomic<bool> hasErrorHook = false;
+        ErrorHook errorHook;
+
+        std::jthread worker;
+    };
+}
@@ -0,0 +1,209 @@
+#include <precomp.h>
+#include <vertex_formats.h>
+#include <bit>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#include <immintrin.h>
+// GCC and Clang can compile the F16C path on any x86 build and pick it at run time, MSVC only when /arch:AVX2 is set.
+#if defined(__GNUC__) || defined(__clang__)
+#define VENG_VERTEX_F16C 1
+#define VENG_TARGET_F16C __attribute__((target("avx,f16c")))
+#elif defined(__AVX2__)
+#define VENG_VERTEX_F16C 1
+#define VENG_TARGET_F16C
+#endif
+#endif
+
+namespace veng {
+
+    std::uint32_t GetVertexStride(VertexLayout layout) {
+        return layout == VertexLayout::Compact ? sizeof(CompactVertex) : sizeof(Vertex);
+    }
+
+    VkVertexInputBindingDescription GetVertexBindingDescription(VertexLayout layout) {
+        VkVertexInputBindingDescription description = {};
+        description.binding = 0;
+        description.stride = GetVertexStride(layout);
+        description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+        return description;
+    }
+
+    std::array<VkVertexInputAttributeDescription, 3> GetVertexAttributeDescriptions(VertexLayout layout) {
+        std::array<VkVertexInputAttributeDescription, 3> descriptions = {};
+        for (std::uint32_t location = 0; location < descriptions.size(); ++location) {
+            descriptions[location].binding = 0;
+            descriptions[location].location = location;
+        }
+
+        // Both layouts feed the same shader inputs, the formats expand to floats during vertex fetch.
+        if (layout == VertexLayout::Compact) {
+            descriptions[0].format = VK_FORMAT_R16G16B16A16_SFLOAT;
+            descriptions[0].offset = offsetof(CompactVertex, position);
+            descriptions[1].format = VK_FORMAT_R16G16_SNORM;
+            descriptions[1].offset = offsetof(CompactVertex, normal);
+            descriptions[2].format = VK_FORMAT_R16G16_SFLOAT;
+            descriptions[2].offset = offsetof(CompactVertex, uv);
+        } else {
+            descriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+            descriptions[0].offset = offsetof(Vertex, position);
+            descriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+            descriptions[1].offset = offsetof(Vertex, normal);
+            descriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
+            descriptions[2].offset = offsetof(Vertex, uv);
+        }
+        return descriptions;
+    }
+
+    std::uint16_t FloatToHalf(float value) {
+        // Round to nearest even, the same rounding F16C uses, so both encoder paths agree bit for bit.
+        std::uint32_t bits = std::bit_cast<std::uint32_t>(value);
+        const std::uint32_t sign = (bits >> 16) & 0x8000u;
+        bits &= 0x7fffffffu;
+
+        if (bits >= 0x47800000u) {
+            return static_cast<std::uint16_t>(sign | (bits > 0x7f800000u ? 0x7e00u : 0x7c00u));
+        }
+
+        if (bits < 0x38800000u) {
+            // Adding 0.5 lines the half denormal up with the float mantissa and lets the FPU do the rounding.
+            const float shifted = std::bit_cast<float>(bits) + 0.5f;
+            return static_cast<std::uint16_t>(sign | (std::bit_cast<std::uint32_t>(shifted) - 0x3f000000u));
+        }
+
+        const std::uint32_t mantissaOdd = (bits >> 13) & 1u;
+        bits += 0xc8000fffu + mantissaOdd;
+        return static_cast<std::uint16_t>(sign | (bits >> 13));
+    }
+
+    float HalfToFloat(std::uint16_t value) {
+        const std::uint32_t sign = static_cast<std::uint32_t>(value & 0x8000u) << 16;
+        const std::uint32_t exponent = (value >> 10) & 0x1fu;
+        const std::uint32_t mantissa = value & 0x3ffu;
+
+        if (exponent == 0) {
+            const float magnitude = std::ldexp(static_cast<float>(mantissa), -24);
+            return sign != 0 ? -magnitude : magnitude;
+        }
+        if (exponent == 31) {
+            return std::bit_cast<float>(sign | 0x7f800000u | (mantissa << 13));
+        }
+        return std::bit_cast<float>(sign | ((exponent + 112) << 23) | (mantissa << 13));
+    }
+
+    std::array<std::int16_t, 2> EncodeOctahedral(glm::vec3 normal) {
+        const float sum = std::max(std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z), std::numeric_limits<float>::min());
+        float x = normal.x / sum;
+        float y = normal.y / sum;
+
+        // The lower hemisphere is folded over the diagonals onto the outer triangles of the square.
+        if (normal.z < 0.0f) {
+            const float foldedX = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            const float foldedY = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+            x = foldedX;
+            y = foldedY;
+        }
+
+        return {static_cast<std::int16_t>(std::nearbyint(std::clamp(x, -1.0f, 1.0f) * 32767.0f)),
+                static_cast<std::int16_t>(std::nearbyint(std::clamp(y, -1.0f, 1.0f) * 32767.0f))};
+    }
+
+    void CompressVerticesScalar(gsl::span<const Vertex> vertices, gsl::span<CompactVertex> compressed) {
+        for (std::size_t i = 0; i < vertices.size(); ++i) {
+            const Vertex& vertex = vertices[i];
+            CompactVertex& target = compressed[i];
+            target.position = {FloatToHalf(vertex.position.x), FloatToHalf(vertex.position.y), FloatToHalf(vertex.position.z), 0};
+            target.normal = EncodeOctahedral(vertex.normal);
+            target.uv = {FloatToHalf(vertex.uv.x), FloatToHalf(vertex.uv.y)};
+        }
+    }
+
+#if defined(VENG_VERTEX_F16C)
+    VENG_TARGET_F16C static __m128i ConvertToHalf(const float* values) {
+        return _mm256_cvtps_ph(_mm256_load_ps(values), _MM_FROUND_TO_NEAREST_INT);
+    }
+
+    VENG_TARGET_F16C static __m128i ConvertToSnorm16(__m256 values) {
+        const __m256 clamped = _mm256_min_ps(_mm256_max_ps(values, _mm256_set1_ps(-1.0f)), _mm256_set1_ps(1.0f));
+        const __m256i integers = _mm256_cvtps_epi32(_mm256_mul_ps(clamped, _mm256_set1_ps(32767.0f)));
+        return _mm_packs_epi32(_mm256_castsi256_si128(integers), _mm256_extractf128_si256(integers, 1));
+    }
+
+    // Transposes eight vertices at a time into lanes, mirroring CompressVerticesScalar operation for operation.
+    VENG_TARGET_F16C static std::size_t CompressVerticesF16C(gsl::span<const Vertex> vertices, gsl::span<CompactVertex> compressed) {
+        constexpr std::size_t kLanes = 8;
+        alignas(32) std::array<std::array<float, kLanes>, 8> lanes;
+        alignas(16) std::array<std::array<std::uint16_t, kLanes>, 5> halves;
+        alignas(16) std::array<std::array<std::int16_t, kLanes>, 2> octahedral;
+
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 minusOne = _mm256_set1_ps(-1.0f);
+        const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+        std::size_t first = 0;
+        for (; first + kLanes <= vertices.size(); first += kLanes) {
+            for (std::size_t lane = 0; lane < kLanes; ++lane) {
+                const Vertex& vertex = vertices[first + lane];
+                lanes[0][lane] = vertex.position.x;
+                lanes[1][lane] = vertex.position.y;
+                lanes[2][lane] = vertex.position.z;
+                lanes[3][lane] = vertex.uv.x;
+                lanes[4][lane] = vertex.uv.y;
+                lanes[5][lane] = vertex.normal.x;
+                lanes[6][lane] = vertex.normal.y;
+                lanes[7][lane] = vertex.normal.z;
+            }
+
+            for (std::size_t component = 0; component < halves.size(); ++component) {
+                _mm_store_si128(reinterpret_cast<__m128i*>(halves[component].data()), ConvertToHalf(lanes[component].data()));
+            }
+
+            const __m256 normalX = _mm256_load_ps(lanes[5].data());
+            const __m256 normalY = _mm256_load_ps(lanes[6].data());
+            const __m256 normalZ = _mm256_load_ps(lanes[7].data());
+
+            __m256 sum = _mm256_add_ps(_mm256_add_ps(_mm256_and_ps(normalX, absMask), _mm256_and_ps(normalY, absMask)),
+                                       _mm256_and_ps(normalZ, absMask));
+            sum = _mm256_max_ps(sum, _mm256_set1_ps(std::numeric_limits<float>::min()));
+            const __m256 x = _mm256_div_ps(normalX, sum);
+            const __m256 y = _mm256_div_ps(normalY, sum);
+
+            const __m256 signX = _mm256_blendv_ps(minusOne, one, _mm256_cmp_ps(x, zero, _CMP_GE_OQ));
+            const __m256 signY = _mm256_blendv_ps(minusOne, one, _mm256_cmp_ps(y, zero, _CMP_GE_OQ));
+            const __m256 foldedX = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_and_ps(y, absMask)), signX);
+            const __m256 foldedY = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_and_ps(x, absMask)), signY);
+            const __m256 lowerHemisphere = _mm256_cmp_ps(normalZ, zero, _CMP_LT_OQ);
+
+            _mm_store_si128(reinterpret_cast<__m128i*>(octahedral[0].data()), ConvertToSnorm16(_mm256_blendv_ps(x, foldedX, lowerHemisphere)));
+            _mm_store_si128(reinterpret_cast<__m128i*>(octahedral[1].data()), ConvertToSnorm16(_mm256_blendv_ps(y, foldedY, lowerHemisphere)));
+
+            for (std::size_t lane = 0; lane < kLanes; ++lane) {
+                CompactVertex& target = compressed[first + lane];
+                target.position = {halves[0][lane], halves[1][lane], halves[2][lane], 0};
+                target.normal = {octahedral[0][lane], octahedral[1][lane]};
+                target.uv = {halves[3][lane], halves[4][lane]};
+            }
+        }
+        return first;
+    }
+
+    static bool IsF16CSupported() {
+#if defined(__GNUC__) || defined(__clang__)
+        static const bool supported = __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+        return supported;
+#else
+        return true;
+#endif
+    }
+#endif
+
+    void CompressVertices(gsl::span<const Vertex> vertices, gsl::span<CompactVertex> compressed) {
+        std::size_t compressedCount = 0;
+#if defined(VENG_VERTEX_F16C)
+        if (IsF16CSupported()) {
+            compressedCount = CompressVerticesF16C(vertices, compressed);
+        }
+#endif
+        CompressVerticesScalar(vertices.subspan(compressedCount), compressed.subspan(compressedCount));
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+namespace veng {
+
+    // Full precision vertex as produced by importers, also the reference layout compact meshes are measured against.
+    struct Vertex {
+        glm::vec3 position = glm::vec3(0.0f);
+        glm::vec3 normal = glm::vec3(0.0f, 0.0f, 1.0f);
+        glm::vec2 uv = glm::vec2(0.0f);
+    };
+
+    // Half-float position and uv with an octahedral snorm16 normal, half the size of Vertex.
+    struct CompactVertex {
+        std::array<std::uint16_t, 4> position = {};
+        std::array<std::int16_t, 2> normal = {};
+        std::array<std::uint16_t, 2> uv = {};
+    };
+
+    static_assert(sizeof(CompactVertex) == 16);
+
+    enum class VertexLayout {
+        Float32,
+        Compact,
+    };
+
+    constexpr std::size_t kVertexLayoutCount = 2;
+
+    std::uint32_t GetVertexStride(VertexLayout layout);
+    VkVertexInputBindingDescription GetVertexBindingDescription(VertexLayout layout);
+    std::array<VkVertexInputAttributeDescription, 3> GetVertexAttributeDescriptions(VertexLayout layout);
+
+    std::uint16_t FloatToHalf(float value);
+    float HalfToFloat(std::uint16_t value);
+    std::array<std::int16_t, 2> EncodeOctahedral(glm::vec3 normal);
+
+    // Uses F16C and SSE where the build targets them and falls back to CompressVerticesScalar otherwise.
+    void CompressVertices(gsl::span<const Vertex> vertices, gsl::span<CompactVertex> compressed);
+    void CompressVerticesScalar(gsl::span<const Vertex> vertices, gsl::span<CompactVertex> compressed);
+}